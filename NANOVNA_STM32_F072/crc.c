@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+void crc32_init(void)
+{
+  rccEnableAHB(RCC_AHBENR_CRCEN, false);
+  // Default CRC-32 polynomial and 32 bit size (reset values)
+  CRC->POL = 0x04C11DB7;
+  CRC->INIT = 0xFFFFFFFF;
+}
+
+// CRC unit calculate MSB first, input bit reversal by word (REV_IN) and output reversal (REV_OUT)
+// give reflected software CRC-32 result, reset value of INIT (0xFFFFFFFF) is reflected start value
+// crc - 0xFFFFFFFF start new calculation (unit reset), else continue from unit state,
+//       crc must be result of previous call (unit used only here, calls not interleaved)
+uint32_t crc32_calc(uint32_t crc, const void *data, uint32_t len)
+{
+  const uint32_t *p = (const uint32_t *)data;
+  CRC->CR = crc == 0xFFFFFFFF ? CRC_CR_REV_IN | CRC_CR_REV_OUT | CRC_CR_RESET : CRC_CR_REV_IN | CRC_CR_REV_OUT;
+  for (; len >= sizeof(uint32_t); len-= sizeof(uint32_t))
+    CRC->DR = *p++;
+  if (len) {
+    // Not aligned tail bytes (not used in storage), byte write need bit reversal by byte
+    const uint8_t *b = (const uint8_t *)p;
+    CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT;
+    while (len--)
+      *(__IO uint8_t *)&CRC->DR = *b++;
+  }
+  return CRC->DR;
+}
@@ -33,18 +33,25 @@ void flash_erase_pages(uint32_t page_address, uint32_t size)
     flash_erase_page0(page_address);
 }
 
+// Write one half word to erased flash
+void flash_program_half_word(uint16_t* dst, uint16_t data)
+{
+  __IO uint16_t* p = dst;
+  if (FLASH->CR & FLASH_CR_LOCK)
+    flash_unlock();
+  flash_wait_for_last_operation();
+  FLASH->CR|= FLASH_CR_PG;
+  *p = data;
+  flash_wait_for_last_operation();
+  FLASH->CR&=~FLASH_CR_PG;
+}
+
 void flash_program_half_word_buffer(uint16_t* dst, uint16_t *data, uint16_t size)
 {
   uint32_t i;
   // unlock, and erase flash pages for buffer (aligned to FLASH_PAGESIZE)
   flash_erase_pages((uint32_t)dst, size);
   // Save buffer
-  __IO uint16_t* p = dst;
-  for (i = 0; i < size/sizeof(uint16_t); i++){
-    flash_wait_for_last_operation();
-    FLASH->CR|= FLASH_CR_PG;
-    p[i] = data[i];
-    flash_wait_for_last_operation();
-    FLASH->CR&=~FLASH_CR_PG;
-  }
+  for (i = 0; i < size/sizeof(uint16_t); i++)
+    flash_program_half_word(&dst[i], data[i]);
 }
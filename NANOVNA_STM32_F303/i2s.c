@@ -29,6 +29,7 @@
 
 /*
  * Run I2S bus in Circular mode, fill buffer, and handle read in I2S DMA RX interrupt
+ * Can be called again for change buffer size (slave receive restart on next frame sync)
  */
 void initI2S(void *buffer, uint16_t count) {
   const uint16_t  I2S_DMA_RX_ccr = 0
@@ -42,6 +43,9 @@ void initI2S(void *buffer, uint16_t count) {
     | STM32_DMA_CR_TCIE        // Full transfer complete interrupt enable
 //  | STM32_DMA_CR_TEIE        // Transfer error interrupt enable
     ;
+  // Stop I2S and DMA if run
+  SPI2->I2SCFGR = 0;
+  dmaChannelDisable(I2S_DMA_RX);
   // I2S RX DMA setup.
   nvicEnableVector(STM32_SPI2_RX_DMA_IRQ_NUMBER, STM32_I2S_SPI2_IRQ_PRIORITY);
   dmaChannelSetTransactionSize(I2S_DMA_RX, count);                 // number of data register
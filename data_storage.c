@@ -24,11 +24,395 @@
 #include <string.h>
 
 uint16_t lastsaveid = 0;
-#if SAVEAREA_MAX >= 8
+// Calibration data used in place from this flash slot (NULL - cal_data in RAM actual), copy to RAM on first write
+static const properties_t *cal_in_flash = NULL;
+
+#ifdef __USE_PACKED_CAL__
+_Static_assert(PROPS_HEADER_SIZE % sizeof(uint32_t) == 0, "Packed properties header need align by 4");
+#endif
+
+#ifdef __USE_FLASH_JOURNAL__
+#ifndef __USE_PACKED_CAL__
+#error "__USE_FLASH_JOURNAL__ require __USE_PACKED_CAL__"
+#endif
+// Journaled storage: config and cal slots saved as records, old record stay valid until new record written
+// Record: header, data, crc. Crc write last, so record valid only after full write (safe on power loss)
+// On first access log replayed, for every id cached offset of record with max sequence number
+// Record crc checked only on first access to it data
+// Cal slot record saved in next free block (block size = erase pages of one record, live records never moved),
+// so every save erase only own block and blocks used in turn (wear leveling)
+// Config records appended to config pages, page erased only on switch to it
+typedef struct {
+  uint16_t magic;
+  uint16_t id;     // 0 ... SAVEAREA_MAX - 1 cal slots, JOURNAL_ID_CONFIG config
+  uint32_t seq;    // record sequence number, bigger is newer
+  uint32_t size;   // data size
+  uint32_t crc;    // crc32 of header (before crc field) and data
+} journal_record_t;
+
+#define JOURNAL_MAGIC            0x4A4E
+#define JOURNAL_ID_CONFIG        SAVEAREA_MAX
+#define JOURNAL_ID_COUNT        (SAVEAREA_MAX + 1)
+#define JOURNAL_NONE             0xFFFFFFFF
+#define JOURNAL_PAGE_CEIL(x)    (((x) + FLASH_PAGESIZE - 1) & ~(FLASH_PAGESIZE - 1))
+#define JOURNAL_LEN(size)       ((sizeof(journal_record_t) + (size) + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1))
+#define JOURNAL_RECORD(offset)  ((const journal_record_t *)(SAVE_CONFIG_ADDR + (offset)))
+// Cal slot record data: properties_t header and float16 cal data (not need checksum)
+#define JOURNAL_PROPS_SIZE      (PROPS_PACKED_SIZE - sizeof(uint32_t))
+// Cal blocks at area start, config pages use rest (min 2 pages, one page erased while other have last record)
+#define JOURNAL_BLOCK_SIZE       JOURNAL_PAGE_CEIL(JOURNAL_LEN(JOURNAL_PROPS_SIZE))
+#define JOURNAL_BLOCK_COUNT     ((SAVE_FULL_AREA_SIZE - 2 * FLASH_PAGESIZE) / JOURNAL_BLOCK_SIZE)
+#define JOURNAL_CONFIG_START    (JOURNAL_BLOCK_COUNT * JOURNAL_BLOCK_SIZE)
+// One free block need for save slot (old record live until new written)
+_Static_assert(JOURNAL_BLOCK_COUNT >= SAVEAREA_MAX + 1, "Journal save area too small for SAVEAREA_MAX slots");
+_Static_assert(JOURNAL_LEN(sizeof(config_t)) <= FLASH_PAGESIZE, "Journal config record not fit in page");
+_Static_assert(JOURNAL_ID_COUNT < 32, "Journal id overflow journal_checked mask");
+
+// Offset of last record for every id (JOURNAL_NONE if not saved)
+static uint32_t journal_index[JOURNAL_ID_COUNT];
+// Config write position
+static uint32_t journal_head;
+// Last written cal block (next save use next free block)
+static uint32_t journal_block;
+// Next record sequence number (0 - log need replay)
+static uint32_t journal_seq = 0;
+// Last record crc checked mask (crc checked only on first access to record data)
+static uint32_t journal_checked;
+
+#ifndef __USE_HW_CRC__
+// CRC-32 (IEEE 802.3, reflected), nibble table, same result as CPU CRC unit
+static uint32_t
+crc32_calc(uint32_t crc, const void *data, uint32_t len)
+{
+  static const uint32_t crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+  };
+  const uint8_t *p = data;
+  while (len--) {
+    crc^= *p++;
+    crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+    crc = (crc >> 4) ^ crc_table[crc & 0x0F];
+  }
+  return crc;
+}
+#endif
+
+static uint32_t
+journal_record_crc(const journal_record_t *r)
+{
+  uint32_t crc = crc32_calc(0xFFFFFFFF, r, offsetof(journal_record_t, crc));
+  return ~crc32_calc(crc, r + 1, r->size);
+}
+
+static uint32_t
+journal_data_size(uint32_t id)
+{
+  return id == JOURNAL_ID_CONFIG ? sizeof(config_t) : JOURNAL_PROPS_SIZE;
+}
+
+// Config page start from pos (wrap to config area start)
+static uint32_t
+journal_config_page(uint32_t pos)
+{
+  pos = JOURNAL_PAGE_CEIL(pos);
+  return pos >= SAVE_FULL_AREA_SIZE ? JOURNAL_CONFIG_START : pos;
+}
+
+// Next cal block after last written, not used by last slot records (blocks more SAVEAREA_MAX, so free block always exist)
+static uint32_t
+journal_next_block(void)
+{
+  uint32_t block = journal_block, pos, i;
+  do {
+    block = (block + 1) % JOURNAL_BLOCK_COUNT;
+    pos = block * JOURNAL_BLOCK_SIZE;
+    for (i = 0; i < SAVEAREA_MAX; i++)
+      if (journal_index[i] == pos) break;
+  } while (i < SAVEAREA_MAX);
+  return block;
+}
+
+#ifdef __USE_FAST_RESUME__
+// Fast resume: journal state in RTC backup registers (updated after every record write and log replay),
+// on boot used without log replay. Backup: magic, crc of state, state (next sequence, config write position
+// and last cal block, last record offset for every id by 2 in word, offsets in words)
+// State checked: crc, last records headers, and no newer records on next write positions (flash written
+// by other firmware or power loss while write), else log replayed. Records crc checked on first access as on replay
+#define RESUME_MAGIC          0x4A525354
+#define RESUME_BACKUP_START   5                                     // 0-4 used for sweep settings (main.c)
+#define RESUME_STATE_SIZE    (2 + (JOURNAL_ID_COUNT + 1) / 2)
+#define RESUME_OFFSET_NONE    0xFFFF
+_Static_assert(RESUME_BACKUP_START + 2 + RESUME_STATE_SIZE <= BACKUP_COUNT, "Fast resume state not fit in backup registers");
+_Static_assert(SAVE_FULL_AREA_SIZE / sizeof(uint32_t) < RESUME_OFFSET_NONE, "Fast resume offset overflow");
+
+static void
+journal_resume_save(void)
+{
+  uint32_t state[RESUME_STATE_SIZE] = {journal_seq, journal_head / sizeof(uint32_t) | (journal_block << 16)}, id, i;
+  for (id = 0; id < JOURNAL_ID_COUNT; id++) {
+    uint32_t v = journal_index[id] == JOURNAL_NONE ? RESUME_OFFSET_NONE : journal_index[id] / sizeof(uint32_t);
+    state[2 + id / 2]|= v << (16 * (id & 1));
+  }
+  set_backup_data32(RESUME_BACKUP_START, 0);                          // not valid while update
+  for (i = 0; i < RESUME_STATE_SIZE; i++)
+    set_backup_data32(RESUME_BACKUP_START + 2 + i, state[i]);
+  set_backup_data32(RESUME_BACKUP_START + 1, crc32_calc(0xFFFFFFFF, state, sizeof(state)));
+  set_backup_data32(RESUME_BACKUP_START, RESUME_MAGIC);
+}
+
+static void
+journal_resume_clear(void)
+{
+  set_backup_data32(RESUME_BACKUP_START, 0);
+}
+
+// Record with sequence not less next on offset (not committed record skipped, as on replay)
+static bool
+journal_newer(uint32_t offset)
+{
+  const journal_record_t *r = JOURNAL_RECORD(offset);
+  return r->magic == JOURNAL_MAGIC && r->crc != JOURNAL_NONE && r->seq >= journal_seq;
+}
+
+static bool
+journal_resume(void)
+{
+  uint32_t state[RESUME_STATE_SIZE], id, i;
+  if (get_backup_data32(RESUME_BACKUP_START) != RESUME_MAGIC) return false;
+  for (i = 0; i < RESUME_STATE_SIZE; i++)
+    state[i] = get_backup_data32(RESUME_BACKUP_START + 2 + i);
+  if (crc32_calc(0xFFFFFFFF, state, sizeof(state)) != get_backup_data32(RESUME_BACKUP_START + 1)) return false;
+  journal_seq   = state[0];
+  journal_head  = (state[1] & 0xFFFF) * sizeof(uint32_t);
+  journal_block = state[1] >> 16;
+  if (journal_seq == 0 || journal_seq == JOURNAL_NONE || journal_block >= JOURNAL_BLOCK_COUNT ||
+      journal_head < JOURNAL_CONFIG_START || journal_head > SAVE_FULL_AREA_SIZE)
+    goto replay;
+  for (id = 0; id < JOURNAL_ID_COUNT; id++) {
+    uint32_t v = (state[2 + id / 2] >> (16 * (id & 1))) & 0xFFFF;
+    journal_index[id] = v == RESUME_OFFSET_NONE ? JOURNAL_NONE : v * sizeof(uint32_t);
+    if (journal_index[id] == JOURNAL_NONE) continue;
+    const journal_record_t *r = JOURNAL_RECORD(journal_index[id]);
+    if (journal_index[id] + JOURNAL_LEN(journal_data_size(id)) > SAVE_FULL_AREA_SIZE ||
+        r->magic != JOURNAL_MAGIC || r->id != id || r->size != journal_data_size(id) ||
+        r->seq >= journal_seq || r->crc == JOURNAL_NONE)
+      goto replay;
+  }
+  if ((journal_head < SAVE_FULL_AREA_SIZE && journal_newer(journal_head)) ||
+      journal_newer(journal_config_page(journal_head)) ||
+      journal_newer(journal_next_block() * JOURNAL_BLOCK_SIZE))
+    goto replay;
+  journal_checked = 0;
+  return true;
+replay:
+  journal_seq = 0;
+  return false;
+}
+#endif
+
+// Replay log: find last record for every id, config write position (after newest config record) and last cal block
+// Fast replay check only headers and commit (crc written), crc check made on first record access
+static void
+journal_init(bool check_crc)
+{
+  uint32_t offset, id, max_seq = 0, cal_seq = 0, config_seq = 0;
+  for (id = 0; id < JOURNAL_ID_COUNT; id++)
+    journal_index[id] = JOURNAL_NONE;
+  journal_head = JOURNAL_CONFIG_START;
+  journal_block = JOURNAL_BLOCK_COUNT - 1;
+  for (offset = 0; offset + sizeof(journal_record_t) <= SAVE_FULL_AREA_SIZE;) {
+    const journal_record_t *r = JOURNAL_RECORD(offset);
+    if (r->magic != JOURNAL_MAGIC || r->id >= JOURNAL_ID_COUNT || r->size != journal_data_size(r->id) ||
+        offset + JOURNAL_LEN(r->size) > SAVE_FULL_AREA_SIZE || r->crc == JOURNAL_NONE) {
+      offset+= sizeof(uint32_t);
+      continue;
+    }
+    // Not complete record (crc write torn) not used, but write position set after it
+    if (r->seq >= max_seq) max_seq = r->seq;
+    if (r->id == JOURNAL_ID_CONFIG) {
+      if (r->seq >= config_seq) {config_seq = r->seq; journal_head = offset + JOURNAL_LEN(r->size);}
+    }
+    else if (r->seq >= cal_seq) {cal_seq = r->seq; journal_block = offset / JOURNAL_BLOCK_SIZE;}
+    if (check_crc && journal_record_crc(r) != r->crc) {
+      offset+= sizeof(uint32_t);
+      continue;
+    }
+    id = r->id;
+    if (journal_index[id] == JOURNAL_NONE || JOURNAL_RECORD(journal_index[id])->seq < r->seq)
+      journal_index[id] = offset;
+    offset+= JOURNAL_LEN(r->size);
+  }
+  journal_seq = max_seq + 1;
+  journal_checked = check_crc ? (1 << JOURNAL_ID_COUNT) - 1 : 0;
+#ifdef __USE_FAST_RESUME__
+  journal_resume_save();
+#endif
+}
+
+// Return last valid record for id
+static const journal_record_t *
+journal_record(uint32_t id)
+{
+#ifdef __USE_FAST_RESUME__
+  if (journal_seq == 0 && !journal_resume()) journal_init(false);
+#else
+  if (journal_seq == 0) journal_init(false);
+#endif
+  if (journal_index[id] == JOURNAL_NONE) return NULL;
+  if ((journal_checked & (1 << id)) == 0) {
+    const journal_record_t *r = JOURNAL_RECORD(journal_index[id]);
+    // Not complete write (power loss or flash error), replay with crc check for use previous records
+    if (journal_record_crc(r) != r->crc) {
+      journal_init(true);
+      if (journal_index[id] == JOURNAL_NONE) return NULL;
+    }
+    journal_checked|= 1 << id;
+  }
+  return JOURNAL_RECORD(journal_index[id]);
+}
+
+static const void *
+journal_data(uint32_t id)
+{
+  const journal_record_t *r = journal_record(id);
+  return r ? r + 1 : NULL;
+}
+
+// Flash erased from offset (not complete record on power loss can be after last valid)
+static bool
+journal_erased(uint32_t offset, uint32_t len)
+{
+  const uint32_t *p = (const uint32_t *)(SAVE_CONFIG_ADDR + offset);
+  for (len/= sizeof(uint32_t); len; len--)
+    if (*p++ != JOURNAL_NONE) return false;
+  return true;
+}
+
+// Write position: config append to page (on page end or not erased use next page), cal slot in next free block
+static uint32_t
+journal_position(uint32_t id, uint32_t len)
+{
+  uint32_t pos;
+  if (id == JOURNAL_ID_CONFIG) {
+    pos = journal_head;
+    if ((pos & (FLASH_PAGESIZE - 1)) && pos + len <= JOURNAL_PAGE_CEIL(pos) && journal_erased(pos, len))
+      return pos;
+    // Next config page, erase it (last config record before it)
+    pos = journal_config_page(pos);
+    flash_erase_pages(SAVE_CONFIG_ADDR + pos, FLASH_PAGESIZE);
+    return pos;
+  }
+  journal_block = journal_next_block();
+  pos = journal_block * JOURNAL_BLOCK_SIZE;
+  flash_erase_pages(SAVE_CONFIG_ADDR + pos, JOURNAL_BLOCK_SIZE);
+  return pos;
+}
+
+// Append record: data (size bytes) and if cal != NULL, after data cal data packed to float16
+static int
+journal_write(uint32_t id, const void *data, uint32_t size, const float *cal)
+{
+  uint32_t i, pos, crc, len = JOURNAL_LEN(journal_data_size(id));
+  // Check all last records before write (not complete record hide previous valid, it can be erased)
+  for (i = 0; i < JOURNAL_ID_COUNT; i++)
+    journal_record(i);
+  pos = journal_position(id, len);
+  const journal_record_t *r = JOURNAL_RECORD(pos);
+  journal_record_t header = {JOURNAL_MAGIC, id, journal_seq, journal_data_size(id), JOURNAL_NONE};
+  // Write header (without crc), data
+  uint16_t *dst = (uint16_t *)r;
+  const uint16_t *src = (const uint16_t *)&header;
+  for (i = 0; i < offsetof(journal_record_t, crc) / sizeof(uint16_t); i++)
+    flash_program_half_word(dst++, src[i]);
+  dst = (uint16_t *)(r + 1);
+  src = (const uint16_t *)data;
+  for (i = 0; i < (size + 1) / sizeof(uint16_t); i++)
+    flash_program_half_word(dst++, src[i]);
+  if (cal)
+    for (i = 0; i < CAL_TYPE_COUNT * POINTS_COUNT * 2; i++)
+      flash_program_half_word(dst++, float_to_half(cal[i]));
+  // Commit record: crc calculated on written flash data
+  crc = journal_record_crc(r);
+  dst = (uint16_t *)&r->crc;
+  flash_program_half_word(dst++, crc);
+  flash_program_half_word(dst++, crc >> 16);
+  journal_index[id] = pos;
+  journal_checked|= 1 << id;
+  if (id == JOURNAL_ID_CONFIG) journal_head = pos + len;
+  journal_seq++;
+#ifdef __USE_FAST_RESUME__
+  journal_resume_save();
+#endif
+  return 0;
+}
+
+int
+config_save(void)
+{
+  // Apply magic word (journal record have crc)
+  config.magic = CONFIG_MAGIC;
+  return journal_write(JOURNAL_ID_CONFIG, &config, sizeof(config_t), NULL);
+}
+
+int
+config_recall(void)
+{
+  const config_t *src = journal_data(JOURNAL_ID_CONFIG);
+  if (src == NULL || src->magic != CONFIG_MAGIC)
+    return -1;
+  // duplicated saved data onto sram to be able to modify marker/trace
+  memcpy(&config, src, sizeof(config_t));
+  return 0;
+}
+
+int
+caldata_save(uint32_t id)
+{
+  if (id >= SAVEAREA_MAX)
+    return -1;
+  caldata_unref();  // slot can be used in place, get RAM copy before write
+  // write header with packed magic, after float16 cal data
+  current_props.magic = PROPS_PACKED_MAGIC;
+  int ret = journal_write(id, &current_props, PROPS_HEADER_SIZE, &cal_data[0][0][0]);
+  current_props.magic = PROPS_MAGIC;
+  if (ret)
+    return ret;
+  lastsaveid = id;
+  return 0;
+}
+
+const properties_t *
+get_properties(uint32_t id)
+{
+  if (id >= SAVEAREA_MAX)
+    return NULL;
+  // point to last record data on the flash memory, only header fields valid (cal data packed)
+  const properties_t *src = journal_data(id);
+  if (src == NULL || src->magic != PROPS_PACKED_MAGIC)
+    return NULL;
+  return src;
+}
+
+void
+clear_all_config_prop_data(void)
+{
+  caldata_unref();
+  lastsaveid = NO_SAVE_SLOT;
+  // unlock and erase flash pages, replay empty log on next access
+  flash_erase_pages(SAVE_CONFIG_ADDR, SAVE_FULL_AREA_SIZE);
+  journal_seq = 0;
+#ifdef __USE_FAST_RESUME__
+  journal_resume_clear();
+#endif
+}
+
+#else
+#if SAVEAREA_MAX >= 16
 #error "Increase checksum_ok type for save more cache slots"
 #endif
-// properties CRC check cache (max 8 slots)
-static uint8_t checksum_ok = 0;
+// properties CRC check cache (max 16 slots)
+static uint16_t checksum_ok = 0;
 
 static uint32_t
 checksum(const void *start, size_t len)
@@ -66,12 +450,62 @@ config_recall(void)
   return 0;
 }
 
+#ifdef __USE_PACKED_CAL__
+_Static_assert(PROPS_PACKED_SIZE <= SAVE_PROP_CONFIG_SIZE, "Packed properties not fit in SAVE_PROP_CONFIG_SIZE");
+
+int
+caldata_save(uint32_t id)
+{
+  if (id >= SAVEAREA_MAX)
+    return -1;
+  caldata_unref();  // slot can be used in place, get RAM copy before erase
+  uint16_t *dst = (uint16_t*)(SAVE_PROP_CONFIG_ADDR + id * SAVE_PROP_CONFIG_SIZE);
+  const uint16_t *src = (const uint16_t *)&current_props;
+  const float *cal = &cal_data[0][0][0];
+  uint32_t i, value;
+  // erase slot and write header with packed magic, after float16 cal data
+  current_props.magic = PROPS_PACKED_MAGIC;
+  flash_erase_pages((uint32_t)dst, PROPS_PACKED_SIZE);
+  for (i = 0; i < PROPS_HEADER_SIZE / sizeof(uint16_t); i++)
+    flash_program_half_word(dst++, src[i]);
+  for (i = 0; i < CAL_TYPE_COUNT * POINTS_COUNT * 2; i++)
+    flash_program_half_word(dst++, float_to_half(cal[i]));
+  current_props.magic = PROPS_MAGIC;
+  // checksum calculated on written flash data
+  value = checksum((const void *)(SAVE_PROP_CONFIG_ADDR + id * SAVE_PROP_CONFIG_SIZE), PROPS_PACKED_SIZE - sizeof(uint32_t));
+  flash_program_half_word(dst++, value);
+  flash_program_half_word(dst++, value >> 16);
+
+  checksum_ok&= ~(1<<id);
+  lastsaveid = id;
+  return 0;
+}
+
+const properties_t *
+get_properties(uint32_t id)
+{
+  if (id >= SAVEAREA_MAX)
+    return NULL;
+  // point to saved area on the flash memory, only header fields valid (cal data packed)
+  properties_t *src = (properties_t*)(SAVE_PROP_CONFIG_ADDR + id * SAVE_PROP_CONFIG_SIZE);
+  // Check crc cache mask (made it only 1 time)
+  if (checksum_ok&(1<<id))
+    return src;
+  if (src->magic != PROPS_PACKED_MAGIC ||
+      checksum(src, PROPS_PACKED_SIZE - sizeof(uint32_t)) != *(uint32_t *)((uint8_t *)src + PROPS_PACKED_SIZE - sizeof(uint32_t)))
+    return NULL;
+  checksum_ok|=1<<id;
+  return src;
+}
+
+#else
 int
 caldata_save(uint32_t id)
 {
   if (id >= SAVEAREA_MAX)
     return -1;
 
+  caldata_unref();  // slot can be used in place, get RAM copy before erase
   // Apply magic word and calculate checksum
   current_props.magic = PROPS_MAGIC;
   current_props.checksum = checksum(&current_props, sizeof current_props - sizeof current_props.checksum);
@@ -100,10 +534,25 @@ get_properties(uint32_t id)
   return src;
 }
 
+#endif
+
+void
+clear_all_config_prop_data(void)
+{
+  caldata_unref();
+  lastsaveid = NO_SAVE_SLOT;
+  checksum_ok = 0;
+  // unlock and erase flash pages
+  flash_erase_pages(SAVE_CONFIG_ADDR, SAVE_FULL_AREA_SIZE);
+}
+
+#endif
+
+#ifdef __USE_PACKED_CAL__
 int
 caldata_recall(uint32_t id)
 {
-  lastsaveid = NO_SAVE_SLOT;
+  caldata_reset();
   if (id == NO_SAVE_SLOT) return 0;
   // point to saved area on the flash memory
   const properties_t *src = get_properties(id);
@@ -113,24 +562,84 @@ caldata_recall(uint32_t id)
   }
   // active configuration points to save data on flash memory
   lastsaveid = id;
-  // duplicated saved data onto sram to be able to modify marker/trace
-  memcpy(&current_props, src, sizeof(properties_t));
+  // copy header to sram, cal data used in place (unpack on first write)
+  memcpy(&current_props, src, PROPS_HEADER_SIZE);
+  current_props.magic = PROPS_MAGIC;
+  cal_in_flash = src;
   return 0;
 }
 
-// Used in interpolate, get current calibration slot data
-const properties_t *
-caldata_reference(void)
+void
+caldata_point(uint16_t type, uint16_t idx, float v[2])
 {
-  return get_properties(lastsaveid);
+  if (cal_in_flash) {
+    const uint16_t *p = (const uint16_t *)((const uint8_t *)cal_in_flash + PROPS_HEADER_SIZE) + (type * POINTS_COUNT + idx) * 2;
+    v[0] = half_to_float(p[0]);
+    v[1] = half_to_float(p[1]);
+    return;
+  }
+  v[0] = cal_data[type][idx][0];
+  v[1] = cal_data[type][idx][1];
 }
 
 void
-clear_all_config_prop_data(void)
+caldata_unref(void)
 {
+  if (cal_in_flash == NULL) return;
+  const uint16_t *packed = (const uint16_t *)((const uint8_t *)cal_in_flash + PROPS_HEADER_SIZE);
+  float *cal = &cal_data[0][0][0];
+  for (uint32_t i = 0; i < CAL_TYPE_COUNT * POINTS_COUNT * 2; i++)
+    cal[i] = half_to_float(packed[i]);
+  cal_in_flash = NULL;
+}
+#else
+int
+caldata_recall(uint32_t id)
+{
+  caldata_reset();
+  if (id == NO_SAVE_SLOT) return 0;
+  // point to saved area on the flash memory
+  const properties_t *src = get_properties(id);
+  if (src == NULL){
+    load_default_properties();
+    return 1;
+  }
+  // active configuration points to save data on flash memory
+  lastsaveid = id;
+  // duplicated saved data onto sram to be able to modify marker/trace, cal data used in place (copy on first write)
+  memcpy(&current_props, src, offsetof(properties_t, _cal_data));
+  cal_in_flash = src;
+  return 0;
+}
+
+void
+caldata_point(uint16_t type, uint16_t idx, float v[2])
+{
+  const float *p = cal_in_flash ? cal_in_flash->_cal_data[type][idx] : cal_data[type][idx];
+  v[0] = p[0];
+  v[1] = p[1];
+}
+
+void
+caldata_unref(void)
+{
+  if (cal_in_flash == NULL) return;
+  memcpy(cal_data, cal_in_flash->_cal_data, sizeof(cal_data));
+  cal_in_flash = NULL;
+}
+#endif
+
+// Drop recalled slot (cal data not copied to RAM), need call before overwrite current_props
+void
+caldata_reset(void)
+{
+  cal_in_flash = NULL;
   lastsaveid = NO_SAVE_SLOT;
-  checksum_ok = 0;
-  // unlock and erase flash pages
-  flash_erase_pages(SAVE_CONFIG_ADDR, SAVE_FULL_AREA_SIZE);
 }
 
+// Used in interpolate, get current calibration slot data
+const properties_t *
+caldata_reference(void)
+{
+  return get_properties(lastsaveid);
+}
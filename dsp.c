@@ -20,17 +20,21 @@
  */
 
 #include "nanovna.h"
+#include <string.h>
+
+// sin/cos table read as int32_t pairs, Cortex M0 not support unaligned access
+#define DSP_TABLE_ALIGN __attribute__((aligned(4)))
 
 #ifdef USE_VARIABLE_OFFSET
-static int16_t sincos_tbl[AUDIO_SAMPLES_COUNT][2];
+static int16_t sincos_tbl[AUDIO_SAMPLES_COUNT][2] DSP_TABLE_ALIGN;
 void generate_DSP_Table(int offset){
-  float audio_freq  = AUDIO_ADC_FREQ;
+  float audio_freq  = ADC_FREQ;
   // N = offset * AUDIO_SAMPLES_COUNT / audio_freq; should be integer
   // AUDIO_SAMPLES_COUNT = N * audio_freq / offset; N - minimum integer value for get integer AUDIO_SAMPLES_COUNT
   // Bandwidth on one step = audio_freq / AUDIO_SAMPLES_COUNT
   float step = offset / audio_freq;
   float w = step/2;
-  for (int i=0; i<AUDIO_SAMPLES_COUNT; i++){
+  for (int i=0; i<ADC_SAMPLES_COUNT; i++){
     float s, c;
     vna_sincosf(w, &s, &c);
     sincos_tbl[i][0] = s*32700.0f;
@@ -40,7 +44,7 @@ void generate_DSP_Table(int offset){
 }
 #elif FREQUENCY_OFFSET==7000*(AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT/1000)
 // static Table for 28kHz IF and 192kHz ADC (or 7kHz IF and 48kHz ADC) audio ADC
-static const int16_t sincos_tbl[48][2] = {
+static const int16_t sincos_tbl[48][2] DSP_TABLE_ALIGN = {
   { 14493, 29389}, { 32138,  6393}, { 24636,-21605}, { -2143,-32698},
   {-27246,-18205}, {-31029, 10533}, {-10533, 31029}, { 18205, 27246},
   { 32698,  2143}, { 21605,-24636}, { -6393,-32138}, {-29389,-14493},
@@ -56,7 +60,7 @@ static const int16_t sincos_tbl[48][2] = {
 };
 #elif FREQUENCY_OFFSET==6000*(AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT/1000)
 // static Table for 12kHz IF and 96kHz ADC (or 6kHz IF and 48kHz ADC) audio ADC
-static const int16_t sincos_tbl[48][2] = {
+static const int16_t sincos_tbl[48][2] DSP_TABLE_ALIGN = {
   { 6393, 32138}, { 27246, 18205}, { 32138,-6393}, { 18205,-27246},
   {-6393,-32138}, {-27246,-18205}, {-32138, 6393}, {-18205, 27246},
   { 6393, 32138}, { 27246, 18205}, { 32138,-6393}, { 18205,-27246},
@@ -72,7 +76,7 @@ static const int16_t sincos_tbl[48][2] = {
 };
 #elif FREQUENCY_OFFSET==5000*(AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT/1000)
 // static Table for 10kHz IF and 96kHz ADC (or 5kHz IF and 48kHz ADC) audio ADC
-static const int16_t sincos_tbl[48][2] = {
+static const int16_t sincos_tbl[48][2] DSP_TABLE_ALIGN = {
   { 10533,  31029 }, { 27246,  18205 }, { 32698,  -2143 }, { 24636, -21605 },
   {  6393, -32138 }, {-14493, -29389 }, {-29389, -14493 }, {-32138,   6393 },
   {-21605,  24636 }, { -2143,  32698 }, { 18205,  27246 }, { 31029,  10533 },
@@ -88,7 +92,7 @@ static const int16_t sincos_tbl[48][2] = {
 };
 #elif FREQUENCY_OFFSET==4000*(AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT/1000)
 // static Table for 8kHz IF and 96kHz audio ADC (or 4kHz IF and 48kHz ADC) audio ADC
-static const int16_t sincos_tbl[48][2] = {
+static const int16_t sincos_tbl[48][2] DSP_TABLE_ALIGN = {
   {  4277, 32488}, { 19948, 25997}, { 30274, 12540}, { 32488, -4277},
   { 25997,-19948}, { 12540,-30274}, { -4277,-32488}, {-19948,-25997},
   {-30274,-12540}, {-32488,  4277}, {-25997, 19948}, {-12540, 30274},
@@ -104,7 +108,7 @@ static const int16_t sincos_tbl[48][2] = {
 };
 #elif FREQUENCY_OFFSET==3000*(AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT/1000)
 // static Table for 6kHz IF and 96kHz audio ADC (or 3kHz IF and 48kHz ADC) audio ADC
-static const int16_t sincos_tbl[48][2] = {
+static const int16_t sincos_tbl[48][2] DSP_TABLE_ALIGN = {
   {  3212, 32610}, { 15447, 28899}, { 25330, 20788}, { 31357,  9512},
   { 32610, -3212}, { 28899,-15447}, { 20788,-25330}, {  9512,-31357},
   { -3212,-32610}, {-15447,-28899}, {-25330,-20788}, {-31357, -9512},
@@ -120,26 +124,99 @@ static const int16_t sincos_tbl[48][2] = {
 };
 #elif FREQUENCY_OFFSET==2000*(AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT/1000)
 // static Table
-static const int16_t sincos_tbl[48][2] = {
+static const int16_t sincos_tbl[48][2] DSP_TABLE_ALIGN = {
 #error "Need check/rebuild sin cos table for DAC"
 };
 #elif FREQUENCY_OFFSET==1000*(AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT/1000)
 // static Table
-static const int16_t sincos_tbl[48][2] = {
+static const int16_t sincos_tbl[48][2] DSP_TABLE_ALIGN = {
 #error "Need check/rebuild sin cos table for DAC"
 };
 #else
 #error "Need check/rebuild sin cos table for DAC"
 #endif
 
-#ifndef __USE_DSP__
+// Used for dump current table (need for host replay)
+const int16_t *dsp_get_sincos_table(void) {
+  return &sincos_tbl[0][0];
+}
+
 // Define DSP accumulator value type
-typedef float acc_t;
+// Cortex M0 not have FPU, use integer accumulators (int64_t add = adds + adcs)
+// Cortex M4 use int64_t accumulators for DSP instructions
+typedef int64_t acc_t;
 typedef float measure_t;
-acc_t acc_samp_s;
-acc_t acc_samp_c;
-acc_t acc_ref_s;
-acc_t acc_ref_c;
+static acc_t acc_samp_s;
+static acc_t acc_samp_c;
+static acc_t acc_ref_s;
+static acc_t acc_ref_c;
+
+#ifdef __USE_IF_FILTER__
+//
+// CIC3 IF filter, used as windowed integration of buffer results
+// Buffer correlation (sum of AUDIO_SAMPLES_COUNT samples) is first boxcar stage, here made
+// 3 integrators on buffer results and comb (delay M) at end, equivalent weight window
+// for N = 3*M buffers is triangle^boxcar (quadratic B-spline), sinc^3 response
+// first sidelobe -39dB (boxcar sum only -13dB), noise bandwidth ~1.65 of rectangle
+// Integrators use modular arithmetic, overflow not affect result if it fit in int64
+// max result = M^3 * 2^31, M <= (BANDWIDTH_COUNT_MAX+1)/3 = 1365, so fit
+// Not need store buffers history, only 2 integrator snapshots
+static uint16_t cic_m;       // comb delay (0 - filter disabled)
+static uint16_t cic_k;       // processed buffers count (skip first if count not aligned by 3)
+static uint64_t cic_i1[4], cic_i2[4], cic_i3[4], cic_s1[4], cic_s2[4];
+
+static void cic_reset(void) {
+  uint16_t n = config._bandwidth + 1;
+  cic_m = (config._if_filter == IF_FILTER_CIC3 && n >= 3) ? n / 3 : 0;
+  cic_k = 3 * cic_m - n;     // start from negative for skip first buffers (uint16 overflow)
+  memset(cic_i1, 0, sizeof(cic_i1));
+  memset(cic_i2, 0, sizeof(cic_i2));
+  memset(cic_i3, 0, sizeof(cic_i3));
+  memset(cic_s1, 0, sizeof(cic_s1));
+  memset(cic_s2, 0, sizeof(cic_s2));
+}
+
+static void cic_process(int64_t samp_s, int64_t samp_c, int64_t ref_s, int64_t ref_c) {
+  if ((int16_t)++cic_k <= 0) return; // skip buffer
+  uint64_t x[4] = {samp_s, samp_c, ref_s, ref_c};
+  for (int i = 0; i < 4; i++) {
+    cic_i1[i]+= x[i];
+    cic_i2[i]+= cic_i1[i];
+    cic_i3[i]+= cic_i2[i];
+  }
+  uint16_t m = cic_m;
+  if (cic_k == m) memcpy(cic_s1, cic_i3, sizeof(cic_i3));
+  else if (cic_k == 2*m) memcpy(cic_s2, cic_i3, sizeof(cic_i3));
+  else if (cic_k == 3*m) {
+    // Comb: y = I3[3M] - 3*I3[2M] + 3*I3[M], normalize to rectangle sum of 3*M buffers: y * 3 / M^2 (window sum = M^3)
+    int64_t y[4];
+    for (int i = 0; i < 4; i++)
+      y[i] = (int64_t)(cic_i3[i] - 3 * (cic_s2[i] - cic_s1[i])) / (m * m) * 3;
+#ifdef __USE_DSP__
+    acc_samp_s = y[0]<<4; acc_samp_c = y[1]<<4; acc_ref_s = y[2]<<4; acc_ref_c = y[3]<<4; // restore M4 scale
+#else
+    acc_samp_s = y[0];    acc_samp_c = y[1];    acc_ref_s = y[2];    acc_ref_c = y[3];
+#endif
+  }
+}
+#endif
+
+#ifndef __USE_DSP__
+
+// Cortex M0 kernel, load ref/smp and sin/cos pairs as one word (SWAR), unroll by 4
+// Buffer sum overflow check: |sum((smp * sin)>>4)| <= 32768/16 * sum(|sin|) < 0.962 * 2^31 for all tables
+#if AUDIO_SAMPLES_COUNT % 4
+#error "AUDIO_SAMPLES_COUNT must be aligned by 4 for dsp_process unroll"
+#endif
+#define DSP_STEP(n) {                                           \
+    int32_t sr = src[n], sc = tbl[n];                           \
+    int32_t ref = (int16_t)sr, smp = sr>>16;                    \
+    int32_t sin = (int16_t)sc, cos = sc>>16;                    \
+    samp_s+= (smp * sin)>>4;                                    \
+    samp_c+= (smp * cos)>>4;                                    \
+    ref_s += (ref * sin)>>4;                                    \
+    ref_c += (ref * cos)>>4;                                    \
+  }
 void
 dsp_process(audio_sample_t *capture, size_t length)
 {
@@ -147,18 +224,20 @@ dsp_process(audio_sample_t *capture, size_t length)
   int32_t samp_c = 0;
   int32_t ref_s = 0;
   int32_t ref_c = 0;
-  uint32_t i = 0;
+  const int32_t *src = (int32_t *)capture;           // ref | smp << 16
+  const int32_t *tbl = (int32_t *)sincos_tbl;        // sin | cos << 16
+  const int32_t *end = src + length/2;
   do{
-    int16_t ref = capture[i+0];
-    int16_t smp = capture[i+1];
-    int32_t sin = ((int16_t *)sincos_tbl)[i+0];
-    int32_t cos = ((int16_t *)sincos_tbl)[i+1];
-    samp_s+= (smp * sin)/16;
-    samp_c+= (smp * cos)/16;
-    ref_s += (ref * sin)/16;
-    ref_c += (ref * cos)/16;
-    i+=2;
-  }while (i < length);
+    DSP_STEP(0);
+    DSP_STEP(1);
+    DSP_STEP(2);
+    DSP_STEP(3);
+    src+=4;
+    tbl+=4;
+  }while (src < end);
+#ifdef __USE_IF_FILTER__
+  if (cic_m) {cic_process(samp_s, samp_c, ref_s, ref_c); return;}
+#endif
   acc_samp_s += samp_s;
   acc_samp_c += samp_c;
   acc_ref_s += ref_s;
@@ -166,19 +245,33 @@ dsp_process(audio_sample_t *capture, size_t length)
 }
 
 #else
-// Define DSP accumulator value type
-typedef int64_t acc_t;
-typedef float measure_t;
-static acc_t acc_samp_s;
-static acc_t acc_samp_c;
-static acc_t acc_ref_s;
-static acc_t acc_ref_c;
 // Cortex M4 DSP instruction use
 #include "dsp.h"
 void
 dsp_process(audio_sample_t *capture, size_t length)
 {
   uint32_t i = 0;
+#ifdef __USE_IF_FILTER__
+  if (cic_m) {
+    // Need buffer sum for filter, use local accumulators
+    acc_t samp_s = 0;
+    acc_t samp_c = 0;
+    acc_t ref_s = 0;
+    acc_t ref_c = 0;
+    do{
+      int32_t sc = ((int32_t *)sincos_tbl)[i];
+      int32_t sr = ((int32_t *)capture)[i];
+      samp_s= __smlaltb(samp_s, sr, sc ); // samp_s+= smp * sin
+      samp_c= __smlaltt(samp_c, sr, sc ); // samp_c+= smp * cos
+      ref_s = __smlalbb( ref_s, sr, sc ); //  ref_s+= ref * sin
+      ref_c = __smlalbt( ref_c, sr, sc ); //  ref_s+= ref * cos
+      i++;
+    } while (i < length/2);
+    // Reduce size (as in Cortex M0 kernel), prevent integrators result overflow
+    cic_process(samp_s>>4, samp_c>>4, ref_s>>4, ref_c>>4);
+    return;
+  }
+#endif
 //  int64_t samp_s = 0;
 //  int64_t samp_c = 0;
 //  int64_t ref_s = 0;
@@ -213,15 +306,16 @@ calculate_gamma(float gamma[2])
 {
 #if 1
   // calculate reflection coeff. by samp divide by ref
-#if 0
+#if 1
+  // Use one reciprocal and multiply (Cortex M0 soft float division much slower multiply)
+  // |ref|^2 < 2^96 for any bandwidth, fit in float, max relative error ~3e-7 (same as divide by rc)
   measure_t rs = acc_ref_s;
   measure_t rc = acc_ref_c;
-  measure_t rr = rs * rs + rc * rc;
-  //rr = vna_sqrtf(rr) * 1e8;
+  measure_t rr = 1.0f / (rs * rs + rc * rc);
   measure_t ss = acc_samp_s;
   measure_t sc = acc_samp_c;
-  gamma[0] =  (sc * rc + ss * rs) / rr;
-  gamma[1] =  (ss * rc - sc * rs) / rr;
+  gamma[0] =  (sc * rc + ss * rs) * rr;
+  gamma[1] =  (ss * rc - sc * rs) * rr;
 #else
   measure_t rs_rc = (measure_t) acc_ref_s / acc_ref_c;
   measure_t sc_rc = (measure_t)acc_samp_c / acc_ref_c;
@@ -253,6 +347,75 @@ fetch_amplitude_ref(float gamma[2])
   gamma[1] =  acc_ref_c * 1e-9;
 }
 
+#ifdef __USE_SETTLE_DETECT__
+//
+// Generator settle detection
+// IF frequency aligned to buffer size, so stable generator give same reference phasor in every buffer
+// After frequency change PLL lock and filters transient move amplitude and phase, wait until it stop
+static int32_t settle_s;
+static int32_t settle_c;
+static uint8_t settle_count;
+
+void
+dsp_settle_reset(void)
+{
+  settle_s = 0;
+  settle_c = 0;
+  settle_count = 0;
+}
+
+bool
+dsp_settle_check(audio_sample_t *capture, size_t length)
+{
+  // Reference channel only correlation, products >> 4 as in Cortex M0 kernel (buffer sum fit in int32)
+  int32_t ref_s = 0;
+  int32_t ref_c = 0;
+  const int32_t *src = (int32_t *)capture;           // ref | smp << 16
+  const int32_t *tbl = (int32_t *)sincos_tbl;        // sin | cos << 16
+  const int32_t *end = src + length/2;
+  do{
+    int32_t ref = (int16_t)*src++, sc = *tbl++;
+    ref_s+= (ref * (int16_t)sc)>>4;
+    ref_c+= (ref * (sc>>16))>>4;
+  }while (src < end);
+  // Integer only (called from I2S DMA interrupt): halved sums (delta fit in int32), squares in 64 bit
+  // |ref - prev|^2 < |ref|^2 / SETTLE_THRESHOLD^2, zero or weak ref never pass (use timeout)
+  ref_s>>= 1;
+  ref_c>>= 1;
+  int32_t ds = ref_s - settle_s;
+  int32_t dc = ref_c - settle_c;
+  settle_s = ref_s;
+  settle_c = ref_c;
+  uint64_t d2 = (uint64_t)((int64_t)ds * ds) + (uint64_t)((int64_t)dc * dc);
+  uint64_t r2 = (uint64_t)((int64_t)ref_s * ref_s) + (uint64_t)((int64_t)ref_c * ref_c);
+  if (d2 < r2 / ((uint64_t)SETTLE_THRESHOLD * SETTLE_THRESHOLD))
+    return ++settle_count >= SETTLE_BUFFERS;
+  settle_count = 0;
+  return false;
+}
+#endif
+
+#ifdef __USE_AUTO_GAIN__
+// Sample channel sine amplitude relative to ADC full scale (used for auto gain)
+// One buffer correlation = A * 32700 * ADC_SAMPLES_COUNT / 2 (Cortex M0 kernel products >> 4)
+float
+dsp_sample_level(void)
+{
+  measure_t ss = acc_samp_s;
+  measure_t sc = acc_samp_c;
+  uint16_t count = config._bandwidth + 1;
+#ifdef __USE_IF_FILTER__
+  if (cic_m) count = 3 * cic_m;   // CIC result normalized to rectangle sum
+#endif
+#ifdef __USE_DSP__
+  const float scale = 2.0f / (32700.0f * 32768.0f);
+#else
+  const float scale = 32.0f / (32700.0f * 32768.0f);
+#endif
+  return vna_sqrtf(ss * ss + sc * sc) * scale / (count * ADC_SAMPLES_COUNT);
+}
+#endif
+
 void
 reset_dsp_accumerator(void)
 {
@@ -260,4 +423,7 @@ reset_dsp_accumerator(void)
   acc_ref_c = 0;
   acc_samp_s = 0;
   acc_samp_c = 0;
+#ifdef __USE_IF_FILTER__
+  cic_reset();
+#endif
 }
@@ -19,6 +19,7 @@
  */
 
 // Cortex M4 DSP instructions assembly
+#ifdef __arm__
 
 // __smlabb inserts a SMLABB instruction. __smlabb returns the equivalent of
 //  int32_t res = x[0] * y[0] + acc
@@ -127,3 +128,18 @@ __attribute__((always_inline)) __STATIC_INLINE  int64_t __smlaltt(int64_t acc, i
     : [x] "r" (x), [y] "r" (y) : );
   return r.i_rep;
 }
+#else
+// Host build (test/), C equivalents of Cortex M4 DSP instructions
+#define DSP_BOT(v) ((int32_t)(int16_t)(v))
+#define DSP_TOP(v) ((int32_t)(v)>>16)
+__STATIC_INLINE int32_t __smlabb(int32_t x, int32_t y, int32_t acc) {return acc + DSP_BOT(x) * DSP_BOT(y);}
+__STATIC_INLINE int32_t __smlabt(int32_t x, int32_t y, int32_t acc) {return acc + DSP_BOT(x) * DSP_TOP(y);}
+__STATIC_INLINE int32_t __smlatb(int32_t x, int32_t y, int32_t acc) {return acc + DSP_TOP(x) * DSP_BOT(y);}
+__STATIC_INLINE int32_t __smlatt(int32_t x, int32_t y, int32_t acc) {return acc + DSP_TOP(x) * DSP_TOP(y);}
+__STATIC_INLINE int64_t __smlalbb(int64_t acc, int32_t x, int32_t y) {return acc + DSP_BOT(x) * DSP_BOT(y);}
+__STATIC_INLINE int64_t __smlalbt(int64_t acc, int32_t x, int32_t y) {return acc + DSP_BOT(x) * DSP_TOP(y);}
+__STATIC_INLINE int64_t __smlaltb(int64_t acc, int32_t x, int32_t y) {return acc + DSP_TOP(x) * DSP_BOT(y);}
+__STATIC_INLINE int64_t __smlaltt(int64_t acc, int32_t x, int32_t y) {return acc + DSP_TOP(x) * DSP_TOP(y);}
+#undef DSP_BOT
+#undef DSP_TOP
+#endif
@@ -81,6 +81,11 @@
 #include "NANOVNA_STM32_F072/flash.c"
 #endif
 
+// Compact STM32 CRC library (F072 and F303 have same CRC unit)
+#ifdef __USE_HW_CRC__
+#include "NANOVNA_STM32_F072/crc.c"
+#endif
+
 // Compact STM32 GPIO library
 #if HAL_USE_PAL == FALSE
 #ifdef NANOVNA_F303
@@ -120,23 +120,55 @@ void rtc_set_time(uint32_t dr, uint32_t tr);
  * Backup
  */
 #ifdef __USE_BACKUP__
-inline uint32_t get_backup_data32(uint16_t id) {
+// Backup registers count (STM32F303 have 16, STM32F072 5)
+#ifdef NANOVNA_F303
+#define BACKUP_COUNT   16
+#else
+#define BACKUP_COUNT    5
+#endif
+static inline uint32_t get_backup_data32(uint16_t id) {
   switch (id) {
     case 0: return RTC->BKP0R;
     case 1: return RTC->BKP1R;
     case 2: return RTC->BKP2R;
     case 3: return RTC->BKP3R;
     case 4: return RTC->BKP4R;
+#if BACKUP_COUNT > 5
+    case 5: return RTC->BKP5R;
+    case 6: return RTC->BKP6R;
+    case 7: return RTC->BKP7R;
+    case 8: return RTC->BKP8R;
+    case 9: return RTC->BKP9R;
+    case 10: return RTC->BKP10R;
+    case 11: return RTC->BKP11R;
+    case 12: return RTC->BKP12R;
+    case 13: return RTC->BKP13R;
+    case 14: return RTC->BKP14R;
+    case 15: return RTC->BKP15R;
+#endif
   }
   return 0;
 }
-inline void set_backup_data32(uint16_t id, uint32_t data) {
+static inline void set_backup_data32(uint16_t id, uint32_t data) {
   switch (id) {
     case 0: RTC->BKP0R = data; break;
     case 1: RTC->BKP1R = data; break;
     case 2: RTC->BKP2R = data; break;
     case 3: RTC->BKP3R = data; break;
     case 4: RTC->BKP4R = data; break;
+#if BACKUP_COUNT > 5
+    case 5: RTC->BKP5R = data; break;
+    case 6: RTC->BKP6R = data; break;
+    case 7: RTC->BKP7R = data; break;
+    case 8: RTC->BKP8R = data; break;
+    case 9: RTC->BKP9R = data; break;
+    case 10: RTC->BKP10R = data; break;
+    case 11: RTC->BKP11R = data; break;
+    case 12: RTC->BKP12R = data; break;
+    case 13: RTC->BKP13R = data; break;
+    case 14: RTC->BKP14R = data; break;
+    case 15: RTC->BKP15R = data; break;
+#endif
   }
 }
 #endif
@@ -166,12 +198,20 @@ void initI2S(void *buffer, uint16_t count);
 
 #define FLASH_PAGESIZE 0x800
 
-#define SAVEAREA_MAX 7
-
 // Depend from config_t size, should be aligned by FLASH_PAGESIZE
 #define SAVE_CONFIG_SIZE        0x00000800
 // Depend from properties_t size, should be aligned by FLASH_PAGESIZE
+#if defined(__USE_FLASH_JOURNAL__)
+// Journal: cal slots in rotated blocks (one more slots count), config in rest pages
+#define SAVE_FULL_AREA_SIZE     0x0001C000
+#define SAVEAREA_MAX 9
+#elif defined(__USE_PACKED_CAL__)
+#define SAVEAREA_MAX 11
+#define SAVE_PROP_CONFIG_SIZE   0x00002800
+#else
+#define SAVEAREA_MAX 7
 #define SAVE_PROP_CONFIG_SIZE   0x00004000
+#endif
 #else
 // For STM32F072xB CPU setting
 #define FLASH_START_ADDRESS   0x08000000
@@ -179,16 +219,26 @@ void initI2S(void *buffer, uint16_t count);
 
 #define FLASH_PAGESIZE 0x800
 
-#define SAVEAREA_MAX 5
-
 // Depend from config_t size, should be aligned by FLASH_PAGESIZE
 #define SAVE_CONFIG_SIZE        0x00000800
 // Depend from properties_t size, should be aligned by FLASH_PAGESIZE
+#if defined(__USE_FLASH_JOURNAL__)
+// Journal: cal slots in rotated blocks (one more slots count), config in rest pages
+#define SAVE_FULL_AREA_SIZE     0x00008000
+#define SAVEAREA_MAX 6
+#elif defined(__USE_PACKED_CAL__)
+#define SAVEAREA_MAX 7
+#define SAVE_PROP_CONFIG_SIZE   0x00001000
+#else
+#define SAVEAREA_MAX 5
 #define SAVE_PROP_CONFIG_SIZE   0x00001800
 #endif
+#endif
 
 // Save config_t and properties_t flash area (see flash7 from *.ld settings)
+#ifndef SAVE_FULL_AREA_SIZE
 #define SAVE_FULL_AREA_SIZE     (SAVE_CONFIG_SIZE + SAVEAREA_MAX * SAVE_PROP_CONFIG_SIZE)
+#endif
 // Save setting at end of CPU flash area
 // Config at end minus full size
 #define SAVE_CONFIG_ADDR        (FLASH_START_ADDRESS + FLASH_TOTAL_SIZE - SAVE_FULL_AREA_SIZE)
@@ -199,6 +249,16 @@ void initI2S(void *buffer, uint16_t count);
 void flash_erase_pages(uint32_t page_address, uint32_t size);
 // Write data
 void flash_program_half_word_buffer(uint16_t* dst, uint16_t *data, uint16_t size);
+void flash_program_half_word(uint16_t* dst, uint16_t data);
+
+/*
+ * CRC-32 (IEEE 802.3) on CPU CRC unit
+ */
+#ifdef __USE_HW_CRC__
+void crc32_init(void);
+// crc = 0xFFFFFFFF start new, else continue from result of previous call (unit state), data must be aligned by 4
+uint32_t crc32_calc(uint32_t crc, const void *data, uint32_t len);
+#endif
 
 /*
  * gpio.c
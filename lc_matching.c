@@ -619,4 +619,88 @@ static void prepare_s11_resonance(uint8_t type, uint8_t update_mask)
 }
 #endif //__S11_RESONANCE_MEASURE__
 
+#ifdef __S11_DTF_MEASURE__
+// Min reflection peak level for search (|S11|^2 = -60dB)
+#define MEASURE_DTF_MIN_LEVEL   1e-6f
+typedef struct {
+  dtf_peak_t data[MEASURE_DTF_COUNT];
+  uint8_t count;
+} s11_dtf_measure_t;
+static s11_dtf_measure_t *s11_dtf = (s11_dtf_measure_t *)measure_memory;
+
+static float s11_dtf_power(uint16_t i) {
+  return get_l(measured[0][i][0], measured[0][i][1]);
+}
+
+static float s11_dtf_level(uint16_t i) {
+  float p = s11_dtf_power(i);
+  return vna_log10f_x_10(p < 1e-20f ? 1e-20f : p);
+}
+
+// Distance to fault: one pass over time domain S11 data, select count max local peaks (sorted insert)
+// refine peak position and level by parabolic interpolation in dB, return found peaks count
+int measure_dtf_peaks(dtf_peak_t *peak, int count)
+{
+  uint16_t x[MEASURE_DTF_COUNT];
+  float    y[MEASURE_DTF_COUNT];
+  int i, j, n = 0;
+  // Need impulse response (step response not have peaks on reflections)
+  if ((props_mode & DOMAIN_MODE) != DOMAIN_TIME || domain_func == TD_FUNC_LOWPASS_STEP || sweep_points < 2)
+    return 0;
+  if (count > MEASURE_DTF_COUNT) count = MEASURE_DTF_COUNT;
+  // Use mirror point before 0 (lowpass impulse is symmetric)
+  float y1 = s11_dtf_power(1), y2 = s11_dtf_power(0), y3;
+  for (i = 0; i < sweep_points - 1; i++, y1 = y2, y2 = y3) {
+    y3 = s11_dtf_power(i + 1);
+    if (y2 < MEASURE_DTF_MIN_LEVEL || y2 < y1 || y2 <= y3) continue;
+    if (n == count && y2 <= y[n - 1]) continue;
+    if (n < count) n++;
+    for (j = n - 1; j > 0 && y[j - 1] < y2; j--) {
+      x[j] = x[j - 1];
+      y[j] = y[j - 1];
+    }
+    x[j] = i;
+    y[j] = y2;
+  }
+  for (j = 0; j < n; j++) {
+    i = x[j];
+    const float l1 = s11_dtf_level(i ? i - 1 : 1);
+    const float l2 = s11_dtf_level(i);
+    const float l3 = s11_dtf_level(i + 1);
+    const float a = l1 - 2 * l2 + l3;
+    float d = 0.0f, l = l2;
+    if (a < 0.0f) {
+      d = 0.5f * (l1 - l3) / a;
+      l = l2 - 0.25f * (l1 - l3) * d;
+    }
+    const float dist = distance_of_index(i);
+    peak[j].distance = dist + d * (distance_of_index(i + 1) - dist);
+    peak[j].rl = -l;
+  }
+  return n;
+}
+
+static void draw_s11_dtf(int x0, int y0){
+  int xp = STR_MEASURE_X - x0;
+  int yp = STR_MEASURE_Y - y0;
+  cell_printf(xp, yp, "S11 DTF (K=%d%%)", velocity_factor);
+  if (s11_dtf->count == 0) {
+    cell_printf(xp, yp+=STR_MEASURE_HEIGHT, (props_mode & DOMAIN_MODE) == DOMAIN_TIME ? "Not found" : "Need time domain");
+    return;
+  }
+  for (int i = 0; i < s11_dtf->count; i++)
+    cell_printf(xp, yp+=STR_MEASURE_HEIGHT, "%d: %Fm, RL %.1fdB", i + 1, s11_dtf->data[i].distance, s11_dtf->data[i].rl);
+}
+
+static void prepare_s11_dtf(uint8_t type, uint8_t update_mask)
+{
+  (void)type;
+  if (update_mask & MEASURE_UPD_SWEEP)
+    s11_dtf->count = measure_dtf_peaks(s11_dtf->data, MEASURE_DTF_COUNT);
+  // Prepare for update
+  invalidate_rect(STR_MEASURE_X                        , STR_MEASURE_Y,
+                  STR_MEASURE_X + 3 * STR_MEASURE_WIDTH, STR_MEASURE_Y + (MEASURE_DTF_COUNT + 1) * STR_MEASURE_HEIGHT);
+}
+#endif // __S11_DTF_MEASURE__
+
 #endif // __VNA_MEASURE__
@@ -81,6 +81,10 @@ static volatile vna_shellcmd_t  shell_function = 0;
 //#define ENABLE_TEST_COMMAND
 // Enable stat command, used for debug
 //#define ENABLE_STAT_COMMAND
+// Enable perf command, measure i2s DMA interrupt cycles and CPU load, used for debug
+//#define ENABLE_PERF_COMMAND
+// Enable boottime command, show boot stages time (time to first trace)
+#define ENABLE_BOOTTIME_COMMAND
 // Enable gain command, used for debug
 //#define ENABLE_GAIN_COMMAND
 // Enable port command, used for debug
@@ -106,7 +110,9 @@ static volatile vna_shellcmd_t  shell_function = 0;
 
 static void apply_CH0_error_term(float data[4], float c_data[CAL_TYPE_COUNT][2]);
 static void apply_CH1_error_term(float data[4], float c_data[CAL_TYPE_COUNT][2]);
+static void apply_CH1_source_match(float data[4], float c_data[CAL_TYPE_COUNT][2]);
 static void cal_interpolate(int idx, freq_t f, float data[CAL_TYPE_COUNT][2]);
+static void cal_interpolate_prepare(void);
 
 static uint16_t get_sweep_mask(void);
 static void update_frequencies(void);
@@ -114,6 +120,9 @@ static int  set_frequency(freq_t freq);
 static void set_frequencies(freq_t start, freq_t stop, uint16_t points);
 static bool sweep(bool break_on_operation, uint16_t ch_mask);
 static void transform_domain(uint16_t ch_mask);
+#ifdef __USE_TD_GATE__
+static void transform_gate(uint16_t ch_mask);
+#endif
 
 uint8_t sweep_mode = SWEEP_ENABLE;
 // current sweep point (used for continue sweep if user break)
@@ -219,6 +228,26 @@ static void measurementDataSmooth(uint16_t ch_mask){
 }
 #endif
 
+#ifdef ENABLE_BOOTTIME_COMMAND
+#ifdef NANOVNA_F303
+// Cortex M4 DWT cycle counter, 32 bit count up
+#define BOOT_COUNTER_INIT()    {CoreDebug->DEMCR|= CoreDebug_DEMCR_TRCENA_Msk; DWT->CTRL|= DWT_CTRL_CYCCNTENA_Msk;}
+#define BOOT_COUNTER()         (DWT->CYCCNT)
+#else
+// Cortex M0 not have DWT, use system time (CH_CFG_ST_FREQUENCY step) in CPU cycles
+#define BOOT_COUNTER_INIT()    {}
+#define BOOT_COUNTER()         (chVTGetSystemTimeX() * (STM32_SYSCLK / CH_CFG_ST_FREQUENCY))
+#endif
+enum {BOOT_START = 0, BOOT_SETTINGS, BOOT_SI5351, BOOT_CODEC, BOOT_LCD, BOOT_SD_CARD, BOOT_I2S, BOOT_SWEEP, BOOT_TRACE, BOOT_STAGE_COUNT};
+static uint32_t boot_time[BOOT_STAGE_COUNT];
+#define BOOT_TIMESTAMP(stage)  {boot_time[stage] = BOOT_COUNTER();}
+#define BOOT_TIMESTAMP_ONCE(stage) {if (boot_time[stage] == 0) BOOT_TIMESTAMP(stage);}
+#else
+#define BOOT_COUNTER_INIT()    {}
+#define BOOT_TIMESTAMP(stage)  {}
+#define BOOT_TIMESTAMP_ONCE(stage) {}
+#endif
+
 static THD_WORKING_AREA(waThread1, 1024);
 static THD_FUNCTION(Thread1, arg)
 {
@@ -238,6 +267,7 @@ static THD_FUNCTION(Thread1, arg)
     bool completed = false;
     uint16_t mask = get_sweep_mask();
     if (sweep_mode&(SWEEP_ENABLE|SWEEP_ONCE)) {
+      BOOT_TIMESTAMP_ONCE(BOOT_SWEEP);
       completed = sweep(true, mask);
       sweep_mode&=~SWEEP_ONCE;
     } else {
@@ -263,6 +293,9 @@ static THD_FUNCTION(Thread1, arg)
 #endif
 //      START_PROFILE
       if ((props_mode & DOMAIN_MODE) == DOMAIN_TIME) transform_domain(mask);
+#ifdef __USE_TD_GATE__
+      else if (props_mode & TD_GATE) transform_gate(mask);
+#endif
 //      STOP_PROFILE;
       // Prepare draw graphics, cache all lines, mark screen cells for redraw
       request_to_redraw(REDRAW_PLOT);
@@ -272,6 +305,7 @@ static THD_FUNCTION(Thread1, arg)
     // plot trace and other indications as raster
     draw_all();
 #endif
+    if (completed) BOOT_TIMESTAMP_ONCE(BOOT_TRACE);
   }
 }
 
@@ -369,6 +403,241 @@ kaiser_window_ext(uint32_t k, uint32_t n, uint16_t beta)
 }
 #endif
 
+// Time domain window function value at k position for symmetric window size n (normalized to max = 1.0)
+static float
+window_function(uint32_t k, uint32_t n)
+{
+  float s, c;
+  if (n < 2) return 1.0f;
+  switch (domain_window) {
+//  case TD_WINDOW_MINIMUM: // this is rectangular
+//    break;
+    case TD_WINDOW_NORMAL:  return kaiser_window_ext(k, n,  6) / bessel0_ext( 6 *  6 / 4.0f);
+    case TD_WINDOW_MAXIMUM: return kaiser_window_ext(k, n, 13) / bessel0_ext(13 * 13 / 4.0f);
+    case TD_WINDOW_HANN:
+      // Not use zero end points (gate need remove window from result)
+      vna_sincosf((float)(k + 1) / (n + 1), &s, &c);
+      return 0.5f - 0.5f * c;
+    case TD_WINDOW_BLACKMAN: {
+      // 4 term Blackman-Harris, cos(2x) and cos(3x) from cos(x)
+      vna_sincosf((float)k / (n - 1), &s, &c);
+      float c2 = 2.0f * c * c - 1.0f;
+      float c3 = c * (2.0f * c2 - 1.0f);
+      return 0.35875f - 0.48829f * c + 0.14128f * c2 - 0.01168f * c3;
+    }
+  }
+  return 1.0f;
+}
+
+// Window cache, window is symmetric so store only upper half: window_table[j] = window(n/2 + j, n)
+// Lowpass use upper half of 2*sweep_points size window, bandpass and gate mirror it
+// Max n = 2*POINTS_COUNT, so need POINTS_COUNT values
+#if defined(NANOVNA_F303)
+typedef float window_t;
+static inline window_t window_store(float w) {return w;}
+static inline float    window_load(window_t v) {return v;}
+#else
+// RAM tight, store as unsigned 16 bit fixed point (1.0 = 65535), not allow zero
+typedef uint16_t window_t;
+static inline window_t window_store(float w) {uint32_t v = w * 65535.0f + 0.5f; return v ? v : 1;}
+static inline float    window_load(window_t v) {return v * (1.0f / 65535.0f);}
+#endif
+static window_t window_table[POINTS_COUNT];
+
+#ifdef __USE_TD_GATE__
+// Gate normalization cache: 1 / (gated window response) for every point, recalculated on gate or window change
+#if defined(NANOVNA_F303)
+typedef float gate_norm_t;
+static inline gate_norm_t gate_norm_store(float v) {return v;}
+static inline float       gate_norm_load(gate_norm_t v) {return v;}
+#else
+// RAM tight, store as float16 (relative error 2^-11)
+typedef uint16_t gate_norm_t;
+static inline gate_norm_t gate_norm_store(float v) {return float_to_half(v);}
+static inline float       gate_norm_load(gate_norm_t v) {return half_to_float(v);}
+#endif
+static gate_norm_t gate_norm[POINTS_COUNT][2];
+#endif
+
+// Recalculate window table only if window type or size changed
+static void
+window_prepare(uint16_t n)
+{
+  static uint32_t window_cache = 0;
+  uint32_t check = domain_window | ((uint32_t)n<<16);
+  if (window_cache == check) return;
+  window_cache = check;
+  for (uint16_t k = n / 2; k < n; k++)
+    window_table[k - n / 2] = window_store(window_function(k, n));
+}
+
+static inline float
+window_get(uint16_t k, uint16_t n)
+{
+  if (k < n / 2) k = n - 1 - k;
+  return window_load(window_table[k - n / 2]);
+}
+
+#ifdef __USE_TD_ZOOM__
+// Time domain zoom, output point i have time (start + i * step) in FFT time step units (1 / (FFT_SIZE * df))
+// return false if zoom not used (only lowpass, bandpass give complex result)
+bool get_td_zoom(float *start, float *step)
+{
+  if ((props_mode & (DOMAIN_MODE|TD_ZOOM)) != (DOMAIN_TIME|TD_ZOOM) || domain_func == TD_FUNC_BANDPASS || sweep_points < 2)
+    return false;
+  const float scale = (float)FFT_SIZE * get_sweep_frequency(ST_SPAN) / (sweep_points - 1);
+  float t0 = td_start * scale;
+  float t1 = td_stop  * scale;
+  if (t0 < 0.0f) t0 = 0.0f;
+  if (t1 <= t0) return false;
+  // Time response is periodic (FFT_SIZE), not need more
+  if (t1 - t0 > FFT_SIZE) t1 = t0 + FFT_SIZE;
+  *start = t0;
+  *step  = (t1 - t0) / (sweep_points - 1);
+  return true;
+}
+
+/*
+ * Chirp-Z (Bluestein) zoom for lowpass, output m at time t = t0 + m * dt (FFT time step units):
+ *  x(t) = Re(sum(b[k] * exp(2*pi*i*k*t/N))), b[0] = X[0], b[N/2] = X[N/2], other b[k] = 2 * X[k]
+ *  with W^n = exp(2*pi*i*n*dt/N) and k*m = (k^2 + m^2 - (m - k)^2) / 2:
+ *  y[m] = W^(m^2/2) * sum(b[k] * exp(2*pi*i*k*t0/N) * W^(k^2/2) * W^(-(m-k)^2/2))
+ * Sum is convolution with chirp filter h[n] = W^(-n^2/2), n = -(points-1) .. block-1, made by FFT_SIZE
+ * complex FFT, one FFT pass give block = FFT_SIZE - points + 1 outputs
+ * Step response (sum of impulse 0 .. t): s(t) = (t + 1) * X[0] + Re(sum(b[k] * D[k] * (exp(2*pi*i*k*(t+1)/N) - 1))),
+ *  D[k] = 1 / (exp(2*pi*i*k/N) - 1) = -1/2 - i/2 * cot(pi*k/N), equal sum of real iFFT result on integer t
+ *  plus impulse part before 0 (as not zoomed transform): s(N - 1) - s(P - 1), P = sweep_points
+ * Phases calculated in 32 bit fixed point (1 turn = 2^32), uint32 overflow is modulo 1 turn
+ */
+#define CZT_BLOCK(points)  (FFT_SIZE - (points) + 1)
+#if defined(NANOVNA_F303)
+// F303: chirp filter spectrum cache and output for more than one block in CCM RAM (not used by DMA)
+static float czt_filter[FFT_SIZE][2] __attribute__((section(".ram4")));
+static float czt_out[POINTS_COUNT]   __attribute__((section(".ram4")));
+#define CZT_FILTER   czt_filter
+#define CZT_OUT      czt_out
+#else
+// F072: work buffer and chirp filter spectrum in spi_buffer, all output in one block
+#if 2*2*4*FFT_SIZE > (SPI_BUFFER_SIZE * LCD_PIXEL_SIZE)
+#error "Need increase spi_buffer for time domain zoom"
+#endif
+#if CZT_BLOCK(POINTS_COUNT) < POINTS_COUNT
+#error "Time domain zoom need FFT_SIZE >= 2 * POINTS_COUNT - 1"
+#endif
+#define CZT_FILTER   (((float(*)[2])spi_buffer) + FFT_SIZE)
+#endif
+
+static inline void
+czt_sincos(uint32_t phase, float *s, float *c)
+{
+  vna_sincosf(phase * (1.0f / 4294967296.0f), s, c);
+}
+
+// Chirp filter spectrum for q = dt / (2 * N) turns (W^(n^2/2) phase = n^2 * q)
+static void
+czt_prepare(uint32_t q, uint16_t points)
+{
+  float (*h)[2] = CZT_FILTER;
+#ifdef CZT_OUT
+  // Cache filter in CCM
+  static uint32_t czt_cache[2] = {0, 0};
+  if (czt_cache[0] == q && czt_cache[1] == points) return;
+  czt_cache[0] = q;
+  czt_cache[1] = points;
+#endif
+  const uint16_t block = CZT_BLOCK(points);
+  uint32_t n;
+  for (n = 0; n < FFT_SIZE; n++) {
+    // index n: h[n], n < block, index FFT_SIZE - n: h[-n], n < points
+    uint32_t k = n < block ? n : FFT_SIZE - n;
+    float s, c;
+    czt_sincos(k * k * q, &s, &c);
+    h[n][0] = c;
+    h[n][1] =-s;
+  }
+  fft_forward(h);
+}
+
+static void
+transform_zoom_lowpass(float *data, uint16_t points, float t0, float dt)
+{
+  float (*tmp)[2] = (float(*)[2])spi_buffer;
+  float (*h)[2] = CZT_FILTER;
+#ifdef CZT_OUT
+  float *out = CZT_OUT;
+#else
+  float *out = data;     // one block, data not need after fill work buffer
+#endif
+  const uint16_t block = CZT_BLOCK(points);
+  const uint32_t q = dt * (4294967296.0f / (2 * FFT_SIZE)) + 0.5f;
+  float turn = t0 * (1.0f / FFT_SIZE);
+  turn-= (uint32_t)turn;
+  uint32_t tb = turn * 4294967296.0f;                        // block start time phase t / N
+  const uint32_t tn = sweep_points * (uint32_t)(4294967296ULL / FFT_SIZE); // negative time start phase P / N
+  uint16_t i, m, m0;
+  czt_prepare(q, points);
+  float x0 = data[0], sum = 0.0f, neg = 0.0f;
+  // Prepare b[k] in place
+  for (i = 0; i < points; i++) {
+    const float mul = (i == 0 || i == FFT_SIZE / 2) ? 1.0f : 2.0f;
+    float re = data[i * 2 + 0] * mul, im = data[i * 2 + 1] * mul;
+    if (domain_func == TD_FUNC_LOWPASS_STEP) {
+      if (i == 0) {re = im = 0.0f;}
+      else {
+        // b[k] * D[k], D[k] = -1/2 - i/2 * cot(pi*k/N)
+        float s, c;
+        vna_sincosf((float)i / (2 * FFT_SIZE), &s, &c);
+        const float ct = c / s;
+        const float r = 0.5f * (im * ct - re);
+        im = -0.5f * (re * ct + im);
+        re = r;
+        czt_sincos(i * tn, &s, &c);
+        neg-= re * c - im * s;
+      }
+      sum+= re;
+    }
+    data[i * 2 + 0] = re;
+    data[i * 2 + 1] = im;
+  }
+  // Step response need value at t + 1, start from impulse part before 0
+  if (domain_func == TD_FUNC_LOWPASS_STEP) {
+    tb+= (uint32_t)(4294967296ULL / FFT_SIZE);
+    neg+= (FFT_SIZE - sweep_points) * x0 + sum;
+  }
+  for (m0 = 0; m0 < sweep_points; m0+= block, tb+= 2 * q * block) {
+    for (i = 0; i < points; i++) {
+      float s, c;
+      czt_sincos(i * tb + i * i * q, &s, &c);
+      tmp[i][0] = data[i * 2 + 0] * c - data[i * 2 + 1] * s;
+      tmp[i][1] = data[i * 2 + 0] * s + data[i * 2 + 1] * c;
+    }
+    for (; i < FFT_SIZE; i++)
+      tmp[i][0] = tmp[i][1] = 0.0f;
+    fft_forward(tmp);
+    for (i = 0; i < FFT_SIZE; i++) {
+      const float re = tmp[i][0] * h[i][0] - tmp[i][1] * h[i][1];
+      const float im = tmp[i][0] * h[i][1] + tmp[i][1] * h[i][0];
+      tmp[i][0] = re;
+      tmp[i][1] = im;
+    }
+    fft_inverse(tmp);
+    for (m = 0; m < block && m0 + m < sweep_points; m++) {
+      float s, c;
+      czt_sincos(m * m * q, &s, &c);
+      float v = (tmp[m][0] * c - tmp[m][1] * s) * (1.0f / FFT_SIZE);
+      if (domain_func == TD_FUNC_LOWPASS_STEP)
+        v+= (t0 + (m0 + m) * dt + 1.0f) * x0 - sum + neg;
+      out[m0 + m] = v;
+    }
+  }
+  // Expand to complex (back order, out can be data)
+  for (i = sweep_points; i-- > 0;) {
+    data[i * 2 + 0] = out[i];
+    data[i * 2 + 1] = 0.0f;
+  }
+}
+#endif
+
 static void
 transform_domain(uint16_t ch_mask)
 {
@@ -390,93 +659,221 @@ transform_domain(uint16_t ch_mask)
       break;
   }
   uint16_t window_size = sweep_points + offset;
-  uint16_t beta = 0;
-  switch (domain_window) {
-//    case TD_WINDOW_MINIMUM:
-//    beta = 0;  // this is rectangular
-//      break;
-    case TD_WINDOW_NORMAL:
-      beta = 6;
-      break;
-    case TD_WINDOW_MAXIMUM:
-      beta = 13;
-      break;
-  }
+  // Window table (normalized to max = 1.0) recalculated only if window or size changed
+  window_prepare(window_size);
   // Add amplitude correction for not full size FFT data and also add computed default scale
   // recalculate the scale factor if any window details are changed. The scale factor is to compensate for windowing.
-  // Add constant multiplier for kaiser_window_ext use 1.0f / bessel0_ext(beta*beta/4.0f)
   // Add constant multiplier  1.0f / FFT_SIZE
   static float window_scale = 0.0f;
-  static uint16_t td_cache = 0;
+  static uint32_t td_cache = 0;
   // Check mode cache data
-  uint16_t td_check = (props_mode & (TD_WINDOW|TD_FUNC))|(sweep_points<<5);
+  uint32_t td_check = (props_mode & (TD_WINDOW|TD_FUNC))|((uint32_t)sweep_points<<16);
   if (td_cache!=td_check){
     td_cache = td_check;
     if (domain_func == TD_FUNC_LOWPASS_STEP)
-      window_scale = 1.0f / (FFT_SIZE * bessel0_ext(beta*beta/4.0f));
+      window_scale = 1.0f / FFT_SIZE;
     else {
       window_scale = 0.0f;
-      for (int i = 0; i < sweep_points; i++)
-        window_scale += kaiser_window_ext(i + offset, window_size, beta);
+      for (i = 0; i < sweep_points; i++)
+        window_scale += window_get(i + offset, window_size);
       if (domain_func == TD_FUNC_BANDPASS) window_scale = 1.0f / (       window_scale);
       else                                 window_scale = 1.0f / (2.0f * window_scale);
-//    window_scale*= FFT_SIZE               // add correction from kaiser_window
+//    window_scale*= FFT_SIZE               // add correction from window
 //    window_scale/= FFT_SIZE               // add defaut from FFT_SIZE
-//    window_scale*= bessel0_ext(beta*beta/4.0f) // for get result as kaiser_window
-//    window_scale/= bessel0_ext(beta*beta/4.0f) // for set correction on calculated kaiser_window for value
     }
-#ifdef USE_FFT_WINDOW_BUFFER
-    // Cache window function data to static buffer
-    static float kaiser_data[FFT_SIZE];
-    for (i = 0; i < sweep_points; i++)
-      kaiser_data[i] = kaiser_window_ext(i + offset, window_size, beta) * window_scale;
-#endif
   }
+#ifdef __USE_TD_ZOOM__
+  float zoom_start = 0.0f, zoom_step = 0.0f;
+  bool zoom = get_td_zoom(&zoom_start, &zoom_step);
+#endif
   // Made Time Domain Calculations
   for (int ch = 0; ch < 2; ch++,ch_mask>>=1) {
     if ((ch_mask&1)==0) continue;
     // Prepare data in tmp buffer (use spi_buffer), apply window function and constant correction factor
     float* tmp  = (float*)spi_buffer;
     float *data = measured[ch][0];
-    for (i = 0; i < sweep_points; i++) {
-#ifdef USE_FFT_WINDOW_BUFFER
-      float w = kaiser_data[i];
-#else
-      float w = kaiser_window_ext(i + offset, window_size, beta) * window_scale;
+    // Lowpass use real output iFFT, need only FFT_SIZE/2 + 1 bins (upper half is conjugate)
+    uint16_t fft_points = is_lowpass ? FFT_SIZE / 2 + 1 : FFT_SIZE;
+    uint16_t points = sweep_points < fft_points ? sweep_points : fft_points;
+#ifdef __USE_TD_ZOOM__
+    // Zoom need windowed data for every step, apply window in place
+    if (zoom) tmp = data;
 #endif
+    for (i = 0; i < points; i++) {
+      float w = window_get(i + offset, window_size) * window_scale;
       tmp[i * 2 + 0] = data[i * 2 + 0] * w;
       tmp[i * 2 + 1] = data[i * 2 + 1] * w;
     }
+#ifdef __USE_TD_ZOOM__
+    if (zoom) {
+      transform_zoom_lowpass(data, points, zoom_start, zoom_step);
+      continue;
+    }
+#endif
     // Fill zeroes last
-    for (; i < FFT_SIZE; i++) {
+    for (; i < fft_points; i++) {
       tmp[i * 2 + 0] = 0.0f;
       tmp[i * 2 + 1] = 0.0f;
     }
-    // For lowpass mode swap
     if (is_lowpass) {
-      for (i = 1; i < sweep_points; i++) {
-        tmp[(FFT_SIZE - i) * 2 + 0] =  tmp[i * 2 + 0];
-        tmp[(FFT_SIZE - i) * 2 + 1] = -tmp[i * 2 + 1];
+      // Made real iFFT in temp buffer, result is FFT_SIZE real values
+      fft_real_inverse((float(*)[2])tmp);
+      float v = 0.0f;
+      // Step start from impulse part before 0 (periodic result, times not shown), settle to reflection coefficient
+      if (domain_func == TD_FUNC_LOWPASS_STEP)
+        for (i = sweep_points; i < FFT_SIZE; i++) v+= tmp[i];
+      for (i = 0; i < sweep_points; i++) {
+        if (domain_func == TD_FUNC_LOWPASS_STEP) v+= tmp[i];
+        else                                     v = tmp[i];
+        data[i * 2 + 0] = v;
+        data[i * 2 + 1] = 0.0f;
       }
+      continue;
     }
     // Made iFFT in temp buffer
     fft_inverse((float(*)[2])tmp);
-    // set img part as zero
-    if (is_lowpass){
-      for (i = 0; i < sweep_points; i++)
-        tmp[i*2+1] = 0.0f;
-    }
-    if (domain_func == TD_FUNC_LOWPASS_STEP) {
-      for (i = 1; i < sweep_points; i++) {
-        tmp[i*2+0]+= tmp[i*2+0-2];
-//      tmp[i*2+1]+= tmp[i*2+1-2];  // already zero as is_lowpass
-      }
-    }
     // Copy data back
     memcpy(measured[ch], tmp, sizeof(measured[0]));
   }
 }
 
+#ifdef __USE_TD_GATE__
+// Set gate on time domain active and previous marker positions
+bool
+set_gate_from_markers(void)
+{
+  if ((props_mode & DOMAIN_MODE) != DOMAIN_TIME || active_marker == MARKER_INVALID || previous_marker == MARKER_INVALID)
+    return false;
+  float t0 = time_of_index(markers[active_marker].index);
+  float t1 = time_of_index(markers[previous_marker].index);
+  gate_start = t0 < t1 ? t0 : t1;
+  gate_stop  = t0 < t1 ? t1 : t0;
+  return true;
+}
+
+// Gate edge (raised cosine taper) max size, edge size = gate size * (0, 1/8, 1/4) for minimum, normal, maximum shape
+#define GATE_EDGE_MAX  (FFT_SIZE / 8)
+// Gate in FFT time step units (1 / (FFT_SIZE * df))
+static uint16_t gate_begin = 0, gate_end = 0, gate_edge = 0;
+static float gate_data[GATE_EDGE_MAX];
+
+// Apply gate on time domain data: zero outside, raised cosine edges
+static void
+gate_apply(float *tmp)
+{
+  for (int i = 0; i < FFT_SIZE; i++) {
+    float g;
+    if (i < gate_begin || i > gate_end) g = 0.0f;
+    else if (i < gate_begin + gate_edge) g = gate_data[i - gate_begin];
+    else if (i > gate_end - gate_edge)   g = gate_data[gate_end - i];
+    else continue;
+    tmp[i * 2 + 0]*= g;
+    tmp[i * 2 + 1]*= g;
+  }
+}
+
+// Gated window response: window response of reflection at gate center after gate
+// r[k] = FFT(gate * iFFT(w * exp(-2*pi*i*k*tc/N))) * exp(2*pi*i*k*tc/N), store 1 / r[k]
+static void
+gate_prepare_norm(float *tmp)
+{
+  int i;
+  const uint32_t center2 = gate_begin + gate_end;   // 2 * tc, phase k * tc / N = (k * 2 * tc mod 2 * N) / (2 * N)
+  for (i = 0; i < sweep_points; i++) {
+    float s, c, w = window_get(i, sweep_points);
+    vna_sincosf((float)((i * center2) % (2 * FFT_SIZE)) / (2 * FFT_SIZE), &s, &c);
+    tmp[i * 2 + 0] = w * c;
+    tmp[i * 2 + 1] =-w * s;
+  }
+  for (; i < FFT_SIZE; i++) {
+    tmp[i * 2 + 0] = 0.0f;
+    tmp[i * 2 + 1] = 0.0f;
+  }
+  fft_inverse((float(*)[2])tmp);
+  gate_apply(tmp);
+  fft_forward((float(*)[2])tmp);
+  for (i = 0; i < sweep_points; i++) {
+    float s, c;
+    vna_sincosf((float)((i * center2) % (2 * FFT_SIZE)) / (2 * FFT_SIZE), &s, &c);
+    float re = (tmp[i * 2 + 0] * c - tmp[i * 2 + 1] * s) * (1.0f / FFT_SIZE);
+    float im = (tmp[i * 2 + 0] * s + tmp[i * 2 + 1] * c) * (1.0f / FFT_SIZE);
+    float d = re * re + im * im;
+    if (d < 1e-20f) d = 1e-20f;
+    d = 1.0f / (FFT_SIZE * d); // also remove FFT_SIZE gain of iFFT + FFT
+    gate_norm[i][0] = gate_norm_store( re * d);
+    gate_norm[i][1] = gate_norm_store(-im * d);
+  }
+}
+
+// Time domain gate: window data, iFFT to time (bandpass), apply gate, FFT back and divide on gated window response
+static void
+transform_gate(uint16_t ch_mask)
+{
+#if 2*4*FFT_SIZE > (SPI_BUFFER_SIZE * LCD_PIXEL_SIZE)
+#error "Need increase spi_buffer or use less FFT_SIZE value"
+#endif
+  int i;
+  if (gate_stop <= gate_start || sweep_points < 2) return;
+  // Recalculate gate and normalization only if gate, window or sweep details are changed
+  static float gate_cache[3] = {0};
+  static uint32_t gate_check = 0;
+  const float span = get_sweep_frequency(ST_SPAN);
+  uint32_t check = (props_mode & (TD_GATE_SHAPE|TD_WINDOW))|((uint32_t)sweep_points<<16);
+  window_prepare(sweep_points);
+  if (gate_check != check || gate_cache[0] != gate_start || gate_cache[1] != gate_stop || gate_cache[2] != span) {
+    gate_check = check;
+    gate_cache[0] = gate_start;
+    gate_cache[1] = gate_stop;
+    gate_cache[2] = span;
+    const float scale = (float)FFT_SIZE * span / (sweep_points - 1);
+    float begin = gate_start * scale, end = gate_stop * scale;
+    if (begin < 0.0f) begin = 0.0f;
+    // Gate stop after FFT time range pass all (upper half is negative time part of response near zero)
+    if (end > FFT_SIZE - 1) end = FFT_SIZE - 1;
+    gate_begin = begin;
+    if (gate_begin < begin) gate_begin++;
+    gate_end   = end < gate_begin ? gate_begin : end;
+    uint16_t size = gate_end - gate_begin + 1;
+    switch (props_mode & TD_GATE_SHAPE) {
+      case TD_GATE_MINIMUM: gate_edge = 0;        break;
+      case TD_GATE_NORMAL:  gate_edge = size / 8; break;
+      case TD_GATE_MAXIMUM: gate_edge = size / 4; break;
+    }
+    if (gate_edge > GATE_EDGE_MAX) gate_edge = GATE_EDGE_MAX;
+    for (i = 0; i < gate_edge; i++) {
+      float s, c;
+      vna_sincosf((float)(i + 1) / (2 * (gate_edge + 1)), &s, &c);
+      gate_data[i] = 0.5f - 0.5f * c;
+    }
+    gate_prepare_norm((float*)spi_buffer);
+  }
+  for (int ch = 0; ch < 2; ch++,ch_mask>>=1) {
+    if ((ch_mask&1)==0) continue;
+    float* tmp  = (float*)spi_buffer;
+    float *data = measured[ch][0];
+    // Apply window (as bandpass)
+    for (i = 0; i < sweep_points; i++) {
+      float w = window_get(i, sweep_points);
+      tmp[i * 2 + 0] = data[i * 2 + 0] * w;
+      tmp[i * 2 + 1] = data[i * 2 + 1] * w;
+    }
+    for (; i < FFT_SIZE; i++) {
+      tmp[i * 2 + 0] = 0.0f;
+      tmp[i * 2 + 1] = 0.0f;
+    }
+    fft_inverse((float(*)[2])tmp);
+    gate_apply(tmp);
+    fft_forward((float(*)[2])tmp);
+    // Divide on gated window response
+    for (i = 0; i < sweep_points; i++) {
+      float nr = gate_norm_load(gate_norm[i][0]), ni = gate_norm_load(gate_norm[i][1]);
+      data[i * 2 + 0] = tmp[i * 2 + 0] * nr - tmp[i * 2 + 1] * ni;
+      data[i * 2 + 1] = tmp[i * 2 + 0] * ni + tmp[i * 2 + 1] * nr;
+    }
+  }
+}
+#endif
+
 // Shell commands output
 int shell_printf(const char *fmt, ...)
 {
@@ -820,7 +1217,15 @@ VNA_SHELL_FUNCTION(cmd_data)
   if (sel < 0 || sel >=7)
     goto usage;
 
-  array = sel < 2 ? measured[sel] : cal_data[sel-2];
+  if (sel >= 2) {
+    float v[2];
+    for (i = 0; i < sweep_points; i++) {
+      caldata_point(sel-2, i, v);
+      shell_printf("%f %f" VNA_SHELL_NEWLINE_STR, v[0], v[1]);
+    }
+    return;
+  }
+  array = measured[sel];
 
   for (i = 0; i < sweep_points; i++)
     shell_printf("%f %f" VNA_SHELL_NEWLINE_STR, array[i][0], array[i][1]);
@@ -907,6 +1312,14 @@ config_t config = {
   ._lever_mode = LM_MARKER,
   ._digit_separator = '.',
   ._band_mode = 0,
+  ._if_filter = IF_FILTER_RECT,
+  ._adc_profile = 0,
+  ._delay = {0},
+  ._auto_gain = 0,
+  ._gain_cal = AUTO_GAIN_NOMINAL,
+  ._calkit = CALKIT_DEFAULT,
+  ._cal_stderr = 0.0f,
+  ._cal_average = 1,
 };
 
 properties_t current_props;
@@ -947,6 +1360,7 @@ static const marker_t def_markers[MARKERS_MAX] = {
 // Load propeties default settings
 void load_default_properties(void)
 {
+  caldata_reset();  // Not use slot data from flash
 //Magic add on caldata_save
 //current_props.magic = CONFIG_MAGIC;
   current_props._frequency0       =     50000;    // start =  50kHz
@@ -966,6 +1380,10 @@ void load_default_properties(void)
   current_props._s21_offset       = 0.0f;
   current_props._portz = 50.0f;
   current_props._velocity_factor = 70;
+  current_props._td_start = 0.0f;
+  current_props._td_stop  = 0.0f;
+  current_props._gate_start = 0.0f;
+  current_props._gate_stop  = 0.0f;
   current_props._current_trace   = 0;
   current_props._active_marker   = 0;
   current_props._previous_marker = MARKER_INVALID;
@@ -984,7 +1402,7 @@ void load_default_properties(void)
 // Backup registers support, allow save data on power off (while vbat power enabled)
 //
 #ifdef __USE_BACKUP__
-#if POINTS_COUNT > 511 || SAVEAREA_MAX > 15
+#if POINTS_COUNT > 511
 #error "Check backup data limits!!"
 #endif
 
@@ -992,19 +1410,22 @@ void load_default_properties(void)
 typedef union {
   struct {
     uint32_t points     : 9; //  9 !! limit 511 points!!
-    uint32_t bw         : 9; // 18 !! limit 511
-    uint32_t id         : 4; // 22 !! 15 save slots
+    uint32_t bw         :10; // 19 !! limit 511, bigger stored by step 8 (see BACKUP_BW_PACK)
+    uint32_t reserved   : 3; // 22 save slot id moved to backup_4 high half word
     uint32_t leveler    : 3; // 25
     uint32_t brightness : 7; // 32
   };
   uint32_t v;
 } backup_0;
 
+// Pack bandwidth count in 10 bit: 0-511 as is, 512-4095 by step 8
+#define BACKUP_BW_PACK(bw)    ((bw) < 512 ? (bw) : 512 + (((bw) - 512)>>3))
+#define BACKUP_BW_UNPACK(v)   ((v) < 512 ? (v) : 512 + (((v) - 512)<<3))
+
 void update_backup_data(void) {
   backup_0 bk = {
     .points     = sweep_points,
-    .bw         = config._bandwidth,
-    .id         = lastsaveid,
+    .bw         = BACKUP_BW_PACK(config._bandwidth),
     .leveler    = lever_mode,
     .brightness = config._brightness
   };
@@ -1012,14 +1433,15 @@ void update_backup_data(void) {
   set_backup_data32(1, frequency0);
   set_backup_data32(2, frequency1);
   set_backup_data32(3, var_freq);
-  set_backup_data32(4, config._vna_mode);
+  set_backup_data32(4, config._vna_mode | ((uint32_t)lastsaveid<<16));
 }
 
 static void load_settings(void) {
   if (config_recall() == 0 && VNA_MODE(VNA_MODE_BACKUP)) { // Config loaded ok and need restore backup
     backup_0 bk = {.v = get_backup_data32(0)};
     if (bk.v != 0) {                                             // if backup data valid
-      if (bk.id < SAVEAREA_MAX && caldata_recall(bk.id) == 0) {  // Slot valid and Load ok
+      uint16_t id = get_backup_data32(4)>>16;
+      if (id < SAVEAREA_MAX && caldata_recall(id) == 0) {        // Slot valid and Load ok
         sweep_points = bk.points;                                // Restore settings depend from calibration data
         frequency0 = get_backup_data32(1);
         frequency1 = get_backup_data32(2);
@@ -1029,8 +1451,8 @@ static void load_settings(void) {
       // Here need restore settings not depend from cal data
       config._brightness = bk.brightness;
       lever_mode         = bk.leveler;
-      config._vna_mode   = get_backup_data32(4) | (1<<VNA_MODE_BACKUP); // refresh backup settings
-      set_bandwidth(bk.bw);
+      config._vna_mode   = (uint8_t)get_backup_data32(4) | (1<<VNA_MODE_BACKUP); // refresh backup settings
+      set_bandwidth(BACKUP_BW_UNPACK(bk.bw));
     }
   }
   else
@@ -1063,30 +1485,114 @@ int16_t dump_selection = 0;
 static void
 duplicate_buffer_to_dump(audio_sample_t *p, size_t n)
 {
-  p+=dump_selection;
+  int step = 2;
+  if (dump_selection == 2) step = 1; // dump ref and samp interleaved
+  else p+=dump_selection;
   while (n) {
     if (dump_len == 0) return;
     dump_len--;
     *dump_buffer++ = *p;
-    p+=2;
-    n-=2;
+    p+=step;
+    n-=step;
   }
 }
 #endif
 
 // DMA i2s callback function, called on get 'half' and 'full' buffer size data need for process data, while DMA fill next buffer
 static systime_t ready_time = 0;
+#ifdef __USE_SETTLE_DETECT__
+// Wait generator settle, allow start before ready_time
+static bool settle_wait = false;
+#endif
 // sweep operation variables
 volatile uint16_t wait_count = 0;
-// i2s buffer must be 2x size (for process one while next buffer filled by DMA)
-static audio_sample_t rx_buffer[AUDIO_BUFFER_LEN * 2];
+// i2s buffer must be 2x size (for process one while next buffer filled by DMA), aligned for dsp_process word read
+static audio_sample_t rx_buffer[AUDIO_BUFFER_LEN * 2] __attribute__((aligned(4)));
+
+#ifdef ENABLE_PERF_COMMAND
+#ifdef NANOVNA_F303
+// Cortex M4 DWT cycle counter, 32 bit count up
+#define PERF_COUNTER_INIT()    {CoreDebug->DEMCR|= CoreDebug_DEMCR_TRCENA_Msk; DWT->CTRL|= DWT_CTRL_CYCCNTENA_Msk;}
+#define PERF_COUNTER()         (DWT->CYCCNT)
+#define PERF_DELTA(from, to)   ((to) - (from))
+#else
+// Cortex M0 not have DWT, use SysTick (ChibiOS use TIM2 as system timer), 24 bit count down
+#define PERF_COUNTER_INIT()    {SysTick->LOAD = 0x00FFFFFF; SysTick->VAL = 0; SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;}
+#define PERF_COUNTER()         (SysTick->VAL)
+#define PERF_DELTA(from, to)   (((from) - (to)) & 0x00FFFFFF)
+#endif
+// Nominal DMA half transfer interval in CPU cycles
+#define PERF_INTERVAL_CYCLES   (STM32_SYSCLK / (ADC_FREQ / ADC_SAMPLES_COUNT))
+// Histogram of interrupt cycles by log2 steps, from 2^PERF_HIST_START
+#define PERF_HIST_START        6
+#define PERF_HIST_COUNT        12
+// DMA half/full transfer event to interrupt entry latency: transfers done after event (by CNDTR, on event
+// count/2 or count), resolution one 16 bit transfer (2 transfers on I2S frame), histogram 0, 1, 2-3, 4-7 ...
+#define PERF_TRANSFER_CYCLES   (STM32_SYSCLK / (ADC_FREQ * 2))
+#define PERF_DMA_COUNT         (2 * ADC_BUFFER_LEN * sizeof(audio_sample_t) / sizeof(int16_t))
+#define PERF_LATENCY_COUNT     8
+static struct {
+  uint32_t callback_count;
+  uint32_t process_count;
+  uint32_t last_enter;
+  uint32_t busy_min, busy_max;
+  uint32_t interval_min, interval_max;
+  uint64_t busy_cycles;
+  uint64_t interval_cycles;
+  uint32_t hist[PERF_HIST_COUNT];
+  uint32_t latency_max;
+  uint32_t latency[PERF_LATENCY_COUNT];
+} perf;
+
+static void perf_reset(void) {
+  memset(&perf, 0, sizeof(perf));
+  perf.busy_min = perf.interval_min = 0xFFFFFFFF;
+}
+
+static inline void perf_update(uint32_t enter, uint32_t leave, bool processed) {
+  uint32_t busy = PERF_DELTA(enter, leave);
+  if (perf.callback_count++) { // First call after reset not have interval
+    uint32_t interval = PERF_DELTA(perf.last_enter, enter);
+    perf.interval_cycles+= interval;
+    if (interval < perf.interval_min) perf.interval_min = interval;
+    if (interval > perf.interval_max) perf.interval_max = interval;
+  }
+  perf.last_enter = enter;
+  perf.busy_cycles+= busy;
+  if (busy < perf.busy_min) perf.busy_min = busy;
+  if (busy > perf.busy_max) perf.busy_max = busy;
+  if (processed) perf.process_count++;
+  int bin = 31 - __builtin_clz(busy|1) - PERF_HIST_START;
+  if (bin < 0) bin = 0;
+  if (bin >= PERF_HIST_COUNT) bin = PERF_HIST_COUNT - 1;
+  perf.hist[bin]++;
+}
+
+static inline void perf_latency(uint32_t flags, uint32_t remain) {
+  uint32_t event = (flags & STM32_DMA_ISR_TCIF) ? PERF_DMA_COUNT : PERF_DMA_COUNT / 2;
+  uint32_t done = (event + PERF_DMA_COUNT - remain) % PERF_DMA_COUNT;
+  if (done > perf.latency_max) perf.latency_max = done;
+  int bin = done ? 32 - __builtin_clz(done) : 0;
+  if (bin >= PERF_LATENCY_COUNT) bin = PERF_LATENCY_COUNT - 1;
+  perf.latency[bin]++;
+}
+#endif
 
-void i2s_lld_serve_rx_interrupt(uint32_t flags) {
-//if ((flags & (STM32_DMA_ISR_TCIF|STM32_DMA_ISR_HTIF)) == 0) return;
+static inline bool i2s_process_rx_buffer(uint32_t flags) {
+//if ((flags & (STM32_DMA_ISR_TCIF|STM32_DMA_ISR_HTIF)) == 0) return false;
   uint16_t wait = wait_count;
-  if (wait == 0 || chVTGetSystemTimeX() < ready_time) return;
-  uint16_t count = AUDIO_BUFFER_LEN;
-  audio_sample_t *p = (flags & STM32_DMA_ISR_TCIF) ? rx_buffer + AUDIO_BUFFER_LEN : rx_buffer; // Full or Half transfer complete
+  if (wait == 0) return false;
+  uint16_t count = ADC_BUFFER_LEN;
+  audio_sample_t *p = (flags & STM32_DMA_ISR_TCIF) ? rx_buffer + count : rx_buffer; // Full or Half transfer complete
+  if (chVTGetSystemTimeX() < ready_time) {
+#ifdef __USE_SETTLE_DETECT__
+    // Generator settled before timeout, start (this buffer used as noise buffer)
+    if (!settle_wait || !dsp_settle_check(p, count)) return false;
+    ready_time = 0;
+#else
+    return false;
+#endif
+  }
   if (wait >= config._bandwidth+2)      // At this moment in buffer exist noise data, reset and wait next clean buffer
     reset_dsp_accumerator();
   else
@@ -1095,18 +1601,40 @@ void i2s_lld_serve_rx_interrupt(uint32_t flags) {
   duplicate_buffer_to_dump(p, count);
 #endif
   --wait_count;
-//  stat.callback_count++;
+  return true;
 }
 
-#ifdef ENABLE_SI5351_TIMINGS
-extern uint16_t timings[16];
+void i2s_lld_serve_rx_interrupt(uint32_t flags) {
+#ifdef ENABLE_PERF_COMMAND
+  uint32_t enter = PERF_COUNTER();
+  perf_latency(flags, I2S_DMA_RX->CNDTR);
+  bool processed = i2s_process_rx_buffer(flags);
+  perf_update(enter, PERF_COUNTER(), processed);
+#else
+  i2s_process_rx_buffer(flags);
+#endif
+}
+
+#if defined(ENABLE_SI5351_TIMINGS) || defined(__USE_DELAY_TUNE__)
+extern uint16_t timings[8];
 #undef DELAY_CHANNEL_CHANGE
 #undef DELAY_SWEEP_START
 #define DELAY_CHANNEL_CHANGE  timings[3]
 #define DELAY_SWEEP_START     timings[4]
 #endif
 
-#define DSP_START(delay) {ready_time = chVTGetSystemTimeX() + delay; wait_count = config._bandwidth+2;}
+#ifdef __USE_SETTLE_DETECT__
+// Settle detect need SETTLE_BUFFERS+1 buffers, use it only if delay longer (short delays and channel switch use fixed time)
+#define SETTLE_START(delay) {settle_wait = (uint32_t)(delay) * (ADC_FREQ / ADC_SAMPLES_COUNT) > (SETTLE_BUFFERS + 1) * CH_CFG_ST_FREQUENCY; \
+                             if (settle_wait) dsp_settle_reset();}
+#define SETTLE_STOP()       {settle_wait = false;}
+#else
+#define SETTLE_START(delay)
+#define SETTLE_STOP()
+#endif
+#define DSP_START(delay) {ready_time = chVTGetSystemTimeX() + delay; SETTLE_START(delay); wait_count = config._bandwidth+2;}
+// Start measure only after full delay (settle detect disabled)
+#define DSP_START_FIXED(delay) {ready_time = chVTGetSystemTimeX() + delay; SETTLE_STOP(); wait_count = config._bandwidth+2;}
 #define DSP_WAIT         while (wait_count) {__WFI();}
 #define RESET_SWEEP      {p_sweep = 0;}
 
@@ -1117,6 +1645,7 @@ extern uint16_t timings[16];
 #define SWEEP_APPLY_CALIBRATION     0x10
 #define SWEEP_USE_INTERPOLATION     0x20
 #define SWEEP_USE_RENORMALIZATION   0x40
+#define SWEEP_APPLY_ENHANCED        0x80
 
 static uint16_t get_sweep_mask(void){
   uint16_t ch_mask = 0;
@@ -1144,6 +1673,8 @@ static uint16_t get_sweep_mask(void){
 #endif
   if (cal_status & CALSTAT_APPLY)        ch_mask|= SWEEP_APPLY_CALIBRATION;
   if (cal_status & CALSTAT_INTERPOLATED) ch_mask|= SWEEP_USE_INTERPOLATION;
+  if ((cal_status & (CALSTAT_APPLY|CALSTAT_ENHANCED_RESPONSE)) == (CALSTAT_APPLY|CALSTAT_ENHANCED_RESPONSE))
+    ch_mask|= SWEEP_APPLY_ENHANCED|SWEEP_CH0_MEASURE;
   if (electrical_delay)                  ch_mask|= SWEEP_APPLY_EDELAY;
   if (s21_offset)                        ch_mask|= SWEEP_APPLY_S21_OFFSET;
   return ch_mask;
@@ -1165,6 +1696,61 @@ static void applyOffset(float data[2], float offset){
 #include "vna_modules/vna_renorm.c"
 #endif
 
+#ifdef __USE_AUTO_GAIN__
+/*
+ * Sample channel PGA auto gain
+ * On CH1 (transmission) measure add gain step to band r_gain, step selected by previous sweep level
+ * (max step there sample level < AUTO_GAIN_TARGET), result divided by calibrated step gain
+ * After measure gain restored (CH0 and band change use band gain)
+ */
+#define AUTO_GAIN_TARGET   0.25f       // -12dB full scale, headroom for level change between sweeps
+#define AUTO_GAIN_CLIP     0.70f       // Level possibly clipped, restart from 0 step
+static uint8_t auto_gain_step[POINTS_COUNT];
+static uint8_t auto_gain_current = 0;
+
+static uint8_t auto_gain_max_step(void) {
+  uint8_t r_gain = si5351_get_gain() >> 8;
+  uint16_t max = r_gain <= AUTO_GAIN_REG_MAX ? (AUTO_GAIN_REG_MAX - r_gain) / AUTO_GAIN_REG_STEP + 1 : 1;
+  return max < config._auto_gain ? max : config._auto_gain;
+}
+
+static void auto_gain_set(uint8_t step) {
+  if (step == auto_gain_current) return;
+  uint16_t g = si5351_get_gain();
+  tlv320aic3204_set_gain(g & 0xFF, (g >> 8) + step * AUTO_GAIN_REG_STEP);
+  auto_gain_current = step;
+}
+
+static float auto_gain_mag2(uint8_t step) {
+  const float *g = config._gain_cal[step];
+  return g[0] * g[0] + g[1] * g[1];
+}
+
+// Select step for next sweep by measured level
+static void auto_gain_update(uint16_t idx, uint8_t step) {
+  float level = dsp_sample_level();
+  uint8_t max = auto_gain_max_step(), next = 0;
+  if (level < AUTO_GAIN_CLIP) {
+    float level2 = level * level / auto_gain_mag2(step); // level^2 on step 0
+    while (next + 1 < max && level2 * auto_gain_mag2(next + 1) < AUTO_GAIN_TARGET * AUTO_GAIN_TARGET) next++;
+  }
+  auto_gain_step[idx] = next;
+}
+
+static void auto_gain_apply(float data[2], uint8_t step) {
+  const float *g = config._gain_cal[step];
+  float rr = 1.0f / auto_gain_mag2(step);
+  float re = (data[0] * g[0] + data[1] * g[1]) * rr;
+  float im = (data[1] * g[0] - data[0] * g[1]) * rr;
+  data[0] = re;
+  data[1] = im;
+}
+
+static void auto_gain_reset(void) {
+  memset(auto_gain_step, 0, sizeof(auto_gain_step));
+}
+#endif
+
 // main loop for measurement
 static bool sweep(bool break_on_operation, uint16_t mask)
 {
@@ -1210,11 +1796,19 @@ static bool sweep(bool break_on_operation, uint16_t mask)
       (*sample_func)(&data[0]);             // calculate reflection coefficient
       if (mask & SWEEP_APPLY_CALIBRATION)   // Apply calibration
         apply_CH0_error_term(data, c_data);
-      if (mask & SWEEP_APPLY_EDELAY)        // Apply e-delay
+      if ((mask & SWEEP_APPLY_EDELAY) && !(mask & SWEEP_APPLY_ENHANCED)) // Apply e-delay (after CH1 if need S11a)
         applyEDelay(&data[0], s, c);
     }
     // CH1:TRANSMISSION, reset and begin measure
     if (mask & SWEEP_CH1_MEASURE) {
+#ifdef __USE_AUTO_GAIN__
+      uint8_t gain_step = 0;
+      if (config._auto_gain && sample_func == calculate_gamma && p_sweep < POINTS_COUNT) {
+        gain_step = auto_gain_step[p_sweep];
+        if (gain_step >= auto_gain_max_step()) gain_step = 0;
+        auto_gain_set(gain_step);
+      }
+#endif
       tlv320aic3204_select(1);
       DSP_START(delay+st_delay);
       // Get calibration data, only if not do this in 0 channel wait
@@ -1225,13 +1819,26 @@ static bool sweep(bool break_on_operation, uint16_t mask)
       //================================================
       DSP_WAIT;
       (*sample_func)(&data[2]);              // Measure transmission coefficient
+#ifdef __USE_AUTO_GAIN__
+      if (config._auto_gain && sample_func == calculate_gamma && p_sweep < POINTS_COUNT) {
+        auto_gain_update(p_sweep, gain_step);
+        if (gain_step) {
+          auto_gain_apply(&data[2], gain_step);
+          auto_gain_set(0);
+        }
+      }
+#endif
       if (mask & SWEEP_APPLY_CALIBRATION)    // Apply calibration
         apply_CH1_error_term(data, c_data);
+      if (mask & SWEEP_APPLY_ENHANCED)       // Apply source match correction by S11a
+        apply_CH1_source_match(data, c_data);
       if (mask & SWEEP_APPLY_EDELAY)         // Apply e-delay
         applyEDelay(&data[2], s, c);
       if (mask & SWEEP_APPLY_S21_OFFSET)
         applyOffset(&data[2], offset);
     }
+    if ((mask & (SWEEP_APPLY_ENHANCED|SWEEP_APPLY_EDELAY)) == (SWEEP_APPLY_ENHANCED|SWEEP_APPLY_EDELAY))
+      applyEDelay(&data[0], s, c);
 #ifdef __VNA_Z_RENORMALIZATION__
     if (mask & SWEEP_USE_RENORMALIZATION)
       apply_renormalization(data, mask);
@@ -1272,12 +1879,17 @@ static bool sweep(bool break_on_operation, uint16_t mask)
 VNA_SHELL_FUNCTION(cmd_dump)
 {
   int i, j;
-  audio_sample_t dump[96*2];
+  // Aligned for dsp_process word read
+  audio_sample_t dump[96*2] __attribute__((aligned(4)));
   dump_buffer = dump;
   dump_len = ARRAY_COUNT(dump);
+  if (argc == 1) {
+    int sel = my_atoi(argv[0]);
+    dump_selection = sel == 2 ? 2 : sel == 1 ? 0 : 1;
+  }
+  if (dump_selection == 2) // dump 2 buffers
+    dump_len = 2 * ADC_BUFFER_LEN;
   int len = dump_len;
-  if (argc == 1)
-    dump_selection = my_atoi(argv[0]) == 1 ? 0 : 1;
 
   tlv320aic3204_select(0);
   DSP_START(DELAY_SWEEP_START);
@@ -1289,6 +1901,37 @@ VNA_SHELL_FUNCTION(cmd_dump)
       j = 0;
     }
   }
+  if (dump_selection != 2)
+    return;
+  // Golden data for host replay (see python/dsp_replay.py): sin/cos table and DSP result on dumped buffers
+  DSP_WAIT;
+  const int16_t *table = dsp_get_sincos_table();
+  shell_printf("table:" VNA_SHELL_NEWLINE_STR);
+  for (i = 0, j = 0; i < ADC_SAMPLES_COUNT*2; i++) {
+    shell_printf("%6d ", table[i]);
+    if (++j == 12) {
+      shell_printf(VNA_SHELL_NEWLINE_STR);
+      j = 0;
+    }
+  }
+  float gamma[2], ampl[2], ref[2];
+#ifdef __USE_IF_FILTER__
+  uint8_t if_filter = config._if_filter; // Replay use rectangle sum
+  config._if_filter = IF_FILTER_RECT;
+#endif
+  reset_dsp_accumerator();
+  for (i = 0; i < len; i+= ADC_BUFFER_LEN) // process by buffers (table size)
+    dsp_process(&dump[i], ADC_BUFFER_LEN);
+  calculate_gamma(gamma);
+  fetch_amplitude(ampl);
+  fetch_amplitude_ref(ref);
+#ifdef __USE_IF_FILTER__
+  config._if_filter = if_filter;
+#endif
+  reset_dsp_accumerator();
+  shell_printf("gamma: %.9f %.9f" VNA_SHELL_NEWLINE_STR, gamma[0], gamma[1]);
+  shell_printf("ampl: %.9f %.9f" VNA_SHELL_NEWLINE_STR, ampl[0], ampl[1]);
+  shell_printf("ref: %.9f %.9f" VNA_SHELL_NEWLINE_STR, ref[0], ref[1]);
 }
 #endif
 
@@ -1314,35 +1957,278 @@ static int set_frequency(freq_t freq)
 }
 
 void set_bandwidth(uint16_t bw_count){
-  config._bandwidth = bw_count&0x1FF;
+  config._bandwidth = bw_count > BANDWIDTH_COUNT_MAX ? BANDWIDTH_COUNT_MAX : bw_count;
   request_to_redraw(REDRAW_BACKUP | REDRAW_FREQUENCY);
 }
 
 uint32_t get_bandwidth_frequency(uint16_t bw_freq){
-  return (AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT)/(bw_freq+1);
+  return (ADC_FREQ/ADC_SAMPLES_COUNT)/(bw_freq+1);
 }
 
-#define MAX_BANDWIDTH      (AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT)
-#define MIN_BANDWIDTH      ((AUDIO_ADC_FREQ/AUDIO_SAMPLES_COUNT)/512 + 1)
+#define MAX_BANDWIDTH      (ADC_FREQ/ADC_SAMPLES_COUNT)
+#define MIN_BANDWIDTH      ((ADC_FREQ/ADC_SAMPLES_COUNT)/(BANDWIDTH_COUNT_MAX + 1) + 1)
 
 VNA_SHELL_FUNCTION(cmd_bandwidth)
 {
   uint16_t user_bw;
+#ifdef __USE_IF_FILTER__
+  static const char if_filter_list[] = "rect|cic";
+  if (argc == 2 && get_str_index(argv[0], "filter") == 0) {
+    int type = get_str_index(argv[1], if_filter_list);
+    if (type < 0) {
+      shell_printf("usage: bandwidth filter {%s}" VNA_SHELL_NEWLINE_STR, if_filter_list);
+      return;
+    }
+    config._if_filter = type;
+    goto result;
+  }
+#endif
   if (argc == 1)
     user_bw = my_atoui(argv[0]);
   else if (argc == 2){
     uint16_t f = my_atoui(argv[0]);
          if (f > MAX_BANDWIDTH) user_bw = 0;
-    else if (f < MIN_BANDWIDTH) user_bw = 511;
-    else user_bw = ((AUDIO_ADC_FREQ+AUDIO_SAMPLES_COUNT/2)/AUDIO_SAMPLES_COUNT)/f - 1;
+    else if (f < MIN_BANDWIDTH) user_bw = BANDWIDTH_COUNT_MAX;
+    else user_bw = ((ADC_FREQ+ADC_SAMPLES_COUNT/2)/ADC_SAMPLES_COUNT)/f - 1;
   }
   else
     goto result;
   set_bandwidth(user_bw);
 result:
+#ifdef __USE_IF_FILTER__
+  shell_printf("bandwidth %d (%uHz) filter %s" VNA_SHELL_NEWLINE_STR, config._bandwidth, get_bandwidth_frequency(config._bandwidth),
+               config._if_filter == IF_FILTER_CIC3 ? "cic" : "rect");
+#else
   shell_printf("bandwidth %d (%uHz)" VNA_SHELL_NEWLINE_STR, config._bandwidth, get_bandwidth_frequency(config._bandwidth));
+#endif
+}
+
+#ifdef USE_ADC_PROFILE
+// Validated ADC profiles (IF offset * samples / freq should be integer for default IF)
+const adc_profile_t adc_profiles[ADC_PROFILE_COUNT] = {
+//  freq, samples
+  {192000, 48}, // default, 4000 measure/s
+  {384000, 32}, // fast, 12000 measure/s
+  { 96000, 48}, // 2000 measure/s
+  { 48000, 48}, // slow, 1000 measure/s, better dynamic range
+};
+#if AUDIO_ADC_FREQ != 192000 || AUDIO_SAMPLES_COUNT < 48
+#error "Check adc_profiles, first should be default, samples count <= AUDIO_SAMPLES_COUNT"
+#endif
+
+bool adc_profile_check(uint16_t profile, int32_t offset) {
+  if (profile >= ADC_PROFILE_COUNT) return false;
+  return ((int64_t)offset * adc_profiles[profile].samples) % adc_profiles[profile].freq == 0;
+}
+
+void set_adc_profile(uint16_t profile) {
+  // IF not aligned on profile sin/cos table, fall back to default
+  if (!adc_profile_check(profile, IF_OFFSET)) profile = 0;
+  if (profile == config._adc_profile) return;
+  config._adc_profile = profile;
+  tlv320aic3204_set_adc_freq(ADC_FREQ);
+  generate_DSP_Table(IF_OFFSET);
+  initI2S(rx_buffer, 2 * ADC_BUFFER_LEN * sizeof(audio_sample_t) / sizeof(int16_t));
+  request_to_redraw(REDRAW_FREQUENCY);
 }
 
+VNA_SHELL_FUNCTION(cmd_adc)
+{
+  if (argc == 1) {
+    uint16_t profile = my_atoui(argv[0]);
+    if (!adc_profile_check(profile, IF_OFFSET)) {
+      shell_printf("profile %d not valid for IF %d" VNA_SHELL_NEWLINE_STR, profile, IF_OFFSET);
+      return;
+    }
+    set_adc_profile(profile);
+    return;
+  }
+  for (int i = 0; i < ADC_PROFILE_COUNT; i++)
+    shell_printf("%c%d: %6u Hz, %2u samples, %5u Hz%s" VNA_SHELL_NEWLINE_STR, i == config._adc_profile ? '*' : ' ', i,
+                 adc_profiles[i].freq, adc_profiles[i].samples, adc_profiles[i].freq / adc_profiles[i].samples,
+                 adc_profile_check(i, IF_OFFSET) ? "" : " (not valid for IF)");
+}
+#endif
+
+#ifdef __USE_DELAY_TUNE__
+/*
+ * Generator settle delays auto tune
+ * For every Si5351 band (up to STOP_MAX, harmonic bands use current threshold) test step inside band,
+ * channel change and band change up/down on band limit: set 'from' frequency (and channel), wait full
+ * settle, switch to 'to' frequency and measure CH0 gamma after test delay, compare with settled value
+ * Minimum delay there gamma converge (binary search) + margin saved as tuned value
+ */
+#define TUNE_MAX_DELAY     US2ST(5000)        // Search range and settle time for reference measure
+#define TUNE_REPEAT        3                  // Repeat test transition, all should pass
+#define TUNE_TOLERANCE     (1.0f/1000)        // Allowed relative gamma error (-60dB)
+#define TUNE_MARGIN(d)     ((d) + (d) / 4 + US2ST(10))
+
+typedef struct {
+  uint8_t idx;    // delay index
+  uint8_t ch;     // channel before transition (measure always on CH0)
+  freq_t  from;
+  freq_t  to;
+} tune_step_t;
+
+enum {TUNE_STEP_BAND = 0, TUNE_STEP_CHANNEL, TUNE_STEP_UP, TUNE_STEP_DOWN, TUNE_STEP_COUNT};
+#define TUNE_STEP(f)       ((f) / 100)        // Frequency step inside band and over band limit (1%)
+
+// Build transition of type for band [lo, hi] (Si5351 band table, harmonic bands use _harmonic_freq_threshold)
+// Band change steps only up to last band (hi >= STOP_MAX)
+static bool tune_get_step(uint8_t type, uint8_t idx, freq_t lo, freq_t hi, tune_step_t *s) {
+  freq_t f = lo + (hi - lo) / 2;
+  s->idx = DELAY_TUNE_BANDCHANGE;
+  s->ch = 0;
+  switch (type) {
+    case TUNE_STEP_BAND:    s->idx = idx; s->from = f; s->to = f + TUNE_STEP(f); return true; // step inside band
+    case TUNE_STEP_CHANNEL: s->idx = DELAY_TUNE_CHANNEL_CHANGE; s->ch = 1; s->from = s->to = f; return true; // only codec channel change
+    case TUNE_STEP_UP:      s->from = hi - TUNE_STEP(hi); s->to = hi + TUNE_STEP(hi); break; // band change on upper limit
+    case TUNE_STEP_DOWN:    s->from = hi + TUNE_STEP(hi); s->to = hi - TUNE_STEP(hi); break;
+  }
+  return hi < STOP_MAX;
+}
+
+static void tune_measure(uint8_t ch, systime_t delay, float gamma[2]) {
+  tlv320aic3204_select(ch);
+  DSP_START_FIXED(delay);
+  DSP_WAIT;
+  calculate_gamma(gamma);
+}
+
+static bool tune_transition(const tune_step_t *s, systime_t delay, const float ref[2], float tol2) {
+  float gamma[2];
+  for (int r = 0; r < TUNE_REPEAT; r++) {
+    set_frequency(s->from);
+    tune_measure(s->ch, TUNE_MAX_DELAY, gamma);
+    set_frequency(s->to);
+    tune_measure(0, delay, gamma);
+    float re = gamma[0] - ref[0], im = gamma[1] - ref[1];
+    if (re * re + im * im > tol2) return false;
+  }
+  return true;
+}
+
+static systime_t tune_delay(const tune_step_t *s) {
+  float g0[2], g1[2];
+  // Settled value and noise estimate
+  set_frequency(s->to);
+  tune_measure(0, TUNE_MAX_DELAY, g0);
+  tune_measure(0, TUNE_MAX_DELAY, g1);
+  float n2 = (g1[0] - g0[0]) * (g1[0] - g0[0]) + (g1[1] - g0[1]) * (g1[1] - g0[1]);
+  float tol2 = (g0[0] * g0[0] + g0[1] * g0[1]) * (TUNE_TOLERANCE * TUNE_TOLERANCE);
+  if (tol2 < 16 * n2) tol2 = 16 * n2;
+  // Binary search minimum delay
+  systime_t lo = 0, hi = TUNE_MAX_DELAY;
+  while (lo < hi) {
+    systime_t mid = (lo + hi) / 2;
+    if (tune_transition(s, mid, g0, tol2)) hi = mid;
+    else lo = mid + 1;
+  }
+  return hi;
+}
+
+static const char *delay_name[DELAY_TUNE_COUNT] = {"band 1-2", "band 3-4", "band change", "channel", "sweep start"};
+
+VNA_SHELL_FUNCTION(cmd_settle)
+{
+  static const char cmd_settle_list[] = "auto|reset";
+  int idx = argc > 0 ? get_str_index(argv[0], cmd_settle_list) : -1;
+  if (idx == 0) {
+    // Measure all transitions of every band, store max of every type
+    uint16_t delay[DELAY_TUNE_COUNT] = {0};
+    freq_t lo = START_MIN, hi;
+    uint8_t band_idx;
+    for (uint16_t band = 1; lo < STOP_MAX; band++, lo = hi > lo ? hi : lo) {
+      hi = si5351_get_band_limit(band, &band_idx);
+      if (hi <= lo) continue;                     // band not used (limit under threshold)
+      if (hi > STOP_MAX) hi = STOP_MAX;
+      for (uint8_t type = 0; type < TUNE_STEP_COUNT; type++) {
+        tune_step_t s;
+        if (!tune_get_step(type, band_idx, lo, hi, &s)) continue;
+        systime_t d = TUNE_MARGIN(tune_delay(&s));
+        uint16_t us = d > TUNE_MAX_DELAY ? ST2US(TUNE_MAX_DELAY) : ST2US(d);
+        shell_printf("%s: %u -> %u Hz: %u us" VNA_SHELL_NEWLINE_STR, delay_name[s.idx], s.from, s.to, us);
+        if (delay[s.idx] < us) delay[s.idx] = us;
+      }
+    }
+    // Sweep start not tuned (state after idle unknown), keep current
+    delay[DELAY_TUNE_SWEEP_START] = config._delay[DELAY_TUNE_SWEEP_START];
+    memcpy(config._delay, delay, sizeof(delay));
+  } else if (idx == 1)
+    memset(config._delay, 0, sizeof(config._delay));
+  else if (argc == 2) {
+    uint16_t i = my_atoui(argv[0]);
+    if (i >= DELAY_TUNE_COUNT) goto usage;
+    config._delay[i] = my_atoui(argv[1]);
+  } else if (argc != 0) goto usage;
+  si5351_update_timings(config._delay);
+  for (int i = 0; i < DELAY_TUNE_COUNT; i++)
+    shell_printf("%d %-12s %u us%s" VNA_SHELL_NEWLINE_STR, i, delay_name[i], ST2US(timings[i]), config._delay[i] ? "" : " (default)");
+  return;
+usage:
+  shell_printf("usage: settle [%s|{id} {us}]" VNA_SHELL_NEWLINE_STR, cmd_settle_list);
+}
+#endif
+
+#ifdef __USE_AUTO_GAIN__
+// Measure sample channel gain of every step on freq (relative to previous step, need signal not clipped on max step)
+static void auto_gain_calibrate(freq_t freq) {
+  float prev[2], g[2];
+  config._auto_gain = AUTO_GAIN_STEPS;
+  set_frequency(freq);
+  // Steps count depend from band gain, get it after band set
+  uint8_t k, max = auto_gain_max_step();
+  tlv320aic3204_select(1);
+  for (k = 0; k < max; k++) {
+    auto_gain_set(k);
+    DSP_START_FIXED(US2ST(2000));
+    DSP_WAIT;
+    float level = dsp_sample_level();
+    shell_printf("step %d: level %f dBFS" VNA_SHELL_NEWLINE_STR, k, vna_log10f_x_10(level * level));
+    if (level >= AUTO_GAIN_CLIP) break;
+    calculate_gamma(g);
+    if (k == 0) {
+      config._gain_cal[0][0] = 1.0f;
+      config._gain_cal[0][1] = 0.0f;
+    } else {
+      // gain[k] = gain[k-1] * g / prev
+      float rr = prev[0] * prev[0] + prev[1] * prev[1];
+      float re = (g[0] * prev[0] + g[1] * prev[1]) / rr;
+      float im = (g[1] * prev[0] - g[0] * prev[1]) / rr;
+      const float *p = config._gain_cal[k - 1];
+      config._gain_cal[k][0] = p[0] * re - p[1] * im;
+      config._gain_cal[k][1] = p[0] * im + p[1] * re;
+    }
+    prev[0] = g[0];
+    prev[1] = g[1];
+  }
+  auto_gain_set(0);
+  config._auto_gain = k;
+}
+
+VNA_SHELL_FUNCTION(cmd_autogain)
+{
+  static const char cmd_autogain_list[] = "off|on|cal|reset";
+  if (argc > 0) {
+    switch (get_str_index(argv[0], cmd_autogain_list)) {
+      case 0: config._auto_gain = 0; break;
+      case 1: config._auto_gain = AUTO_GAIN_STEPS; break;
+      case 2: auto_gain_calibrate(argc > 1 ? my_atoui(argv[1]) : get_sweep_frequency(ST_CENTER)); break;
+      case 3: {static const float nominal[AUTO_GAIN_STEPS][2] = AUTO_GAIN_NOMINAL; memcpy(config._gain_cal, nominal, sizeof(nominal));} break;
+      default:
+        shell_printf("usage: autogain [%s] [freq]" VNA_SHELL_NEWLINE_STR, cmd_autogain_list);
+        return;
+    }
+    auto_gain_reset();
+  }
+  for (int i = 0; i < AUTO_GAIN_STEPS; i++) {
+    const float *g = config._gain_cal[i];
+    shell_printf("%c%d: %f dB %f deg" VNA_SHELL_NEWLINE_STR, i < config._auto_gain ? '*' : ' ', i,
+                 vna_log10f_x_10(auto_gain_mag2(i)), (180.0f / VNA_PI) * vna_atan2f(g[1], g[0]));
+  }
+}
+#endif
+
 void set_sweep_points(uint16_t points){
   if (points == sweep_points || points > POINTS_COUNT)
     return;
@@ -1550,13 +2436,18 @@ update_frequencies(void)
   freq_t stop  = get_sweep_frequency(ST_STOP);
 
   set_frequencies(start, stop, sweep_points);
+#ifdef __USE_AUTO_GAIN__
+  auto_gain_reset();
+#endif
 
   update_marker_index();
   // set grid layout
   update_grid();
   // Update interpolation flag
-  if (needInterpolate(start, stop, sweep_points))
+  if (needInterpolate(start, stop, sweep_points)) {
     cal_status|= CALSTAT_INTERPOLATED;
+    cal_interpolate_prepare();
+  }
   else
     cal_status&= ~CALSTAT_INTERPOLATED;
 
@@ -1771,6 +2662,125 @@ eterm_calc_et(void)
   cal_status |= CALSTAT_ET;
 }
 
+// Cal kit standard actual reflection on frequency
+// Termination load + offset line (delay, loss, Z0), Keysight cal kit definition
+static void
+calkit_gamma(int type, freq_t freq, float g[2])
+{
+  const calkit_t *k = &config._calkit;
+  float f = freq;
+  float w = VNA_TWOPI * f;
+  float sq = vna_sqrtf(f * 1e-9f);
+  float delay = k->delay[type] * 1e-12f;
+  float loss  = k->loss[type] * 1e9f;
+  // Offset line Zc = Z0 + (1 - j) * loss / (2w) * sqrt(f/1e9)
+  float zl  = w > 0.0f ? loss / (2.0f * w) * sq : 0.0f;
+  float zcr = k->z0 + zl;
+  float zci = -zl;
+  // Termination Gl = (Zt - Zc)/(Zt + Zc), for open use admittance Gl = (1 - Zc*Yt)/(1 + Zc*Yt)
+  float nr, ni, dr, di;
+  if (type == CALKIT_OPEN) {
+    float c = (k->c[0] + f * 1e-12f * (k->c[1] + f * 1e-9f * (k->c[2] + f * 1e-9f * k->c[3]))) * 1e-15f;
+    float yr = -zci * w * c, yi = zcr * w * c;    // Zc * jwC
+    nr = 1.0f - yr; ni = -yi;
+    dr = 1.0f + yr; di =  yi;
+  } else {
+    float zr, zi;
+    if (type == CALKIT_SHORT) {
+      zr = 0.0f;
+      zi = w * (k->l[0] + f * 1e-12f * (k->l[1] + f * 1e-9f * (k->l[2] + f * 1e-9f * k->l[3]))) * 1e-12f;
+    } else {
+      zr = k->load_r;
+      zi = w * k->load_l * 1e-12f;
+    }
+    nr = zr - zcr; ni = zi - zci;
+    dr = zr + zcr; di = zi + zci;
+  }
+  float d = 1.0f / (dr * dr + di * di);
+  float glr = (nr * dr + ni * di) * d;
+  float gli = (ni * dr - nr * di) * d;
+  // Line input G' = Gl * exp(-2*(al + j*bl)), al = loss * delay / (2 * Z0) * sqrt(f/1e9), bl = w * delay + al
+  float al = loss * delay / (2.0f * k->z0) * sq;
+  float bl = w * delay + al;
+  // exp(-2*al), al small on real kits, use series (vna_expf error 8e-5 and exp(0) != 1 break ideal kit)
+  float x = 2.0f * al, s, c;
+  float e = x < 0.1f ? 1.0f - x * (1.0f - x * 0.5f * (1.0f - x * (1.0f / 3.0f))) : vna_expf(-x);
+  vna_sincosf(-bl / VNA_PI, &s, &c);             // angle -2*bl in turns
+  float gr = e * (glr * c - gli * s);
+  float gi = e * (glr * s + gli * c);
+  // Reference to system impedance G = (G1 + G')/(1 + G1*G'), G1 = (Zc - Zsys)/(Zc + Zsys)
+  dr = zcr + CALKIT_Z_SYS;
+  d = 1.0f / (dr * dr + zci * zci);
+  float g1r = ((zcr - CALKIT_Z_SYS) * dr + zci * zci) * d;
+  float g1i = (zci * dr - (zcr - CALKIT_Z_SYS) * zci) * d;
+  nr = g1r + gr;
+  ni = g1i + gi;
+  dr = 1.0f + g1r * gr - g1i * gi;
+  di = g1r * gi + g1i * gr;
+  d = 1.0f / (dr * dr + di * di);
+  g[0] = (nr * dr + ni * di) * d;
+  g[1] = (ni * dr - nr * di) * d;
+}
+
+// Solve Ed, Es, Er on point from raw open, short and load by cal kit model
+// m = Ed + G*m*Es + G*De, De = Er - Ed*Es, linear for Ed, Es, De (subtract load row for remove Ed)
+static void
+calkit_solve(int i, float e[3][2])
+{
+  static const uint8_t std[3] = {CAL_OPEN, CAL_SHORT, CAL_LOAD};
+  float g[3][2], gm[3][2];
+  freq_t f = getFrequency(i);
+  for (int j = 0; j < 3; j++) {
+    const float *m = cal_data[std[j]][i];
+    calkit_gamma(j, f, g[j]);
+    gm[j][0] = g[j][0] * m[0] - g[j][1] * m[1];
+    gm[j][1] = g[j][0] * m[1] + g[j][1] * m[0];
+  }
+  const float *ml = cal_data[CAL_LOAD][i];
+  // a11*Es + a12*De = b1 (open - load), a21*Es + a22*De = b2 (short - load)
+  float a11r = gm[0][0] - gm[2][0], a11i = gm[0][1] - gm[2][1];
+  float a12r =  g[0][0] -  g[2][0], a12i =  g[0][1] -  g[2][1];
+  float a21r = gm[1][0] - gm[2][0], a21i = gm[1][1] - gm[2][1];
+  float a22r =  g[1][0] -  g[2][0], a22i =  g[1][1] -  g[2][1];
+  float b1r = cal_data[CAL_OPEN ][i][0] - ml[0], b1i = cal_data[CAL_OPEN ][i][1] - ml[1];
+  float b2r = cal_data[CAL_SHORT][i][0] - ml[0], b2i = cal_data[CAL_SHORT][i][1] - ml[1];
+  float detr = (a11r * a22r - a11i * a22i) - (a12r * a21r - a12i * a21i);
+  float deti = (a11r * a22i + a11i * a22r) - (a12r * a21i + a12i * a21r);
+  float d = 1.0f / (detr * detr + deti * deti);
+  // Es = (b1*a22 - b2*a12) / det, De = (a11*b2 - a21*b1) / det
+  float nr = (b1r * a22r - b1i * a22i) - (b2r * a12r - b2i * a12i);
+  float ni = (b1r * a22i + b1i * a22r) - (b2r * a12i + b2i * a12r);
+  float esr = (nr * detr + ni * deti) * d;
+  float esi = (ni * detr - nr * deti) * d;
+  nr = (a11r * b2r - a11i * b2i) - (a21r * b1r - a21i * b1i);
+  ni = (a11r * b2i + a11i * b2r) - (a21r * b1i + a21i * b1r);
+  float der = (nr * detr + ni * deti) * d;
+  float dei = (ni * detr - nr * deti) * d;
+  // Ed = ml - Gl*ml*Es - Gl*De
+  e[0][0] = ml[0] - (gm[2][0] * esr - gm[2][1] * esi) - (g[2][0] * der - g[2][1] * dei);
+  e[0][1] = ml[1] - (gm[2][0] * esi + gm[2][1] * esr) - (g[2][0] * dei + g[2][1] * der);
+  e[1][0] = esr;
+  e[1][1] = esi;
+  // Er = De + Ed*Es
+  e[2][0] = der + e[0][0] * esr - e[0][1] * esi;
+  e[2][1] = dei + e[0][0] * esi + e[0][1] * esr;
+}
+
+static void
+eterm_calc_calkit(void)
+{
+  int i;
+  float e[3][2];
+  for (i = 0; i < sweep_points; i++) {
+    calkit_solve(i, e);
+    cal_data[ETERM_ED][i][0] = e[0][0]; cal_data[ETERM_ED][i][1] = e[0][1];
+    cal_data[ETERM_ES][i][0] = e[1][0]; cal_data[ETERM_ES][i][1] = e[1][1];
+    cal_data[ETERM_ER][i][0] = e[2][0]; cal_data[ETERM_ER][i][1] = e[2][1];
+  }
+  cal_status &= ~(CALSTAT_OPEN|CALSTAT_SHORT);
+  cal_status |= CALSTAT_ES|CALSTAT_ER;
+}
+
 #if 0
 void apply_error_term(void)
 {
@@ -1848,9 +2858,9 @@ static void apply_CH0_error_term(float data[4], float c_data[CAL_TYPE_COUNT][2])
   float s11mi = data[1] - c_data[ETERM_ED][1];
   float err = c_data[ETERM_ER][0] + s11mr * c_data[ETERM_ES][0] - s11mi * c_data[ETERM_ES][1];
   float eri = c_data[ETERM_ER][1] + s11mr * c_data[ETERM_ES][1] + s11mi * c_data[ETERM_ES][0];
-  float sq = err*err + eri*eri;
-  data[0] = (s11mr * err + s11mi * eri) / sq;
-  data[1] = (s11mi * err - s11mr * eri) / sq;
+  float sq = 1.0f / (err*err + eri*eri); // reciprocal, one division
+  data[0] = (s11mr * err + s11mi * eri) * sq;
+  data[1] = (s11mi * err - s11mr * eri) * sq;
 }
 
 static void apply_CH1_error_term(float data[4], float c_data[CAL_TYPE_COUNT][2])
@@ -1864,6 +2874,130 @@ static void apply_CH1_error_term(float data[4], float c_data[CAL_TYPE_COUNT][2])
   data[3] = s21mi * c_data[ETERM_ET][0] + s21mr * c_data[ETERM_ET][1];
 }
 
+// Enhanced response: source match correction by corrected S11 (data[0..1] = S11a)
+static void apply_CH1_source_match(float data[4], float c_data[CAL_TYPE_COUNT][2])
+{
+  // S21a = S21a' * (1 - Es * S11a)
+  float esr = 1.0f - (c_data[ETERM_ES][0] * data[0] - c_data[ETERM_ES][1] * data[1]);
+  float esi = 0.0f - (c_data[ETERM_ES][1] * data[0] + c_data[ETERM_ES][0] * data[1]);
+  float s21r = data[2];
+  float s21i = data[3];
+  data[2] = s21r * esr - s21i * esi;
+  data[3] = s21i * esr + s21r * esi;
+}
+
+// Get one port error terms (Ed, Es, Er) on point from calculated terms or raw open/short/load data
+static bool
+eterm_get_one_port(int i, float e[3][2])
+{
+  e[0][0] = e[0][1] = 0.0f;
+  if (cal_status & CALSTAT_ED) {
+    e[0][0] = cal_data[ETERM_ED][i][0];
+    e[0][1] = cal_data[ETERM_ED][i][1];
+  }
+  if ((cal_status & (CALSTAT_ES|CALSTAT_ER)) == (CALSTAT_ES|CALSTAT_ER)) {
+    e[1][0] = cal_data[ETERM_ES][i][0]; e[1][1] = cal_data[ETERM_ES][i][1];
+    e[2][0] = cal_data[ETERM_ER][i][0]; e[2][1] = cal_data[ETERM_ER][i][1];
+    return true;
+  }
+  if ((cal_status & (CALSTAT_OPEN|CALSTAT_SHORT)) != (CALSTAT_OPEN|CALSTAT_SHORT))
+    return false;
+  if (cal_status & CALSTAT_LOAD) {
+    calkit_solve(i, e);
+    return true;
+  }
+  // Same as eterm_calc_es and eterm_calc_er(-1) for ideal open and short (no load)
+  // Es = (S11mo' + S11ms')/(S11mo' - S11ms'), Er = -(1 + Es)S11ms'
+  float s11or = cal_data[CAL_OPEN][i][0] - e[0][0];
+  float s11oi = cal_data[CAL_OPEN][i][1] - e[0][1];
+  float s11sr = cal_data[CAL_SHORT][i][0] - e[0][0];
+  float s11si = cal_data[CAL_SHORT][i][1] - e[0][1];
+  float numr = s11or + s11sr, numi = s11oi + s11si;
+  float denomr = s11or - s11sr, denomi = s11oi - s11si;
+  float d = 1.0f / (denomr*denomr + denomi*denomi);
+  e[1][0] = (numr*denomr + numi*denomi) * d;
+  e[1][1] = (numi*denomr - numr*denomi) * d;
+  e[2][0] = -((1.0f + e[1][0]) * s11sr - e[1][1] * s11si);
+  e[2][1] = -((1.0f + e[1][0]) * s11si + e[1][1] * s11sr);
+  return true;
+}
+
+// Enhanced response: thru S21 include load match El (thru S11 after one port correction)
+// S21mt - Ex = Et / (1 - Es * El), store S21mt * (1 - Es * El) (Ex * Es * El ignored, isolation small)
+static void
+eterm_thru_load_match(void)
+{
+  int i;
+  float e[3][2];
+  for (i = 0; i < sweep_points; i++) {
+    if (!eterm_get_one_port(i, e))
+      return;
+    // El = S11mt' / (Er + Es * S11mt'), S11mt' = S11mt - Ed
+    float tr = measured[0][i][0] - e[0][0];
+    float ti = measured[0][i][1] - e[0][1];
+    float dr = e[2][0] + tr * e[1][0] - ti * e[1][1];
+    float di = e[2][1] + tr * e[1][1] + ti * e[1][0];
+    float d = 1.0f / (dr*dr + di*di);
+    float elr = (tr * dr + ti * di) * d;
+    float eli = (ti * dr - tr * di) * d;
+    float kr = 1.0f - (e[1][0] * elr - e[1][1] * eli);
+    float ki = 0.0f - (e[1][0] * eli + e[1][1] * elr);
+    float sr = cal_data[CAL_THRU][i][0];
+    float si = cal_data[CAL_THRU][i][1];
+    cal_data[CAL_THRU][i][0] = sr * kr - si * ki;
+    cal_data[CAL_THRU][i][1] = si * kr + sr * ki;
+  }
+}
+
+#ifdef __USE_CAL_AVERAGE__
+// Minimum sweeps count before check standard error
+#define CAL_AVERAGE_MIN  3
+// Per point variance sum (own buffer, spi_buffer used by LCD draw on sweep)
+static float cal_m2[POINTS_COUNT];
+
+static void
+cal_average_progress(int n, int count, float se2)
+{
+  lcd_set_foreground(LCD_FG_COLOR);
+  lcd_set_background(LCD_BG_COLOR);
+  if (se2 > 0.0f)
+    lcd_printf(OFFSETX + CELLOFFSETX + 2, OFFSETY + 2, "AVG %d/%d SE %.1f" S_dB "   ", n, count, vna_log10f_x_10(se2));
+  else
+    lcd_printf(OFFSETX + CELLOFFSETX + 2, OFFSETY + 2, "AVG %d/%d   ", n, count);
+}
+
+// Made average on collect, cal_data[dst] already have first sweep
+// Running mean (Welford): mean+= (x - mean) / n, m2+= |x - mean_old| * |x - mean_new|
+// Standard error of mean = sqrt(m2 / (n * (n - 1))), stop then max on all points less config._cal_stderr
+static void
+cal_average(uint16_t dst, uint16_t src, uint16_t mask)
+{
+  int count = config._cal_average, n, j;
+  if (count < 2) return;
+  float limit = config._cal_stderr < 0.0f ? vna_expf(config._cal_stderr * (logf(10.0f) / 10.0f)) : 0.0f;
+  float se2 = 0.0f;
+  float *m2 = cal_m2;
+  for (j = 0; j < sweep_points; j++)
+    m2[j] = 0.0f;
+  for (n = 2; n <= count; n++) {
+    cal_average_progress(n, count, se2);
+    sweep(false, mask);
+    float k = 1.0f / n, max_m2 = 0.0f;
+    for (j = 0; j < sweep_points; j++) {
+      float dr = measured[src][j][0] - cal_data[dst][j][0];
+      float di = measured[src][j][1] - cal_data[dst][j][1];
+      cal_data[dst][j][0]+= dr * k;
+      cal_data[dst][j][1]+= di * k;
+      m2[j]+= (dr * dr + di * di) * (1.0f - k);  // (x - mean_old)*(x - mean_new) = (1 - 1/n)*|x - mean_old|^2
+      if (m2[j] > max_m2) max_m2 = m2[j];
+    }
+    se2 = max_m2 / (n * (n - 1));
+    if (n >= CAL_AVERAGE_MIN && se2 < limit) break;
+  }
+  request_to_redraw(REDRAW_AREA);
+}
+#endif
+
 void
 cal_collect(uint16_t type)
 {
@@ -1883,6 +3017,7 @@ cal_collect(uint16_t type)
     [CAL_ISOLN]= {CALSTAT_ISOLN, ~(                      CALSTAT_APPLY), CAL_ISOLN, 1},
   };
   if (type >= ARRAY_COUNT(calibration_set)) return;
+  caldata_unref();  // Get RAM copy of calibration before modify
 
   // reset old calibration if frequency range/points not some
   if (needInterpolate(frequency0, frequency1, sweep_points)){
@@ -1899,7 +3034,7 @@ cal_collect(uint16_t type)
   src = calibration_set[type].src;
 
   // Run sweep for collect data (use minimum BANDWIDTH_30, or bigger if set)
-  uint8_t bw = config._bandwidth;  // store current setting
+  uint16_t bw = config._bandwidth; // store current setting
   if (bw < BANDWIDTH_100)
     config._bandwidth = BANDWIDTH_100;
 
@@ -1907,28 +3042,20 @@ cal_collect(uint16_t type)
 //  if (sweep_points != POINTS_COUNT)
 //    set_sweep_points(POINTS_COUNT);
   uint16_t mask = (src == 0) ? SWEEP_CH0_MEASURE : SWEEP_CH1_MEASURE;
+  // Enhanced response need thru reflection for load match
+  if (dst == CAL_THRU && (cal_status & CALSTAT_ENHANCED_RESPONSE)) mask|= SWEEP_CH0_MEASURE;
   if (electrical_delay) mask|= SWEEP_APPLY_EDELAY;
   // Measure calibration data
   sweep(false, mask);
   // Copy calibration data
   memcpy(cal_data[dst], measured[src], sizeof measured[0]);
 
-  // Made average if need
-  int count = 1, i, j;
-  for (i = 1; i < count; i ++){
-    sweep(false, (src == 0) ? SWEEP_CH0_MEASURE : SWEEP_CH1_MEASURE);
-    for (j = 0; j < sweep_points; j++){
-      cal_data[dst][j][0]+=measured[src][j][0];
-      cal_data[dst][j][1]+=measured[src][j][1];
-    }
-  }
-  if (i != 1){
-    float k = 1.0f / i;
-    for (j = 0; j < sweep_points; j++){
-      cal_data[dst][j][0]*= k;
-      cal_data[dst][j][1]*= k;
-    }
-  }
+  // Made average if need (thru load match use last S11 sweep)
+#ifdef __USE_CAL_AVERAGE__
+  cal_average(dst, src, mask);
+#endif
+  if (mask & SWEEP_CH0_MEASURE && dst == CAL_THRU)
+    eterm_thru_load_match();
 
   config._bandwidth = bw;          // restore
   request_to_redraw(REDRAW_CAL_STATUS);
@@ -1937,6 +3064,7 @@ cal_collect(uint16_t type)
 void
 cal_done(void)
 {
+  caldata_unref();  // Get RAM copy of calibration before modify
   // Set Load/Ed to default if not calculated
   if (!(cal_status & CALSTAT_LOAD))
     eterm_set(ETERM_ED, 0.0, 0.0);
@@ -1945,7 +3073,9 @@ cal_done(void)
     eterm_set(ETERM_EX, 0.0, 0.0);
 
   // Precalculate Es and Er from Short and Open (and use Load/Ed data)
-  if ((cal_status & CALSTAT_SHORT) && (cal_status & CALSTAT_OPEN)) {
+  if ((cal_status & (CALSTAT_SHORT|CALSTAT_OPEN|CALSTAT_LOAD)) == (CALSTAT_SHORT|CALSTAT_OPEN|CALSTAT_LOAD)) {
+    eterm_calc_calkit();  // All standards measured, use cal kit model
+  } else if ((cal_status & CALSTAT_SHORT) && (cal_status & CALSTAT_OPEN)) {
     eterm_calc_es();
     eterm_calc_er(-1);
   } else if (cal_status & CALSTAT_OPEN) {
@@ -1971,10 +3101,40 @@ cal_done(void)
     eterm_set(ETERM_ES, 0.0, 0.0);
 
   cal_status|= CALSTAT_APPLY;
+  cal_interpolate_prepare();
   lastsaveid = NO_SAVE_SLOT;
   request_to_redraw(REDRAW_BACKUP | REDRAW_CAL_STATUS);
 }
 
+// Interpolation use only calibration points from one harmonic band (error terms have step between bands)
+// Band split points precalculated on cal done and on change sweep range (calibration load)
+#define CAL_INTERPOLATE_POINTS  4   // cubic interpolation
+#define CAL_BAND_SPLIT_MAX     16
+static uint16_t cal_band_split[CAL_BAND_SPLIT_MAX]; // first calibration point index of next harmonic band
+static uint8_t  cal_band_splits;
+// Lagrange weight denominators 1/prod(i - m), m != i, on equidistant nodes 0..n-1 (n = 2..4)
+static const float cal_lagrange_rden[CAL_INTERPOLATE_POINTS + 1][CAL_INTERPOLATE_POINTS] = {
+  [2] = {-1.0f,        1.0f},
+  [3] = { 0.5f,       -1.0f,  0.5f},
+  [4] = {-1.0f / 6.0f, 0.5f, -0.5f, 1.0f / 6.0f},
+};
+
+static void
+cal_interpolate_prepare(void)
+{
+  uint16_t src_points = cal_sweep_points - 1;
+  freq_t span = cal_frequency1 - cal_frequency0;
+  uint32_t band = si5351_get_harmonic_lvl(cal_frequency0), b;
+  cal_band_splits = 0;
+  if (src_points == 0) return;
+  for (int i = 1; i <= src_points && cal_band_splits < CAL_BAND_SPLIT_MAX; i++) {
+    b = si5351_get_harmonic_lvl(cal_frequency0 + ((uint64_t)span * i + src_points/2) / src_points);
+    if (b == band) continue;
+    band = b;
+    cal_band_split[cal_band_splits++] = i;
+  }
+}
+
 static void cal_interpolate(int idx, freq_t f, float data[CAL_TYPE_COUNT][2]){
   int eterm;
   uint16_t src_points = cal_sweep_points - 1;
@@ -2000,35 +3160,49 @@ static void cal_interpolate(int idx, freq_t f, float data[CAL_TYPE_COUNT][2]){
   if (f == src_f0) goto copy_point;
 
   float k1 = (delta == 0) ? 0.0f : (float)(f - src_f0) / delta;
-  // avoid glitch between freqs in different harmonics mode
-  uint32_t hf0 = si5351_get_harmonic_lvl(src_f0);
-  if (hf0 != si5351_get_harmonic_lvl(src_f1)) {
-    // f in prev harmonic, need extrapolate from prev 2 points
-    if (hf0 == si5351_get_harmonic_lvl(f)){
-      if (idx < 1) goto copy_point; // point limit
-      idx--;
-      k1+= 1.0f;
-    }
-    // f in next harmonic, need extrapolate from next 2 points
-    else {
-      if (idx >= src_points) goto copy_point; // point limit
-      idx++;
-      k1-= 1.0f;
-    }
+  // avoid glitch between freqs in different harmonics mode, use only points from f harmonic band
+  // f in prev harmonic - extrapolate from prev points, f in next harmonic - extrapolate from next points
+  int p = idx;
+  if (si5351_get_harmonic_lvl(src_f0) != si5351_get_harmonic_lvl(f))
+    p++;
+  int lo = 0, hi = src_points, i;
+  for (i = 0; i < cal_band_splits; i++) {
+    if (cal_band_split[i] > p) {hi = cal_band_split[i] - 1; break;}
+    lo = cal_band_split[i];
+  }
+  // Lagrange polynomial on n points from band (cubic, quadratic on extrapolate, linear or copy if band small)
+  int n = hi - lo + 1;
+  if (n > CAL_INTERPOLATE_POINTS) n = CAL_INTERPOLATE_POINTS;
+  if ((idx < lo || idx >= hi) && n > 3) n = 3;
+  if (n < 2) {idx = p; goto copy_point;}
+  int s = n > 2 ? idx - 1 : idx;
+  if (s > hi - n + 1) s = hi - n + 1;
+  if (s < lo) s = lo;
+  // w[i] = prod(u - m) / prod(i - m), m != i: cached denominators, numerator from prefix and suffix products
+  float u = (idx - s) + k1, w[CAL_INTERPOLATE_POINTS], l = 1.0f, r = 1.0f;
+  for (i = 0; i < n; i++) {
+    w[i] = l * cal_lagrange_rden[n][i];
+    l*= u - i;
+  }
+  for (i = n - 1; i >= 0; i--) {
+    w[i]*= r;
+    r*= u - i;
   }
-  // Interpolate by k1
-  float k0 = 1.0f - k1;
   for (eterm = 0; eterm < CAL_TYPE_COUNT; eterm++) {
-    data[eterm][0] = cal_data[eterm][idx][0] * k0 + cal_data[eterm][idx+1][0] * k1;
-    data[eterm][1] = cal_data[eterm][idx][1] * k0 + cal_data[eterm][idx+1][1] * k1;
+    float re = 0.0f, im = 0.0f, v[2];
+    for (i = 0; i < n; i++) {
+      caldata_point(eterm, s + i, v);
+      re+= v[0] * w[i];
+      im+= v[1] * w[i];
+    }
+    data[eterm][0] = re;
+    data[eterm][1] = im;
   }
   return;
   // Direct point copy
 copy_point:
-  for (eterm = 0; eterm < CAL_TYPE_COUNT; eterm++) {
-    data[eterm][0] = cal_data[eterm][idx][0];
-    data[eterm][1] = cal_data[eterm][idx][1];
-  }
+  for (eterm = 0; eterm < CAL_TYPE_COUNT; eterm++)
+    caldata_point(eterm, idx, data[eterm]);
   return;
 }
 
@@ -2042,13 +3216,20 @@ VNA_SHELL_FUNCTION(cmd_cal)
       if (cal_status & (1<<i))
         shell_printf("%s ", items[i]);
     }
+    if (cal_status & CALSTAT_ENHANCED_RESPONSE)
+      shell_printf("enhanced");
     shell_printf(VNA_SHELL_NEWLINE_STR);
     return;
   }
   request_to_redraw(REDRAW_CAL_STATUS);
-  //                                     0    1     2    3     4    5  6   7     8
-  static const char cmd_cal_list[] = "load|open|short|thru|isoln|done|on|off|reset";
-  switch (get_str_index(argv[0], cmd_cal_list)) {
+  //                                     0    1     2    3     4    5  6   7     8      9     10   11
+  static const char cmd_cal_list[] = "load|open|short|thru|isoln|done|on|off|reset|enh_on|enh_off"
+#ifdef __USE_CAL_AVERAGE__
+                                     "|avg"
+#endif
+  ;
+  int idx = get_str_index(argv[0], cmd_cal_list);
+  switch (idx) {
     case 0:
       cal_collect(CAL_LOAD);
       return;
@@ -2074,14 +3255,65 @@ VNA_SHELL_FUNCTION(cmd_cal)
       cal_status &= ~CALSTAT_APPLY;
       return;
     case 8:
+      caldata_reset();
       cal_status = 0;
       return;
+    case 9:
+    case 10:
+      if (cal_status & CALSTAT_ENHANCED_LOCK) {
+        shell_printf("thru measured, reset calibration for change enhanced" VNA_SHELL_NEWLINE_STR);
+        return;
+      }
+      if (idx == 9) cal_status |=  CALSTAT_ENHANCED_RESPONSE;
+      else          cal_status &= ~CALSTAT_ENHANCED_RESPONSE;
+      return;
+#ifdef __USE_CAL_AVERAGE__
+    case 11:
+      if (argc > 1) {
+        int count = my_atoi(argv[1]);
+        config._cal_average = count < 1 ? 1 : count;
+        config._cal_stderr = argc > 2 ? my_atof(argv[2]) : 0.0f;
+      }
+      shell_printf("average %d stderr %f" S_dB VNA_SHELL_NEWLINE_STR, config._cal_average, config._cal_stderr);
+      return;
+#endif
     default:
       break;
   }
   shell_printf("usage: cal [%s]" VNA_SHELL_NEWLINE_STR, cmd_cal_list);
 }
 
+VNA_SHELL_FUNCTION(cmd_calkit)
+{
+  static const char cmd_calkit_list[] = "open|short|load|delay|loss|z0|reset";
+  calkit_t *k = &config._calkit;
+  int i;
+  if (argc > 0) {
+    int idx = get_str_index(argv[0], cmd_calkit_list);
+    argc--; argv++;
+    switch (idx) {
+      case 0: for (i = 0; i < 4 && i < argc; i++) k->c[i] = my_atof(argv[i]); break;
+      case 1: for (i = 0; i < 4 && i < argc; i++) k->l[i] = my_atof(argv[i]); break;
+      case 2: if (argc > 0) k->load_r = my_atof(argv[0]); if (argc > 1) k->load_l = my_atof(argv[1]); break;
+      case 3: for (i = 0; i < 3 && i < argc; i++) k->delay[i] = my_atof(argv[i]); break;
+      case 4: for (i = 0; i < 3 && i < argc; i++) k->loss[i] = my_atof(argv[i]); break;
+      case 5: if (argc > 0) k->z0 = my_atof(argv[0]); break;
+      case 6: {static const calkit_t def = CALKIT_DEFAULT; *k = def;} break;
+      default:
+        shell_printf("usage: calkit [%s] {values}" VNA_SHELL_NEWLINE_STR, cmd_calkit_list);
+        return;
+    }
+    if (k->z0 <= 0.0f) k->z0 = CALKIT_Z_SYS;
+    return;
+  }
+  shell_printf("open C0..C3: %f %f %f %f" VNA_SHELL_NEWLINE_STR, k->c[0], k->c[1], k->c[2], k->c[3]);
+  shell_printf("short L0..L3: %f %f %f %f" VNA_SHELL_NEWLINE_STR, k->l[0], k->l[1], k->l[2], k->l[3]);
+  shell_printf("load R L: %f %f" VNA_SHELL_NEWLINE_STR, k->load_r, k->load_l);
+  shell_printf("delay ps: %f %f %f" VNA_SHELL_NEWLINE_STR, k->delay[0], k->delay[1], k->delay[2]);
+  shell_printf("loss GOhm/s: %f %f %f" VNA_SHELL_NEWLINE_STR, k->loss[0], k->loss[1], k->loss[2]);
+  shell_printf("z0: %f" VNA_SHELL_NEWLINE_STR, k->z0);
+}
+
 VNA_SHELL_FUNCTION(cmd_save)
 {
   if (argc != 1)
@@ -2126,6 +3358,8 @@ const char *get_trace_chname(int t)
 void set_trace_type(int t, int type, int channel)
 {
   channel&= 1;
+  // TDR Z not valid on this channel/mode, show step response reflection coefficient
+  if (type == TRC_TDR && !TDR_AVAILABLE(channel)) type = TRC_REAL;
   bool update = trace[t].type != type || trace[t].channel != channel;
   if (!update) return;
   if (trace[t].type != type) {
@@ -2142,12 +3376,21 @@ void set_trace_type(int t, int type, int channel)
 void set_trace_channel(int t, int channel)
 {
   channel&= 1;
+  if (trace[t].type == TRC_TDR && !TDR_AVAILABLE(channel)) {set_trace_type(t, TRC_REAL, channel); return;}
   if (trace[t].channel != channel) {
     trace[t].channel = channel;
     request_to_redraw(REDRAW_MARKER | REDRAW_PLOT);
   }
 }
 
+// Call after transform mode change, TDR Z traces not valid in new mode switch to real
+void tdr_check_traces(void)
+{
+  for (int t = 0; t < TRACES_MAX; t++)
+    if (trace[t].type == TRC_TDR && !TDR_AVAILABLE(trace[t].channel))
+      set_trace_type(t, TRC_REAL, trace[t].channel);
+}
+
 void set_active_trace(int t) {
   if (current_trace == t) return;
   current_trace = t;
@@ -2233,12 +3476,12 @@ VNA_SHELL_FUNCTION(cmd_trace)
     set_trace_enable(t, false);
     return;
   }
-#if MAX_TRACE_TYPE != 30
+#if MAX_TRACE_TYPE != 31
 #error "Trace type enum possibly changed, check cmd_trace function"
 #endif
   // enum TRC_LOGMAG, TRC_PHASE, TRC_DELAY, TRC_SMITH, TRC_POLAR, TRC_LINEAR, TRC_SWR, TRC_REAL, TRC_IMAG, TRC_R, TRC_X, TRC_Z, TRC_ZPHASE,
-  //      TRC_G, TRC_B, TRC_Y, TRC_Rp, TRC_Xp, TRC_sC, TRC_sL, TRC_pC, TRC_pL, TRC_Q, TRC_Rser, TRC_Xser, TRC_Zser, TRC_Rsh, TRC_Xsh, TRC_Zsh, TRC_Qs21
-  static const char cmd_type_list[] = "logmag|phase|delay|smith|polar|linear|swr|real|imag|r|x|z|zp|g|b|y|rp|xp|sc|sl|pc|pl|q|rser|xser|zser|rsh|xsh|zsh|q21";
+  //      TRC_G, TRC_B, TRC_Y, TRC_Rp, TRC_Xp, TRC_sC, TRC_sL, TRC_pC, TRC_pL, TRC_Q, TRC_Rser, TRC_Xser, TRC_Zser, TRC_Rsh, TRC_Xsh, TRC_Zsh, TRC_Qs21, TRC_TDR
+  static const char cmd_type_list[] = "logmag|phase|delay|smith|polar|linear|swr|real|imag|r|x|z|zp|g|b|y|rp|xp|sc|sl|pc|pl|q|rser|xser|zser|rsh|xsh|zsh|q21|tdr";
   int type = get_str_index(argv[1], cmd_type_list);
   if (type >= 0) {
     int src = trace[t].channel;
@@ -2247,6 +3490,10 @@ VNA_SHELL_FUNCTION(cmd_trace)
       if ((uint32_t)src > 1)
         goto usage;
     }
+    if (type == TRC_TDR && !TDR_AVAILABLE(src)) {
+      shell_printf("tdr need S11 and transform on step" VNA_SHELL_NEWLINE_STR);
+      return;
+    }
     set_trace_type(t, type, src);
     set_trace_enable(t, true);
     return;
@@ -2391,6 +3638,7 @@ set_domain_mode(int mode) // accept DOMAIN_FREQ or DOMAIN_TIME
 {
   if (mode != (props_mode & DOMAIN_MODE)) {
     props_mode = (props_mode & ~DOMAIN_MODE) | (mode & DOMAIN_MODE);
+    tdr_check_traces();
     request_to_redraw(REDRAW_FREQUENCY | REDRAW_MARKER);
     lever_mode = LM_MARKER;
   }
@@ -2400,10 +3648,11 @@ static inline void
 set_timedomain_func(uint32_t func) // accept TD_FUNC_LOWPASS_IMPULSE, TD_FUNC_LOWPASS_STEP or TD_FUNC_BANDPASS
 {
   props_mode = (props_mode & ~TD_FUNC) | func;
+  tdr_check_traces();
 }
 
 static inline void
-set_timedomain_window(uint32_t func) // accept TD_WINDOW_MINIMUM/TD_WINDOW_NORMAL/TD_WINDOW_MAXIMUM
+set_timedomain_window(uint32_t func) // accept TD_WINDOW_MINIMUM/TD_WINDOW_NORMAL/TD_WINDOW_MAXIMUM/TD_WINDOW_HANN/TD_WINDOW_BLACKMAN
 {
   props_mode = (props_mode & ~TD_WINDOW) | func;
 }
@@ -2414,8 +3663,8 @@ VNA_SHELL_FUNCTION(cmd_transform)
   if (argc == 0) {
     goto usage;
   }
-  //                                         0   1       2    3        4       5      6       7
-  static const char cmd_transform_list[] = "on|off|impulse|step|bandpass|minimum|normal|maximum";
+  //                                         0   1       2    3        4       5      6       7    8    9   10       11
+  static const char cmd_transform_list[] = "on|off|impulse|step|bandpass|minimum|normal|maximum|zoom|gate|hann|blackman";
   for (i = 0; i < argc; i++) {
     switch (get_str_index(argv[i], cmd_transform_list)) {
       case 0: set_domain_mode(DOMAIN_TIME); break;
@@ -2426,6 +3675,41 @@ VNA_SHELL_FUNCTION(cmd_transform)
       case 5: set_timedomain_window(TD_WINDOW_MINIMUM); break;
       case 6: set_timedomain_window(TD_WINDOW_NORMAL); break;
       case 7: set_timedomain_window(TD_WINDOW_MAXIMUM); break;
+      case 10: set_timedomain_window(TD_WINDOW_HANN); break;
+      case 11: set_timedomain_window(TD_WINDOW_BLACKMAN); break;
+#ifdef __USE_TD_ZOOM__
+      case 8: // zoom {start stop}|off
+        if (i + 1 < argc && get_str_index(argv[i + 1], "off") == 0) {props_mode&= ~TD_ZOOM; i++; break;}
+        if (i + 2 >= argc) goto usage;
+        if (domain_func == TD_FUNC_BANDPASS) {
+          shell_printf("zoom only for lowpass" VNA_SHELL_NEWLINE_STR);
+          return;
+        }
+        td_start = my_atof(argv[++i]);
+        td_stop  = my_atof(argv[++i]);
+        props_mode|= TD_ZOOM;
+        request_to_redraw(REDRAW_FREQUENCY | REDRAW_MARKER);
+        break;
+#endif
+#ifdef __USE_TD_GATE__
+      case 9: { // gate {start stop}|off|markers|minimum|normal|maximum
+        //                                     0       1       2      3       4
+        static const char gate_list[] = "off|markers|minimum|normal|maximum";
+        static const uint16_t gate_shape[] = {TD_GATE_MINIMUM, TD_GATE_NORMAL, TD_GATE_MAXIMUM};
+        if (i + 1 >= argc) goto usage;
+        int g = get_str_index(argv[i + 1], gate_list);
+        if      (g == 0) {props_mode&= ~TD_GATE; i++; break;}
+        else if (g == 1) {if (!set_gate_from_markers()) goto usage; i++;}
+        else if (g >= 2) {props_mode = (props_mode & ~TD_GATE_SHAPE) | gate_shape[g - 2]; i++;}
+        else {
+          if (i + 2 >= argc) goto usage;
+          gate_start = my_atof(argv[++i]);
+          gate_stop  = my_atof(argv[++i]);
+        }
+        props_mode|= TD_GATE;
+        break;
+      }
+#endif
       default:
         goto usage;
     }
@@ -2433,6 +3717,28 @@ VNA_SHELL_FUNCTION(cmd_transform)
   return;
 usage:
   shell_printf("usage: transform {%s} [...]" VNA_SHELL_NEWLINE_STR, cmd_transform_list);
+#ifdef __USE_TD_ZOOM__
+  shell_printf("       transform zoom {start(s) stop(s)}|off" VNA_SHELL_NEWLINE_STR);
+#endif
+#ifdef __USE_TD_GATE__
+  shell_printf("       transform gate {start(s) stop(s)}|off|markers|minimum|normal|maximum" VNA_SHELL_NEWLINE_STR);
+#endif
+}
+#endif
+
+#ifdef __S11_DTF_MEASURE__
+VNA_SHELL_FUNCTION(cmd_dtf)
+{
+  dtf_peak_t peak[MEASURE_DTF_COUNT];
+  int count = argc == 1 ? my_atoi(argv[0]) : MEASURE_DTF_COUNT;
+  if (argc > 1 || count < 1 || count > MEASURE_DTF_COUNT) {
+    shell_printf("usage: dtf [1..%d]" VNA_SHELL_NEWLINE_STR, MEASURE_DTF_COUNT);
+    return;
+  }
+  // Output distance (m) and return loss (dB) of time domain S11 peaks
+  count = measure_dtf_peaks(peak, count);
+  for (int i = 0; i < count; i++)
+    shell_printf("%f %f" VNA_SHELL_NEWLINE_STR, peak[i].distance, peak[i].rl);
 }
 #endif
 
@@ -2527,7 +3833,7 @@ VNA_SHELL_FUNCTION(cmd_stat)
   int32_t ave0, ave1;
 //  float sample[2], ref[2];
 //  minr, maxr,  mins, maxs;
-  int32_t count = AUDIO_BUFFER_LEN;
+  int32_t count = ADC_BUFFER_LEN;
   int i;
   (void)argc;
   (void)argv;
@@ -2540,7 +3846,7 @@ VNA_SHELL_FUNCTION(cmd_stat)
 //    dsp_process(&p[AUDIO_BUFFER_LEN], AUDIO_BUFFER_LEN);
 
     acc0 = acc1 = 0;
-    for (i = 0; i < AUDIO_BUFFER_LEN*2; i += 2) {
+    for (i = 0; i < ADC_BUFFER_LEN*2; i += 2) {
       acc0 += p[i  ];
       acc1 += p[i+1];
     }
@@ -2549,7 +3855,7 @@ VNA_SHELL_FUNCTION(cmd_stat)
     acc0 = acc1 = 0;
 //    minr  = maxr = 0;
 //    mins  = maxs = 0;
-    for (i = 0; i < AUDIO_BUFFER_LEN*2; i += 2) {
+    for (i = 0; i < ADC_BUFFER_LEN*2; i += 2) {
       acc0 += (p[i  ] - ave0)*(p[i  ] - ave0);
       acc1 += (p[i+1] - ave1)*(p[i+1] - ave1);
 //      if (minr < p[i  ]) minr = p[i  ];
@@ -2576,6 +3882,85 @@ VNA_SHELL_FUNCTION(cmd_stat)
 }
 #endif
 
+#ifdef ENABLE_PERF_COMMAND
+VNA_SHELL_FUNCTION(cmd_perf)
+{
+  if (argc == 1 && get_str_index(argv[0], "reset") == 0) {
+    osalSysLock();
+    perf_reset();
+    osalSysUnlock();
+    return;
+  }
+  if (argc != 0) {
+    shell_printf("usage: perf [reset]" VNA_SHELL_NEWLINE_STR);
+    return;
+  }
+  // Get snapshot, interrupt can change data
+  osalSysLock();
+  uint32_t callback_count = perf.callback_count;
+  uint32_t process_count = perf.process_count;
+  uint32_t busy_min = perf.busy_min, busy_max = perf.busy_max;
+  uint32_t interval_min = perf.interval_min, interval_max = perf.interval_max;
+  uint64_t busy_cycles = perf.busy_cycles;
+  uint64_t interval_cycles = perf.interval_cycles;
+  uint32_t hist[PERF_HIST_COUNT];
+  memcpy(hist, perf.hist, sizeof(hist));
+  uint32_t latency_max = perf.latency_max;
+  uint32_t latency[PERF_LATENCY_COUNT];
+  memcpy(latency, perf.latency, sizeof(latency));
+  osalSysUnlock();
+  if (callback_count < 2) {
+    shell_printf("no data" VNA_SHELL_NEWLINE_STR);
+    return;
+  }
+  uint32_t busy_ave = busy_cycles / callback_count;
+  uint32_t interval_ave = interval_cycles / (callback_count - 1);
+  uint32_t load = busy_cycles * 1000 / (interval_cycles + busy_max); // in 0.1%, include last interval
+  shell_printf("clock: %u Hz, nominal interval: %u" VNA_SHELL_NEWLINE_STR, STM32_SYSCLK, PERF_INTERVAL_CYCLES);
+  shell_printf("callback count: %u, processed: %u" VNA_SHELL_NEWLINE_STR, callback_count, process_count);
+  shell_printf("busy cycle:     min %u ave %u max %u" VNA_SHELL_NEWLINE_STR, busy_min, busy_ave, busy_max);
+  shell_printf("interval cycle: min %u ave %u max %u" VNA_SHELL_NEWLINE_STR, interval_min, interval_ave, interval_max);
+  shell_printf("max latency: %d, load: %u.%u%%, peak: %u%%" VNA_SHELL_NEWLINE_STR,
+               (int)(interval_max - PERF_INTERVAL_CYCLES), load / 10, load % 10, busy_max * 100 / PERF_INTERVAL_CYCLES);
+  shell_printf("busy histogram:" VNA_SHELL_NEWLINE_STR);
+  for (int i = 0; i < PERF_HIST_COUNT; i++)
+    if (hist[i]) {
+      if (i < PERF_HIST_COUNT - 1)
+        shell_printf(" <%6u: %u" VNA_SHELL_NEWLINE_STR, 1U << (i + PERF_HIST_START + 1), hist[i]);
+      else // last bin also count all bigger
+        shell_printf(">=%6u: %u" VNA_SHELL_NEWLINE_STR, 1U << (i + PERF_HIST_START), hist[i]);
+    }
+  shell_printf("dma latency: max %u transfers (%u cycles), transfer: %u cycles" VNA_SHELL_NEWLINE_STR,
+               latency_max, latency_max * PERF_TRANSFER_CYCLES, PERF_TRANSFER_CYCLES);
+  shell_printf("latency histogram (transfers):" VNA_SHELL_NEWLINE_STR);
+  for (int i = 0; i < PERF_LATENCY_COUNT; i++)
+    if (latency[i]) {
+      if (i == 0)
+        shell_printf("       0: %u" VNA_SHELL_NEWLINE_STR, latency[i]);
+      else if (i < PERF_LATENCY_COUNT - 1)
+        shell_printf(" %3u-%3u: %u" VNA_SHELL_NEWLINE_STR, 1U << (i - 1), (1U << i) - 1, latency[i]);
+      else
+        shell_printf("   >=%3u: %u" VNA_SHELL_NEWLINE_STR, 1U << (i - 1), latency[i]);
+    }
+}
+#endif
+
+#ifdef ENABLE_BOOTTIME_COMMAND
+VNA_SHELL_FUNCTION(cmd_boottime)
+{
+  (void)argc;
+  (void)argv;
+  static const char *stage[BOOT_STAGE_COUNT] = {"start", "settings", "si5351", "codec", "lcd", "sd card", "i2s", "sweep", "trace"};
+  shell_printf("clock: %u Hz" VNA_SHELL_NEWLINE_STR, STM32_SYSCLK);
+  for (int i = 1; i < BOOT_STAGE_COUNT; i++) {
+    if (boot_time[i] == 0) continue; // not reached
+    uint32_t cycles = boot_time[i] - boot_time[BOOT_START];
+    uint32_t us = cycles / (STM32_SYSCLK / 1000000);
+    shell_printf("%8s: %10u cycles %4u.%03u ms" VNA_SHELL_NEWLINE_STR, stage[i], cycles, us / 1000, us % 1000);
+  }
+}
+#endif
+
 #ifndef VERSION
 #define VERSION "unknown"
 #endif
@@ -2931,6 +4316,15 @@ static const VNAShellCommand commands[] =
     {"offset"      , cmd_offset      , CMD_WAIT_MUTEX|CMD_RUN_IN_UI|CMD_RUN_IN_LOAD},
 #endif
     {"bandwidth"   , cmd_bandwidth   , CMD_RUN_IN_LOAD},
+#ifdef USE_ADC_PROFILE
+    {"adc"         , cmd_adc         , CMD_WAIT_MUTEX|CMD_BREAK_SWEEP},
+#endif
+#ifdef __USE_DELAY_TUNE__
+    {"settle"      , cmd_settle      , CMD_WAIT_MUTEX|CMD_BREAK_SWEEP},
+#endif
+#ifdef __USE_AUTO_GAIN__
+    {"autogain"    , cmd_autogain    , CMD_WAIT_MUTEX|CMD_BREAK_SWEEP},
+#endif
 #ifdef __USE_RTC__
     {"time"        , cmd_time        , CMD_RUN_IN_UI},
 #endif
@@ -2953,6 +4347,12 @@ static const VNAShellCommand commands[] =
 #ifdef ENABLE_STAT_COMMAND
     {"stat"        , cmd_stat        , CMD_WAIT_MUTEX},
 #endif
+#ifdef ENABLE_PERF_COMMAND
+    {"perf"        , cmd_perf        , 0},
+#endif
+#ifdef ENABLE_BOOTTIME_COMMAND
+    {"boottime"    , cmd_boottime    , 0},
+#endif
 #ifdef ENABLE_GAIN_COMMAND
     {"gain"        , cmd_gain        , CMD_WAIT_MUTEX},
 #endif
@@ -2967,6 +4367,7 @@ static const VNAShellCommand commands[] =
     {"pause"       , cmd_pause       , CMD_WAIT_MUTEX|CMD_BREAK_SWEEP|CMD_RUN_IN_UI|CMD_RUN_IN_LOAD},
     {"resume"      , cmd_resume      , CMD_WAIT_MUTEX|CMD_BREAK_SWEEP|CMD_RUN_IN_UI|CMD_RUN_IN_LOAD},
     {"cal"         , cmd_cal         , CMD_WAIT_MUTEX},
+    {"calkit"      , cmd_calkit      , 0},
     {"save"        , cmd_save        , CMD_RUN_IN_LOAD},
     {"recall"      , cmd_recall      , CMD_WAIT_MUTEX|CMD_BREAK_SWEEP|CMD_RUN_IN_UI|CMD_RUN_IN_LOAD},
     {"trace"       , cmd_trace       , CMD_RUN_IN_LOAD},
@@ -2999,6 +4400,9 @@ static const VNAShellCommand commands[] =
 #endif
 #ifdef ENABLE_TRANSFORM_COMMAND
     {"transform"   , cmd_transform   , CMD_RUN_IN_LOAD},
+#endif
+#ifdef __S11_DTF_MEASURE__
+    {"dtf"         , cmd_dtf         , 0},
 #endif
     {"threshold"   , cmd_threshold   , CMD_RUN_IN_LOAD},
     {"help"        , cmd_help        , 0},
@@ -3349,6 +4753,8 @@ int main(void)
  */
   halInit();
   chSysInit();
+  BOOT_COUNTER_INIT();
+  BOOT_TIMESTAMP(BOOT_START);
 
 /*
  * Init used hardware
@@ -3359,6 +4765,13 @@ int main(void)
   rccEnableDMA1(false);
 //rccEnableDMA2(false);
 
+/*
+ *  Init CRC unit (used for check saved data)
+ */
+#ifdef __USE_HW_CRC__
+  crc32_init();
+#endif
+
 /*
  * Init GPIO (pin control)
  */
@@ -3382,8 +4795,10 @@ int main(void)
 
 /*
  * restore config and calibration 0 slot from flash memory, also if need use backup data
+ * (with __USE_FAST_RESUME__ flash journal state also restored from backup registers, without log scan)
  */
   load_settings();
+  BOOT_TIMESTAMP(BOOT_SETTINGS);
 
 /*
  * I2C bus
@@ -3398,28 +4813,32 @@ int main(void)
 /*
  * Set frequency offset
  */
+#ifdef USE_ADC_PROFILE
+  // Saved ADC profile not valid for saved IF, use default
+  if (!adc_profile_check(config._adc_profile, IF_OFFSET))
+    config._adc_profile = 0;
+#endif
 #ifdef USE_VARIABLE_OFFSET
   si5351_set_frequency_offset(IF_OFFSET);
 #endif
+  BOOT_TIMESTAMP(BOOT_SI5351);
+
 /*
- * Init Shell console connection data
+ * tlv320aic Initialize (audio codec), clocked from si5351
+ * Codec need time for start, init LCD and SD card in this time
  */
-  shell_init_connection();
+  tlv320aic3204_init();
+#ifdef USE_ADC_PROFILE
+  tlv320aic3204_set_adc_freq(ADC_FREQ);
+#endif
+  systime_t codec_ready = chVTGetSystemTimeX() + MS2ST(200);
+  BOOT_TIMESTAMP(BOOT_CODEC);
 
 /*
  * SPI bus and LCD Initialize
  */
   lcd_init();
-
-/*
- * tlv320aic Initialize (audio codec)
- */
-  tlv320aic3204_init();
-  chThdSleepMilliseconds(200); // Wait for aic codec start
-/*
- * I2S Initialize
- */
-  initI2S(rx_buffer, ARRAY_COUNT(rx_buffer) * sizeof(audio_sample_t) / sizeof(int16_t));
+  BOOT_TIMESTAMP(BOOT_LCD);
 
 /*
  * SD Card init (if inserted) allow fix issues
@@ -3428,6 +4847,21 @@ int main(void)
 #ifdef __USE_SD_CARD__
   disk_initialize(0);
 #endif
+  BOOT_TIMESTAMP(BOOT_SD_CARD);
+
+  // Wait for aic codec start
+  int32_t codec_wait = (int32_t)(codec_ready - chVTGetSystemTimeX());
+  if (codec_wait > 0)
+    chThdSleep(codec_wait);
+/*
+ * I2S Initialize
+ */
+#ifdef ENABLE_PERF_COMMAND
+  PERF_COUNTER_INIT();
+  perf_reset();
+#endif
+  initI2S(rx_buffer, 2 * ADC_BUFFER_LEN * sizeof(audio_sample_t) / sizeof(int16_t));
+  BOOT_TIMESTAMP(BOOT_I2S);
 
 /*
  * I2C bus run on work speed
@@ -3439,6 +4873,11 @@ int main(void)
  */
   chThdCreateStatic(waThread1, sizeof(waThread1), NORMALPRIO-1, Thread1, NULL);
 
+/*
+ * Init Shell console connection data (USB connect wait run while first sweep)
+ */
+  shell_init_connection();
+
   while (1) {
     if (shell_check_connect()) {
       shell_printf(VNA_SHELL_NEWLINE_STR "NanoVNA Shell" VNA_SHELL_NEWLINE_STR);
@@ -3473,8 +4912,12 @@ void hard_fault_handler_c(uint32_t *sp) __attribute__((naked));
 void HardFault_Handler(void)
 {
   uint32_t *sp;
+#ifdef __arm__
   //__asm volatile ("mrs %0, msp \n\t": "=r" (sp) );
   __asm volatile("mrs %0, psp \n\t" : "=r"(sp));
+#else
+  sp = 0; // Host build (test/)
+#endif
   hard_fault_handler_c(sp);
 }
 
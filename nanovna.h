@@ -49,6 +49,19 @@
 #define __USE_RTC__
 // Add RTC backup registers support
 #define __USE_BACKUP__
+// Store calibration data in flash slots as float16 (more save slots, see hardware.h)
+#define __USE_PACKED_CAL__
+// Save config and calibration as journal records in all save area (wear leveling, power loss safe), req __USE_PACKED_CAL__
+#define __USE_FLASH_JOURNAL__
+// Fast resume: journal state (records offset, write position) in RTC backup registers, boot without flash log scan
+// (F072 backup registers all used by __USE_BACKUP__), req __USE_BACKUP__ and __USE_FLASH_JOURNAL__
+#if defined(NANOVNA_F303)
+#define __USE_FAST_RESUME__
+#endif
+// Use CPU CRC unit for CRC-32 calculation (else used software table, can be forced by define __USE_SW_CRC__)
+#ifndef __USE_SW_CRC__
+#define __USE_HW_CRC__
+#endif
 // Add SD card support, req enable RTC (additional settings for file system see FatFS lib ffconf.h)
 #define __USE_SD_CARD__
 // If enabled serial in halconf.h, possible enable serial console control
@@ -67,10 +80,12 @@
 #define __VNA_USE_MATH_TABLES__
 // Use custom fast/compact approximation for some math functions in calculations (vna_ ...), use it carefully
 #define __USE_VNA_MATH__
-// Use cache for window function used by FFT (but need FFT_SIZE*sizeof(float) RAM)
-//#define USE_FFT_WINDOW_BUFFER
 // Enable data smooth option
 #define __USE_SMOOTH__
+// Time domain zoom: evaluate lowpass time response only on selected start/stop window with any step (chirp-Z)
+#define __USE_TD_ZOOM__
+// Time domain gating: remove selected time range reflections and show gated response in frequency domain
+#define __USE_TD_GATE__
 // Enable optional change digit separator for locales (dot or comma, need for correct work some external software)
 #define __DIGIT_SEPARATOR__
 // Use table for frequency list (if disabled use real time calc)
@@ -79,6 +94,16 @@
 #ifdef ARM_MATH_CM4
 #define __USE_DSP__
 #endif
+// Add CIC3 windowed integration option for IF filter (better spur rejection, allow narrow IF bandwidth)
+#define __USE_IF_FILTER__
+// Detect generator settle by reference phasor, start measure before fixed DELAY_* (delay used as timeout)
+#define __USE_SETTLE_DETECT__
+// Allow per unit tune generator settle delays (auto tune command, result saved in config)
+#define __USE_DELAY_TUNE__
+// Auto range sample channel codec PGA gain per point by previous sweep level (more S21 dynamic range)
+#define __USE_AUTO_GAIN__
+// Calibration average: N sweeps per standard (running mean and variance), stop on standard error threshold
+#define __USE_CAL_AVERAGE__
 // Add measure module option (allow made some measure calculations on data)
 #define __VNA_MEASURE_MODULE__
 // Add Z normalization feature
@@ -107,6 +132,8 @@
 #define __S11_CABLE_MEASURE__
 // Enable S11 resonance search option
 #define __S11_RESONANCE_MEASURE__
+// Enable S11 distance to fault option (reflection peaks in time domain)
+#define __S11_DTF_MEASURE__
 #endif
 
 /*
@@ -129,6 +156,9 @@
 // Use real time build table (undef for use constant, see comments)
 // Constant tables build only for AUDIO_SAMPLES_COUNT = 48
 #define USE_VARIABLE_OFFSET
+// Allow runtime select ADC sample rate and samples count (need real time build table)
+// AUDIO_ADC_FREQ_K and AUDIO_SAMPLES_COUNT used as default and max buffer size
+#define USE_ADC_PROFILE
 
 // Maximum sweep point count (limit by flash and RAM size)
 #define POINTS_COUNT             401
@@ -290,6 +320,9 @@ extern float measured[2][POINTS_COUNT][2];
 #define CALSTAT_EX CALSTAT_ISOLN
 #define CALSTAT_APPLY (1<<8)
 #define CALSTAT_INTERPOLATED (1<<9)
+#define CALSTAT_ENHANCED_RESPONSE (1<<10)
+// Thru data include load match (if enhanced on measure), enhanced mode can change only before thru measure
+#define CALSTAT_ENHANCED_LOCK (CALSTAT_THRU|CALSTAT_ET)
 
 #define ETERM_ED 0 /* error term directivity */
 #define ETERM_ES 1 /* error term source match */
@@ -297,11 +330,30 @@ extern float measured[2][POINTS_COUNT][2];
 #define ETERM_ET 3 /* error term transmission tracking */
 #define ETERM_EX 4 /* error term isolation */
 
+// Cal kit standards model (config._calkit), applied on cal done if open, short and load measured
+#define CALKIT_OPEN     0
+#define CALKIT_SHORT    1
+#define CALKIT_LOAD     2
+#define CALKIT_Z_SYS    50.0f
+typedef struct {
+  float c[4];      // Open capacitance C0 (1e-15 F), C1 (1e-27 F/Hz), C2 (1e-36 F/Hz^2), C3 (1e-45 F/Hz^3)
+  float l[4];      // Short inductance L0 (1e-12 H), L1 (1e-24 H/Hz), L2 (1e-33 H/Hz^2), L3 (1e-42 H/Hz^3)
+  float delay[3];  // Offset delay for open, short, load (ps)
+  float loss[3];   // Offset loss for open, short, load (GOhm/s)
+  float z0;        // Offset Z0 (Ohm)
+  float load_r;    // Load resistance (Ohm)
+  float load_l;    // Load series inductance (1e-12 H)
+} calkit_t;
+#define CALKIT_DEFAULT {.c = {0}, .l = {0}, .delay = {0}, .loss = {0}, .z0 = CALKIT_Z_SYS, .load_r = CALKIT_Z_SYS, .load_l = 0}
+
+// FFT size for time domain transform, can be set up to 2048 (need 2 * sizeof(float) * FFT_SIZE bytes in spi_buffer)
+#ifndef FFT_SIZE
 #if   POINTS_COUNT <= 256
 #define FFT_SIZE   256
 #elif POINTS_COUNT <= 512
 #define FFT_SIZE   512
 #endif
+#endif
 
 void cal_collect(uint16_t type);
 void cal_done(void);
@@ -398,6 +450,8 @@ extern const char *info_about[];
 #define DELAY_RESET_PLL_BEFORE            0    // 5    0 (0 for disabled)
 #define DELAY_RESET_PLL_AFTER          4000    // 6 4000 (0 for disabled)
 #endif
+// Tunable delays index (same as si5351 timings index), config values in us (0 - use default)
+enum {DELAY_TUNE_BAND_1_2 = 0, DELAY_TUNE_BAND_3_4, DELAY_TUNE_BANDCHANGE, DELAY_TUNE_CHANNEL_CHANGE, DELAY_TUNE_SWEEP_START, DELAY_TUNE_COUNT};
 
 /*
  * dsp.c
@@ -412,6 +466,40 @@ extern const char *info_about[];
 // Buffer contain left and right channel samples (need x2)
 #define AUDIO_BUFFER_LEN      (AUDIO_SAMPLES_COUNT*2)
 
+// Runtime used ADC sample rate and samples count (in buffer)
+#ifdef USE_ADC_PROFILE
+typedef struct {
+  uint32_t freq;
+  uint16_t samples;
+} adc_profile_t;
+#define ADC_PROFILE_COUNT     4
+extern const adc_profile_t adc_profiles[ADC_PROFILE_COUNT];
+#define ADC_FREQ              (adc_profiles[config._adc_profile].freq)
+#define ADC_SAMPLES_COUNT     (adc_profiles[config._adc_profile].samples)
+bool adc_profile_check(uint16_t profile, int32_t offset);
+void set_adc_profile(uint16_t profile);
+#else
+#define ADC_FREQ              AUDIO_ADC_FREQ
+#define ADC_SAMPLES_COUNT     AUDIO_SAMPLES_COUNT
+#endif
+#define ADC_BUFFER_LEN        (ADC_SAMPLES_COUNT*2)
+
+// Maximum measure count for one point (config._bandwidth value)
+#ifdef __USE_IF_FILTER__
+#define BANDWIDTH_COUNT_MAX   (4096 - 1)
+#else
+#define BANDWIDTH_COUNT_MAX   ( 512 - 1)
+#endif
+// IF filter types (config._if_filter value)
+enum {IF_FILTER_RECT = 0, IF_FILTER_CIC3};
+// Sample channel PGA auto gain (config._gain_cal size), step 6dB = 12 PGA register steps (0.5dB)
+#define AUTO_GAIN_STEPS       8
+#define AUTO_GAIN_REG_STEP   12
+#define AUTO_GAIN_REG_MAX    95
+// Default (nominal) step gain, 10^(6*n/20)
+#define AUTO_GAIN_NOMINAL    {{1.0f, 0.0f}, {1.99526f, 0.0f}, {3.98107f, 0.0f}, {7.94328f, 0.0f}, \
+                              {15.8489f, 0.0f}, {31.6228f, 0.0f}, {63.0957f, 0.0f}, {125.893f, 0.0f}}
+
 // Bandwidth depend from AUDIO_SAMPLES_COUNT and audio ADC frequency
 // for AUDIO_SAMPLES_COUNT = 48 and ADC =  48kHz one measure give  48000/48=1000Hz
 // for AUDIO_SAMPLES_COUNT = 48 and ADC =  96kHz one measure give  96000/48=2000Hz
@@ -460,6 +548,18 @@ void calculate_gamma(float *gamma);
 void fetch_amplitude(float *gamma);
 void fetch_amplitude_ref(float *gamma);
 void generate_DSP_Table(int offset);
+const int16_t *dsp_get_sincos_table(void);
+#ifdef __USE_SETTLE_DETECT__
+// Settled if reference phasor change between buffers less then 1/SETTLE_THRESHOLD of amplitude
+// for SETTLE_BUFFERS comparisons in row (need SETTLE_BUFFERS+1 buffers)
+#define SETTLE_THRESHOLD    512     // use power of 2 (integer compare in ISR, divide by square compiled as shift)
+#define SETTLE_BUFFERS        2
+void dsp_settle_reset(void);
+bool dsp_settle_check(audio_sample_t *capture, size_t length);
+#endif
+#ifdef __USE_AUTO_GAIN__
+float dsp_sample_level(void);
+#endif
 
 /*
  * tlv320aic3204.c
@@ -469,6 +569,7 @@ void tlv320aic3204_init(void);
 void tlv320aic3204_set_gain(uint8_t lgain, uint8_t rgain);
 void tlv320aic3204_select(uint8_t channel);
 void tlv320aic3204_write_reg(uint8_t page, uint8_t reg, uint8_t data);
+void tlv320aic3204_set_adc_freq(uint32_t freq);
 
 /*
  * vna_math.c
@@ -783,7 +884,7 @@ extern const uint8_t numfont16x22[];
 #define MAX_PALETTE     32
 
 // trace 
-#define MAX_TRACE_TYPE 30
+#define MAX_TRACE_TYPE 31
 enum trace_type {
   TRC_LOGMAG=0, TRC_PHASE, TRC_DELAY, TRC_SMITH, TRC_POLAR, TRC_LINEAR, TRC_SWR, TRC_REAL, TRC_IMAG,
   TRC_R, TRC_X, TRC_Z, TRC_ZPHASE,
@@ -793,7 +894,8 @@ enum trace_type {
   TRC_Q,
   TRC_Rser, TRC_Xser, TRC_Zser,
   TRC_Rsh, TRC_Xsh, TRC_Zsh,
-  TRC_Qs21
+  TRC_Qs21,
+  TRC_TDR
 };
 // Mask for define rectangular plot
 #define RECTANGULAR_GRID_MASK ((1<<TRC_LOGMAG)|(1<<TRC_PHASE)|(1<<TRC_DELAY)|(1<<TRC_LINEAR)|(1<<TRC_SWR)|(1<<TRC_REAL)|(1<<TRC_IMAG)\
@@ -804,7 +906,8 @@ enum trace_type {
                               |(1<<TRC_Q)\
                               |(1<<TRC_Rser)|(1<<TRC_Xser)|(1<<TRC_Zser)\
                               |(1<<TRC_Rsh)|(1<<TRC_Xsh)|(1<<TRC_Zsh)\
-                              |(1<<TRC_Qs21))
+                              |(1<<TRC_Qs21)\
+                              |(1<<TRC_TDR))
 
 #define ROUND_GRID_MASK ((1<<TRC_POLAR)|(1<<TRC_SMITH))
 
@@ -854,10 +957,12 @@ enum {LM_MARKER, LM_SEARCH, LM_FREQ_0, LM_FREQ_1, LM_EDELAY};
 #define TD_FUNC_LOWPASS_IMPULSE (0b01<<1)
 #define TD_FUNC_LOWPASS_STEP    (0b10<<1)
 // Time domain window
-#define TD_WINDOW               (0b11<<3)
-#define TD_WINDOW_NORMAL        (0b00<<3)
-#define TD_WINDOW_MINIMUM       (0b01<<3)
-#define TD_WINDOW_MAXIMUM       (0b10<<3)
+#define TD_WINDOW               (0b111<<3)
+#define TD_WINDOW_NORMAL        (0b000<<3)
+#define TD_WINDOW_MINIMUM       (0b001<<3)
+#define TD_WINDOW_MAXIMUM       (0b010<<3)
+#define TD_WINDOW_HANN          (0b011<<3)
+#define TD_WINDOW_BLACKMAN      (0b100<<3)
 // Sweep mode
 #define TD_START_STOP           (0<<0)
 #define TD_CENTER_SPAN          (1<<6)
@@ -867,6 +972,15 @@ enum {LM_MARKER, LM_SEARCH, LM_FREQ_0, LM_FREQ_1, LM_EDELAY};
 #define TD_MARKER_DELTA         (1<<8)
 // Marker delta
 //#define TD_MARKER_LOCK          (1<<9) // reserved
+// Time domain zoom on _td_start .. _td_stop window
+#define TD_ZOOM                 (1<<10)
+// Time domain gate on _gate_start .. _gate_stop in frequency domain
+#define TD_GATE                 (1<<11)
+// Time domain gate shape (edge taper width)
+#define TD_GATE_SHAPE           (0b11<<12)
+#define TD_GATE_NORMAL          (0b00<<12)
+#define TD_GATE_MINIMUM         (0b01<<12)
+#define TD_GATE_MAXIMUM         (0b10<<12)
 
 // config._mode flags
 // Auto name for files
@@ -907,6 +1021,9 @@ enum {
 #endif
 #ifdef __S11_RESONANCE_MEASURE__
   MEASURE_S11_RESONANCE,
+#endif
+#ifdef __S11_DTF_MEASURE__
+  MEASURE_S11_DTF,
 #endif
   MEASURE_END
 };
@@ -951,6 +1068,14 @@ typedef struct config {
   uint8_t  _lever_mode;
   uint8_t  _digit_separator;
   uint8_t  _band_mode;
+  uint8_t  _if_filter;
+  uint8_t  _adc_profile;
+  uint16_t _delay[DELAY_TUNE_COUNT];
+  uint8_t  _auto_gain;                          // usable auto gain steps count (0 - disabled)
+  float    _gain_cal[AUTO_GAIN_STEPS][2];       // sample channel gain for every step (complex, relative to step 0)
+  calkit_t _calkit;
+  float    _cal_stderr;                         // stop calibration average then standard error less (dB), 0 - disabled
+  uint16_t _cal_average;                        // calibration average sweeps count
   uint32_t checksum;
 } config_t;
 
@@ -979,6 +1104,10 @@ typedef struct properties {
   float    _var_delay;
   float    _s21_offset;
   float    _portz;
+  float    _td_start;            // time domain zoom window start (seconds)
+  float    _td_stop;             // time domain zoom window stop (seconds)
+  float    _gate_start;          // time domain gate start (seconds)
+  float    _gate_stop;           // time domain gate stop (seconds)
   float    _cal_data[CAL_TYPE_COUNT][POINTS_COUNT][2]; // Put at the end for faster access to others data from struct
   uint32_t checksum;
 } properties_t;
@@ -988,6 +1117,7 @@ extern properties_t current_props;
 
 void set_trace_type(int t, int type, int channel);
 void set_trace_channel(int t, int channel);
+void tdr_check_traces(void);
 void set_trace_scale(int t, float scale);
 void set_active_trace(int t);
 void set_trace_refpos(int t, float refpos);
@@ -1001,6 +1131,12 @@ void shell_reset_console(void);
 
 void set_electrical_delay(float seconds);
 void set_s21_offset(float offset);
+#ifdef __USE_TD_ZOOM__
+bool get_td_zoom(float *start, float *step);
+#endif
+#ifdef __USE_TD_GATE__
+bool set_gate_from_markers(void);
+#endif
 float groupdelay_from_array(int i, const float *v);
 
 void plot_init(void);
@@ -1014,7 +1150,17 @@ void draw_all(void);
 void set_area_size(uint16_t w, uint16_t h);
 void plot_set_measure_mode(uint8_t mode);
 uint16_t plot_get_measure_channels(void);
+#ifdef __S11_DTF_MEASURE__
+// Distance to fault max peaks count
+#define MEASURE_DTF_COUNT   6
+typedef struct {
+  float distance;  // in m (use velocity factor)
+  float rl;        // return loss in dB
+} dtf_peak_t;
+int measure_dtf_peaks(dtf_peak_t *peak, int count);
+#endif
 
+float time_of_index(int idx);
 int distance_to_index(int8_t t, uint16_t idx, int16_t x, int16_t y);
 int search_nearest_index(int x, int y, int t);
 
@@ -1253,8 +1399,14 @@ void testLog(void);        // debug log
 /*
  * flash.c
  */
-#define CONFIG_MAGIC 0x434f4e55 // Config magic value (allow reset on new config version)
-#define PROPS_MAGIC  0x434f4e52 // Properties magic value (allow reset on new properties version)
+#define CONFIG_MAGIC 0x434f4e5a // Config magic value (allow reset on new config version)
+#define PROPS_MAGIC  0x434f4e54 // Properties magic value (allow reset on new properties version)
+#ifdef __USE_PACKED_CAL__
+#define PROPS_PACKED_MAGIC  0x434f4e52 // Packed properties magic value (flash slot format)
+// Flash slot: properties_t header (all before _cal_data), cal data as float16, checksum
+#define PROPS_HEADER_SIZE   offsetof(properties_t, _cal_data)
+#define PROPS_PACKED_SIZE   (PROPS_HEADER_SIZE + CAL_TYPE_COUNT * POINTS_COUNT * 2 * sizeof(uint16_t) + sizeof(uint32_t))
+#endif
 
 #define NO_SAVE_SLOT      ((uint16_t)(-1))
 extern uint16_t lastsaveid;
@@ -1272,6 +1424,10 @@ extern uint16_t lastsaveid;
 #define electrical_delay    current_props._electrical_delay
 #define s21_offset          current_props._s21_offset
 #define velocity_factor     current_props._velocity_factor
+#define td_start            current_props._td_start
+#define td_stop             current_props._td_stop
+#define gate_start          current_props._gate_start
+#define gate_stop           current_props._gate_stop
 #define trace               current_props._trace
 #define current_trace       current_props._current_trace
 #define markers             current_props._markers
@@ -1281,6 +1437,8 @@ extern uint16_t lastsaveid;
 #define props_mode          current_props._mode
 #define domain_window      (props_mode&TD_WINDOW)
 #define domain_func        (props_mode&TD_FUNC)
+// TDR Z trace use S11 lowpass step response, available only for S11 in this time domain mode
+#define TDR_AVAILABLE(ch)  ((ch) == 0 && (props_mode&(DOMAIN_TIME|TD_FUNC)) == (DOMAIN_TIME|TD_FUNC_LOWPASS_STEP))
 
 #define FREQ_STARTSTOP()       {props_mode&=~TD_CENTER_SPAN;}
 #define FREQ_CENTERSPAN()      {props_mode|= TD_CENTER_SPAN;}
@@ -1317,6 +1475,11 @@ int caldata_save(uint32_t id);
 int caldata_recall(uint32_t id);
 const properties_t *caldata_reference(void);
 const properties_t *get_properties(uint32_t id);
+// Calibration data access (in place from flash slot after recall), need call caldata_unref before modify cal_data
+void caldata_point(uint16_t type, uint16_t idx, float v[2]);
+void caldata_unref(void);
+// Drop slot reference without copy, use before overwrite current_props (reset or load from other source)
+void caldata_reset(void);
 
 int config_save(void);
 int config_recall(void);
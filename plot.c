@@ -546,6 +546,17 @@ static float s21_qualityfactor(int i, const float *v) {
   return vna_fabsf(v[1] / (v[0] - get_l(v[0], v[1])));
 }
 
+//**************************************************************************************
+// TDR impedance profile, use lowpass step response (real part is reflection coefficient at time)
+// Z(t) = z0 * (1 + step(t)) / (1 - step(t))
+//**************************************************************************************
+static float tdr_impedance(int i, const float *v) {
+  (void) i;
+  float d = 1.0f - v[0];
+  if (d < 1e-6f) d = 1e-6f; // open
+  return PORT_Z * (1.0f + v[0]) / d;
+}
+
 //**************************************************************************************
 // Group delay
 //**************************************************************************************
@@ -568,7 +579,7 @@ cartesian_scale(const float *v, int16_t *xp, int16_t *yp, float scale) {
   *yp = y;
 }
 
-#if MAX_TRACE_TYPE != 30
+#if MAX_TRACE_TYPE != 31
 #error "Redefined trace_type list, need check format_list"
 #endif
 
@@ -604,6 +615,7 @@ const trace_info_t trace_info_list[MAX_TRACE_TYPE] = {
 [TRC_Xsh]    = {"Xsh",    "%.3F%s", S_DELTA "%.3F%s", S_OHM,    NGRIDY/2, 100.0f, s21shunt_x           },
 [TRC_Zsh]    = {"|Zsh|",  "%.3F%s", S_DELTA "%.3F%s", S_OHM,    NGRIDY/2, 100.0f, s21shunt_z           },
 [TRC_Qs21]   = {"Q",      "%.4f%s", S_DELTA "%.3f%s", "",              0,  10.0f, s21_qualityfactor    },
+[TRC_TDR]    = {"TDR Z",  "%.3F%s", S_DELTA "%.3F%s", S_OHM,           0,  25.0f, tdr_impedance        },
 };
 
 const marker_info_t marker_info_list[MS_END] = {
@@ -757,10 +769,15 @@ trace_print_info(int xpos, int ypos, int t)
   return cell_printf(xpos, ypos, format, get_trace_typename(type, smith), scale, v);
 }
 
-static float time_of_index(int idx)
+float time_of_index(int idx)
 {
   freq_t span = get_sweep_frequency(ST_SPAN);
-  return (idx * (sweep_points-1)) / ((float)FFT_SIZE * span);
+  float t = idx;
+#ifdef __USE_TD_ZOOM__
+  float start, step;
+  if (get_td_zoom(&start, &step)) t = start + t * step;
+#endif
+  return (t * (sweep_points-1)) / ((float)FFT_SIZE * span);
 }
 
 static float distance_of_index(int idx) {
@@ -1094,6 +1111,9 @@ static const struct {
 #ifdef __S11_RESONANCE_MEASURE__
   [MEASURE_S11_RESONANCE]= {MESAURE_S11, MEASURE_UPD_ALL,  draw_s11_resonance, prepare_s11_resonance},
 #endif
+#ifdef __S11_DTF_MEASURE__
+  [MEASURE_S11_DTF]     = {MESAURE_S11, MEASURE_UPD_SWEEP,       draw_s11_dtf, prepare_s11_dtf  },
+#endif
 };
 
 static inline void measure_set_flag(uint8_t flag) {
@@ -1752,7 +1772,7 @@ draw_frequencies(void)
       lcd_printf(FREQUENCIES_XPOS2, FREQUENCIES_YPOS, "%c%s %15q" S_Hz, lm1,  "SPAN", get_sweep_frequency(ST_SPAN));
     }
   } else {
-    lcd_printf(FREQUENCIES_XPOS1, FREQUENCIES_YPOS, "START 0" S_SECOND "    VF = %d%%", velocity_factor);
+    lcd_printf(FREQUENCIES_XPOS1, FREQUENCIES_YPOS, "START %F" S_SECOND "    VF = %d%%", time_of_index(0), velocity_factor);
     lcd_printf(FREQUENCIES_XPOS2, FREQUENCIES_YPOS, "STOP %F" S_SECOND " (%F" S_METRE ")", time_of_index(sweep_points-1), distance_of_index(sweep_points-1));
   }
   // Draw bandwidth and point count
@@ -1792,7 +1812,8 @@ draw_cal_status(void)
     {'S', 0, CALSTAT_ES},
     {'T', 0, CALSTAT_ET},
     {'t', 0, CALSTAT_THRU},
-    {'X', 0, CALSTAT_EX}
+    {'X', 0, CALSTAT_EX},
+    {'E', 0, CALSTAT_ENHANCED_RESPONSE}
   };
   for (i = 0; i < ARRAY_COUNT(calibration_text); i++)
     if (cal_status & calibration_text[i].mask)
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# Measure i2s DMA interrupt (dsp_process) cycles on device for all
+# bandwidths, need firmware build with ENABLE_PERF_COMMAND ('perf' command).
+#
+# For every bandwidth: 'perf reset', run sweep ('scan' command), read 'perf'
+# and check interrupt not overrun: busy max less then nominal DMA half
+# transfer interval and no lost interrupts (interval max < 1.5 * nominal).
+#
+import re
+
+# Bandwidth list in Hz, exist bandwidth depend from ADC frequency and samples count
+BANDWIDTHS = [8000, 4000, 2000, 1000, 333, 100, 30, 10]
+
+def parse_perf(text):
+    r = {}
+    m = re.search(r'clock: (\d+) Hz, nominal interval: (\d+)', text)
+    if not m:
+        raise ValueError("no perf data, need firmware with ENABLE_PERF_COMMAND:\n" + text)
+    r['clock'], r['nominal'] = int(m.group(1)), int(m.group(2))
+    for name in ('busy', 'interval'):
+        m = re.search(name + r' cycle: +min (\d+) ave (\d+) max (\d+)', text)
+        r[name] = [int(v) for v in m.groups()]
+    m = re.search(r'callback count: (\d+), processed: (\d+)', text)
+    r['count'], r['processed'] = int(m.group(1)), int(m.group(2))
+    return r
+
+def measure(nv, bw, start, stop, points):
+    nv.send_command("bandwidth %d hz\r" % bw)
+    result = nv.fetch_data()
+    nv.send_command("perf reset\r")
+    nv.fetch_data()
+    nv.send_command("scan %d %d %d\r" % (start, stop, points))
+    nv.fetch_data()
+    nv.send_command("perf\r")
+    return result.strip(), parse_perf(nv.fetch_data())
+
+def check(r):
+    nominal = r['nominal']
+    return r['busy'][2] < nominal and r['interval'][2] < nominal * 3 // 2
+
+if __name__ == '__main__':
+    import sys
+    from optparse import OptionParser
+    parser = OptionParser(usage="%prog: [options]")
+    parser.add_option("-d", "--dev", dest="device",
+                      help="device node", metavar="DEV")
+    parser.add_option("-S", "--start", dest="start", type="float", default=1e6,
+                      help="start frequency", metavar="START")
+    parser.add_option("-E", "--stop", dest="stop", type="float", default=900e6,
+                      help="stop frequency", metavar="STOP")
+    parser.add_option("-N", "--points", dest="points", type="int", default=101,
+                      help="scan points", metavar="POINTS")
+    parser.add_option("-b", "--bandwidth", dest="bandwidth", type="int", action="append",
+                      help="bandwidth Hz (can repeat, default all)", metavar="HZ")
+    (opt, args) = parser.parse_args()
+    from nanovna import NanoVNA, getport
+    nv = NanoVNA(opt.device or getport())
+    nv.pause()
+    fail = 0
+    print("%-28s %8s %8s %8s %8s %8s %6s" % ("bandwidth", "nominal", "busy min", "ave", "max", "int max", "load"))
+    for bw in opt.bandwidth or BANDWIDTHS:
+        name, r = measure(nv, bw, int(opt.start), int(opt.stop), opt.points)
+        ok = check(r)
+        fail += not ok
+        print("%-28s %8d %8d %8d %8d %8d %5.1f%% %s" % (name, r['nominal'], r['busy'][0], r['busy'][1], r['busy'][2],
+              r['interval'][2], 100.0 * r['busy'][1] / r['nominal'], "ok" if ok else "OVERRUN"))
+    nv.resume()
+    sys.exit(1 if fail else 0)
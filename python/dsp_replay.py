@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+#
+# Record raw I2S buffers from NanoVNA ('dump 2' command) for host replay
+# through firmware dsp.c (see test/test_dsp.c, run 'make -C test').
+#
+# Writes one text file per frequency (PREFIX_FREQ.dump):
+#   kernel: m0 (F072 integer kernel) or m4 (F303 DSP kernel)
+#   freq:   capture frequency, Hz
+#   if:     IF offset, Hz
+#   followed by 'dump 2' output: samples, 'table:' device sin/cos table,
+#   device gamma, ampl and ref on this samples (golden data)
+#
+
+def record(nv, prefix, freqs, kernel, offset):
+    nv.pause()
+    if offset:
+        nv.send_command("offset %d\r" % offset)
+        nv.fetch_data()
+    for f in freqs:
+        if f:
+            nv.set_frequency(f)
+        nv.send_command("dump 2\r")
+        text = nv.fetch_data()
+        if 'table:' not in text or 'gamma:' not in text:
+            raise ValueError("dump output not have golden data, need 'dump 2' command support")
+        name = "%s_%d.dump" % (prefix, f)
+        with open(name, 'w') as out:
+            out.write("kernel: %s\nfreq: %d\nif: %d\n" % (kernel, f, offset or 12000))
+            out.write(text)
+        print("recorded %s" % name)
+    nv.resume()
+
+if __name__ == '__main__':
+    from optparse import OptionParser
+    parser = OptionParser(usage="%prog: [options] PREFIX")
+    parser.add_option("-d", "--dev", dest="device",
+                      help="device node", metavar="DEV")
+    parser.add_option("-f", "--freq", dest="freq", type="float", action="append",
+                      help="capture frequency (can repeat)", metavar="FREQ")
+    parser.add_option("-i", "--if", dest="offset", type="int", default=0,
+                      help="set IF offset (F303 only, default 12000)", metavar="HZ")
+    parser.add_option("-k", "--kernel", dest="kernel", default="m0",
+                      help="device dsp kernel: m0 (F072) or m4 (F303)", metavar="KERNEL")
+    (opt, args) = parser.parse_args()
+    if len(args) != 1 or opt.kernel not in ('m0', 'm4'):
+        parser.print_help()
+        exit(1)
+    from nanovna import NanoVNA, getport
+    nv = NanoVNA(opt.device or getport())
+    record(nv, args[0], [int(f) for f in (opt.freq or [0])], opt.kernel, opt.offset)
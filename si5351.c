@@ -44,18 +44,25 @@ static void si5351_reset_cache(void){
   current_freq = 0;
 }
 
-#ifdef ENABLE_SI5351_TIMINGS
-// For debug
-uint16_t timings[8]={
-  DELAY_BAND_1_2,          // 0
-  DELAY_BAND_3_4,          // 1
-  DELAY_BANDCHANGE,        // 2
-  DELAY_CHANNEL_CHANGE,    // 3
-  DELAY_SWEEP_START,       // 4
-  DELAY_RESET_PLL_BEFORE,  // 5
-  DELAY_RESET_PLL_AFTER,   // 6
-};
+#if defined(ENABLE_SI5351_TIMINGS) || defined(__USE_DELAY_TUNE__)
+// For debug or per unit tuned delays
+#define TIMINGS_DEFAULT {  \
+  DELAY_BAND_1_2,          /* 0 */ \
+  DELAY_BAND_3_4,          /* 1 */ \
+  DELAY_BANDCHANGE,        /* 2 */ \
+  DELAY_CHANNEL_CHANGE,    /* 3 */ \
+  DELAY_SWEEP_START,       /* 4 */ \
+  DELAY_RESET_PLL_BEFORE,  /* 5 */ \
+  DELAY_RESET_PLL_AFTER,   /* 6 */ \
+}
+static const uint16_t timings_default[8] = TIMINGS_DEFAULT;
+uint16_t timings[8] = TIMINGS_DEFAULT;
 inline void si5351_set_timing(int i, int v) {timings[i]=US2ST(v);}
+// Set tuned delays from list (in us), zero value restore default
+void si5351_update_timings(const uint16_t *delay) {
+  for (int i = 0; i < DELAY_TUNE_COUNT; i++)
+    timings[i] = delay[i] ? US2ST(delay[i]) : timings_default[i];
+}
 #undef DELAY_BAND_1_2
 #undef DELAY_BAND_3_4
 #undef DELAY_BANDCHANGE
@@ -82,8 +89,15 @@ uint32_t si5351_get_frequency(void)
 void si5351_set_frequency_offset(int32_t offset)
 {
   si5351_reset_cache();
-  generate_DSP_Table(offset);
   IF_OFFSET = offset;
+#ifdef USE_ADC_PROFILE
+  // Current ADC profile not valid for new IF, switch to default (also generate table)
+  if (config._adc_profile != 0 && !adc_profile_check(config._adc_profile, offset)) {
+    set_adc_profile(0);
+    return;
+  }
+#endif
+  generate_DSP_Table(offset);
 }
 #endif
 
@@ -156,6 +170,9 @@ si5351_init(void)
     p += len;
   }
   si5351_set_band_mode(config._band_mode);
+#ifdef __USE_DELAY_TUNE__
+  si5351_update_timings(config._delay);
+#endif
   // Set any (let it be XTALFREQ) frequency for AIC can run
   si5351_set_frequency(XTALFREQ, 0);
 }
@@ -491,14 +508,22 @@ CONST_BAND band_strategy_t band_strategy_36H_MS5351[] = {
   {           11, SI5351_FIXED_MULT,{ 4},11,13, SI5351_CLK_DRIVE_STRENGTH_8MA, SI5351_CLK_DRIVE_STRENGTH_8MA, 95, 95, 11*12*4}  // 10};
 };
 
+static uint16_t band_count;   // bands in current table
 void si5351_set_band_mode(uint16_t t) {
 #if defined(NANOVNA_F303)
   band_s = t ? band_strategy_36H_MS5351 : band_strategy_H4_SI5351; // !!!! no test MS5351 on H4 board
+  band_count = t ? ARRAY_COUNT(band_strategy_36H_MS5351) : ARRAY_COUNT(band_strategy_H4_SI5351);
 #else
   band_s = t ? band_strategy_36H_MS5351 : band_strategy_33H_SI5351;
+  band_count = t ? ARRAY_COUNT(band_strategy_36H_MS5351) : ARRAY_COUNT(band_strategy_33H_SI5351);
 #endif
 }
 
+// Return current band codec gain (l_gain | r_gain << 8)
+uint16_t si5351_get_gain(void) {
+  return band_s[current_band].l_gain | (band_s[current_band].r_gain << 8);
+}
+
 uint32_t
 si5351_get_harmonic_lvl(uint32_t freq){
   uint16_t i;
@@ -510,6 +535,18 @@ si5351_get_harmonic_lvl(uint32_t freq){
   return i;
 }
 
+#ifdef __USE_DELAY_TUNE__
+// Return band upper frequency (harmonic bands depend from threshold, last band not limited)
+// and delay index used for step inside band
+uint32_t
+si5351_get_band_limit(uint16_t band, uint8_t *delay_idx){
+  uint32_t f = band_s[band].freq; if (f < 20) f*=config._harmonic_freq_threshold;
+  if (band >= band_count - 1) f = 0xFFFFFFFFU;
+  *delay_idx = band_s[band].mode == SI5351_FIXED_PLL ? DELAY_TUNE_BAND_1_2 : DELAY_TUNE_BAND_3_4;
+  return f;
+}
+#endif
+
 /*
  * Maximum supported frequency = FREQ_HARMONICS * 9U
  * configure output as follows:
@@ -80,6 +80,7 @@ void si5351_set_frequency_offset(int32_t offset);
 int  si5351_set_frequency(uint32_t freq, uint8_t drive_strength);
 void si5351_set_power(uint8_t drive_strength);
 void si5351_set_band_mode(uint16_t t);
+void si5351_update_timings(const uint16_t *delay);
 
 // Defug use functions
 void si5351_bulk_write(const uint8_t *buf, int len);
@@ -90,3 +91,5 @@ void si5351_set_tcxo(uint32_t xtal);
 // Get info functions
 uint32_t si5351_get_frequency(void);
 uint32_t si5351_get_harmonic_lvl(uint32_t f);
+uint16_t si5351_get_gain(void);
+uint32_t si5351_get_band_limit(uint16_t band, uint8_t *delay_idx);
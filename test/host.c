@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Host replacement for ChibiOS, board drivers and LCD/si5351/tlv320 drivers
+ * All hardware functions do nothing, only flash emulated (CRC unit model in test_crc.c)
+ */
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "ch.h"
+#include "hal.h"
+#include "usbcfg.h"
+#include "si5351.h"
+#include "nanovna.h"
+#include "host.h"
+
+/*
+ * Peripherals
+ */
+RCC_TypeDef  host_rcc;
+GPIO_TypeDef host_gpio[4];
+TIM_TypeDef  host_tim[4];
+RTC_TypeDef  host_rtc;
+DWT_Type     host_dwt;
+CoreDebug_Type host_core_debug;
+DMA_Channel_TypeDef host_dma[7];
+
+/*
+ * Console streams, output to stdout
+ */
+static size_t host_write(void *ip, const uint8_t *bp, size_t n) {(void)ip; return fwrite(bp, 1, n, stdout);}
+static size_t host_read(void *ip, uint8_t *bp, size_t n) {(void)ip; (void)bp; (void)n; return 0;}
+static msg_t host_put(void *ip, uint8_t b) {(void)ip; putchar(b); return MSG_OK;}
+static msg_t host_get(void *ip) {(void)ip; return MSG_TIMEOUT;}
+static const struct BaseSequentialStreamVMT host_vmt = {host_write, host_read, host_put, host_get};
+
+static USBDriver host_usb = {USB_ACTIVE};
+USBDriver USBD1 = {USB_ACTIVE};
+SerialDriver SD1 = {&host_vmt, {0}, {0}};
+const USBConfig usbcfg;
+SerialUSBConfig serusbcfg = {&host_usb, 1, 2, 3};
+SerialUSBDriver SDU1 = {&host_vmt, &serusbcfg, {0}, {0}};
+
+/*
+ * ChibiOS
+ */
+static systime_t host_time;
+void chSysInit(void) {}
+void halInit(void) {}
+systime_t chVTGetSystemTimeX(void) {return host_time++;}
+systime_t chVTGetSystemTime(void) {return host_time++;}
+void chThdSleep(systime_t time) {host_time+= time;}
+void chThdSleepMilliseconds(uint32_t ms) {host_time+= MS2ST(ms);}
+void chThdSleepMicroseconds(uint32_t us) {host_time+= US2ST(us);}
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg) {(void)wsp; (void)size; (void)prio; (void)pf; (void)arg; return NULL;}
+void chRegSetThreadName(const char *name) {(void)name;}
+void chMtxObjectInit(mutex_t *mp) {(void)mp;}
+void chMtxLock(mutex_t *mp) {(void)mp;}
+void chMtxUnlock(mutex_t *mp) {(void)mp;}
+void osalThreadQueueObjectInit(threads_queue_t *tqp) {(void)tqp;}
+msg_t osalThreadEnqueueTimeoutS(threads_queue_t *tqp, systime_t time) {(void)tqp; (void)time; return MSG_TIMEOUT;}
+void osalThreadDequeueNextI(threads_queue_t *tqp, msg_t msg) {(void)tqp; (void)msg;}
+void NVIC_SystemReset(void) {exit(1);}
+void (*host_irq)(void);
+void host_wfi(void) {if (host_irq) host_irq(); else host_time++;}
+void usbStart(USBDriver *usbp, const USBConfig *config) {(void)usbp; (void)config;}
+void usbConnectBus(USBDriver *usbp) {(void)usbp;}
+void usbDisconnectBus(USBDriver *usbp) {(void)usbp;}
+void sduObjectInit(SerialUSBDriver *sdup) {(void)sdup;}
+void sduStart(SerialUSBDriver *sdup, const SerialUSBConfig *config) {(void)sdup; (void)config;}
+void sduDisconnectI(SerialUSBDriver *sdup) {(void)sdup;}
+void sduConfigureHookI(SerialUSBDriver *sdup) {(void)sdup;}
+void sdStart(SerialDriver *sdp, const SerialConfig *config) {(void)sdp; (void)config;}
+void sdSetBaudrate(SerialDriver *sdp, uint32_t speed) {(void)sdp; (void)speed;}
+size_t sdWriteTimeout(SerialDriver *sdp, const uint8_t *bp, size_t n, systime_t time) {(void)sdp; (void)bp; (void)time; return n;}
+size_t sdReadTimeout(SerialDriver *sdp, uint8_t *bp, size_t n, systime_t time) {(void)sdp; (void)bp; (void)n; (void)time; return 0;}
+void qResetI(io_queue_t *qp) {(void)qp;}
+void rccEnableDMA1(bool lp) {(void)lp;}
+void rccEnableAHB(uint32_t mask, bool lp) {(void)mask; (void)lp;}
+
+/*
+ * Board drivers
+ */
+void initPal(void) {}
+void palSetPadMode(GPIO_TypeDef *port, int bit, uint32_t mode) {(void)port; (void)bit; (void)mode;}
+void initI2S(void *buffer, uint16_t count) {(void)buffer; (void)count;}
+void i2c_start(void) {}
+void i2c_set_timings(uint32_t timings) {(void)timings;}
+void adc_init(void) {}
+uint16_t adc_single_read(uint32_t chsel) {(void)chsel; return 0;}
+void adc_start_analog_watchdog(void) {}
+void adc_stop_analog_watchdog(void) {}
+int16_t adc_vbat_read(void) {return 0;}
+void dac_init(void) {}
+void dac_setvalue_ch2(uint16_t v) {(void)v;}
+void extStart(void) {}
+void ext_channel_enable(uint16_t channel, uint16_t mode) {(void)channel; (void)mode;}
+void initTimers(void) {}
+void startTimer(TIM_TypeDef *timer, uint32_t period) {(void)timer; (void)period;}
+void rtc_init(void) {}
+uint32_t rtc_get_tr_bin(void) {return 0;}
+uint32_t rtc_get_dr_bin(void) {return 0;}
+uint32_t rtc_get_FAT(void) {return 0;}
+void rtc_set_time(uint32_t dr, uint32_t tr) {(void)dr; (void)tr;}
+
+/*
+ * Flash
+ */
+uint32_t host_flash_writes;
+uint32_t host_flash_erases;
+uint32_t host_flash_errors;
+int32_t  host_flash_countdown = -1;
+jmp_buf  host_power_loss;
+
+static void host_flash_power_check(void (*torn)(void *p), void *p)
+{
+  if (host_flash_countdown < 0 || host_flash_countdown-- > 0) return;
+  if (torn) torn(p);
+  longjmp(host_power_loss, 1);
+}
+
+static void torn_erase(void *p) {memset(p, 0xFF, FLASH_PAGESIZE / 2);}
+
+void flash_erase_pages(uint32_t page_address, uint32_t size)
+{
+  size+= page_address;
+  for (; page_address < size; page_address+= FLASH_PAGESIZE) {
+    host_flash_power_check(torn_erase, (void *)(uintptr_t)page_address);
+    memset((void *)(uintptr_t)page_address, 0xFF, FLASH_PAGESIZE);
+    host_flash_erases++;
+  }
+}
+
+void flash_program_half_word(uint16_t *dst, uint16_t data)
+{
+  host_flash_power_check(NULL, NULL);
+  // On STM32 program not erased half word set PGERR (write 0 allowed)
+  if (*dst != 0xFFFF && data != 0) {host_flash_errors++; return;}
+  *dst = data;
+  host_flash_writes++;
+}
+
+void flash_program_half_word_buffer(uint16_t *dst, uint16_t *data, uint16_t size)
+{
+  flash_erase_pages((uint32_t)(uintptr_t)dst, size);
+  for (uint32_t i = 0; i < size / sizeof(uint16_t); i++)
+    flash_program_half_word(&dst[i], data[i]);
+}
+
+void host_flash_erase_all(void)
+{
+  memset((void *)FLASH_START_ADDRESS, 0xFF, FLASH_TOTAL_SIZE);
+}
+
+// Map flash before main()
+__attribute__((constructor)) static void host_flash_map(void)
+{
+  void *p = mmap((void *)FLASH_START_ADDRESS, FLASH_TOTAL_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (p != (void *)FLASH_START_ADDRESS) {
+    fprintf(stderr, "Can't map flash on 0x%08X\n", FLASH_START_ADDRESS);
+    exit(2);
+  }
+  host_flash_erase_all();
+}
+
+/*
+ * Generator and codec
+ */
+uint16_t timings[8];
+void si5351_init(void) {}
+void si5351_set_frequency_offset(int32_t offset) {(void)offset;}
+// Band codec gain on set frequency as si5351.c (codec gain updated on band gain change)
+uint16_t (*host_band_gain)(uint32_t freq);
+static uint16_t host_gain;
+int  si5351_set_frequency(uint32_t freq, uint8_t drive_strength)
+{
+  (void)drive_strength;
+  uint16_t g = host_band_gain ? host_band_gain(freq) : 0;
+  if (g != host_gain) tlv320aic3204_set_gain(g & 0xFF, g >> 8);
+  host_gain = g;
+  return 0;
+}
+void si5351_set_power(uint8_t drive_strength) {(void)drive_strength;}
+void si5351_set_band_mode(uint16_t t) {(void)t;}
+void si5351_update_timings(const uint16_t *delay) {(void)delay;}
+void si5351_set_tcxo(uint32_t xtal) {(void)xtal;}
+uint32_t si5351_get_harmonic_lvl(uint32_t f) {(void)f; return 0;}
+uint16_t si5351_get_gain(void) {return host_gain;}
+uint32_t si5351_get_band_limit(uint16_t band, uint8_t *delay_idx) {*delay_idx = 0; return band ? 0xFFFFFFFFU : 0;}
+void tlv320aic3204_init(void) {}
+uint8_t host_codec_gain[2];
+void tlv320aic3204_set_gain(uint8_t lgain, uint8_t rgain) {host_codec_gain[0] = lgain; host_codec_gain[1] = rgain;}
+void tlv320aic3204_select(uint8_t channel) {(void)channel;}
+void tlv320aic3204_set_adc_freq(uint32_t freq) {(void)freq;}
+
+/*
+ * LCD
+ */
+pixel_t spi_buffer[SPI_BUFFER_SIZE];
+pixel_t foreground_color;
+pixel_t background_color;
+void lcd_init(void) {}
+void lcd_fill(int x, int y, int w, int h) {(void)x; (void)y; (void)w; (void)h;}
+void lcd_bulk_continue(int x, int y, int w, int h) {(void)x; (void)y; (void)w; (void)h;}
+void lcd_bulk_finish(void) {}
+#ifndef lcd_set_font
+void lcd_set_font(int type) {(void)type;}
+#endif
+#ifndef lcd_get_cell_buffer
+pixel_t *lcd_get_cell_buffer(void) {return spi_buffer;}
+#endif
+void lcd_set_foreground(uint16_t fg_idx) {(void)fg_idx;}
+void lcd_set_background(uint16_t bg_idx) {(void)bg_idx;}
+void lcd_clear_screen(void) {}
+void lcd_blitBitmap(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t *bitmap) {(void)x; (void)y; (void)width; (void)height; (void)bitmap;}
+int  lcd_printf(int16_t x, int16_t y, const char *fmt, ...) {(void)x; (void)y; (void)fmt; return 0;}
+int  lcd_drawchar_size(uint8_t ch, int x, int y, uint8_t size) {(void)ch; (void)x; (void)y; (void)size; return 0;}
+void lcd_drawstring_size(const char *str, int x, int y, uint8_t size) {(void)str; (void)x; (void)y; (void)size;}
+void lcd_drawfont(uint8_t ch, int x, int y) {(void)ch; (void)x; (void)y;}
+void lcd_read_memory(int x, int y, int w, int h, uint16_t *out) {(void)x; (void)y; memset(out, 0, w * h * sizeof(uint16_t));}
+void lcd_line(int x0, int y0, int x1, int y1) {(void)x0; (void)y0; (void)x1; (void)y1;}
+void lcd_set_flip(bool flip) {(void)flip;}
+
+/*
+ * SD card
+ */
+DSTATUS disk_initialize(BYTE pdrv) {(void)pdrv; return STA_NOINIT;}
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt) {(void)fs; (void)path; (void)opt; return FR_NOT_READY;}
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode) {(void)fp; (void)path; (void)mode; return FR_NOT_READY;}
+FRESULT f_close(FIL *fp) {(void)fp; return FR_OK;}
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br) {(void)fp; (void)buff; (void)btr; *br = 0; return FR_NOT_READY;}
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw) {(void)fp; (void)buff; (void)btw; *bw = 0; return FR_NOT_READY;}
+FRESULT f_closedir(DIR *dp) {(void)dp; return FR_OK;}
+FRESULT f_findfirst(DIR *dp, FILINFO *fno, const TCHAR *path, const TCHAR *pattern) {(void)dp; (void)fno; (void)path; (void)pattern; return FR_NOT_READY;}
+FRESULT f_findnext(DIR *dp, FILINFO *fno) {(void)dp; (void)fno; return FR_NOT_READY;}
+FRESULT f_unlink(const TCHAR *path) {(void)path; return FR_NOT_READY;}
+
+/*
+ * Test helpers
+ */
+int host_test_fail;
+int host_test_count;
+int host_test_result(const char *name)
+{
+  printf("%s: %d checks, %d failed\n", name, host_test_count, host_test_fail);
+  return host_test_fail ? 1 : 0;
+}
+
+uint64_t host_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+#endif
+}
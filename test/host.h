@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Host test support: firmware sources build with test/stub headers,
+ * hardware drivers replaced by test/host.c
+ */
+#ifndef _HOST_H_
+#define _HOST_H_
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <math.h>
+
+/*
+ * RAM backed flash (mapped on FLASH_START_ADDRESS)
+ * erase set 0xFF, program allowed only on erased half word (or write 0)
+ */
+extern uint32_t host_flash_writes;     // programmed half words
+extern uint32_t host_flash_erases;     // erased pages
+extern uint32_t host_flash_errors;     // program on not erased half word
+// Power loss simulation: after host_flash_countdown flash operations longjmp to host_power_loss
+// (-1 disable), operation in progress torn: half word not written, page erased only half
+extern int32_t  host_flash_countdown;
+extern jmp_buf  host_power_loss;
+void host_flash_erase_all(void);
+
+/*
+ * Interrupts and codec/generator
+ */
+// Called on __WFI (as interrupt, for example I2S DMA rx buffer), NULL - only time step
+extern void (*host_irq)(void);
+// Band codec gain (l_gain | r_gain << 8) by frequency for si5351_set_frequency/si5351_get_gain (NULL - 0)
+extern uint16_t (*host_band_gain)(uint32_t freq);
+// Codec PGA gain (0.5 dB step) set by tlv320aic3204_set_gain: left (reference), right (sample)
+extern uint8_t host_codec_gain[2];
+
+/*
+ * Simple test check helpers, each test file is a separate program
+ */
+extern int host_test_fail;
+extern int host_test_count;
+#define CHECK(cond, ...) do {                                        \
+  host_test_count++;                                                 \
+  if (!(cond)) {                                                     \
+    host_test_fail++;                                                \
+    printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); \
+    printf("\n");                                                    \
+  }                                                                  \
+} while (0)
+int host_test_result(const char *name);
+
+// Host cycle counter for timings (rdtsc or clock_gettime ns)
+uint64_t host_cycles(void);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Host build stub of ChibiOS kernel header (only used by test/ host builds)
+ * Declare types and functions used by firmware sources, implementation in test/host.c
+ */
+#ifndef _CH_H_
+#define _CH_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define TRUE   1
+#define FALSE  0
+#define MSG_OK       0
+#define MSG_TIMEOUT -1
+#define NORMALPRIO  64
+#define TIME_IMMEDIATE  ((systime_t)0)
+#define TIME_INFINITE   ((systime_t)-1)
+#define CH_CFG_ST_FREQUENCY 10000
+#define US2ST(x)  ((systime_t)(((x) * CH_CFG_ST_FREQUENCY + 999999) / 1000000))
+#define MS2ST(x)  ((systime_t)(((x) * CH_CFG_ST_FREQUENCY + 999) / 1000))
+#define S2ST(x)   ((systime_t)((x) * CH_CFG_ST_FREQUENCY))
+#define ST2US(x)  ((uint32_t)(((x) * 1000000ULL) / CH_CFG_ST_FREQUENCY))
+#define ST2MS(x)  ((uint32_t)(((x) * 1000ULL) / CH_CFG_ST_FREQUENCY))
+#define __STATIC_INLINE static inline
+#define osalDbgAssert(c, r) (void)(c)
+#define osalSysLock()
+#define osalSysUnlock()
+#define osalSysLockFromISR()
+#define osalSysUnlockFromISR()
+#define chSysLock()
+#define chSysUnlock()
+#define chSysLockFromISR()
+#define chSysUnlockFromISR()
+#define OSAL_IRQ_PROLOGUE()
+#define OSAL_IRQ_EPILOGUE()
+#define OSAL_IRQ_HANDLER(id) void id(void)
+#define CH_IRQ_HANDLER(id)   void id(void)
+#define CH_IRQ_PROLOGUE()
+#define CH_IRQ_EPILOGUE()
+#define THD_WORKING_AREA(n, s)  char n[s]
+#define THD_FUNCTION(n, a)      void n(void *a)
+
+#define PORT_ARCHITECTURE_NAME "host"
+#define PORT_CORE_VARIANT_NAME "host"
+
+// Core peripherals (CMSIS) as RAM structures
+void host_wfi(void);
+#define __WFI() host_wfi()
+#define __disable_irq()
+#define __enable_irq()
+void NVIC_SystemReset(void);
+static inline uint32_t __ROR(uint32_t v, uint32_t s) {return s ? (v >> s) | (v << (32 - s)) : v;}
+static inline uint32_t __RBIT(uint32_t v) {uint32_t r = 0; for (int i = 0; i < 32; i++, v >>= 1) r = (r << 1) | (v & 1); return r;}
+static inline uint32_t __REV(uint32_t v) {return __builtin_bswap32(v);}
+static inline int32_t  __REVSH(int32_t v) {return (int16_t)__builtin_bswap16((uint16_t)v);}
+static inline uint32_t __REV16(uint32_t v) {return ((v & 0xFF00FF00U) >> 8) | ((v & 0x00FF00FFU) << 8);}
+static inline int32_t  __SSAT(int32_t v, uint32_t b) {int32_t m = (1 << (b - 1)); return v < -m ? -m : v > m - 1 ? m - 1 : v;}
+static inline uint32_t __CLZ(uint32_t v) {return v ? __builtin_clz(v) : 32;}
+
+#define __IO volatile
+typedef struct {volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFRL, AFRH, BRR;} GPIO_TypeDef;
+typedef struct {volatile uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR;} TIM_TypeDef;
+typedef struct {volatile uint32_t TR, DR, CR, ISR, PRER, WUTR, CALIBR, ALRMAR, ALRMBR, WPR, SSR, SHIFTR, TSTR, TSDR, TSSSR, CALR, TAFCR, ALRMASSR, ALRMBSSR, RESERVED7, BKP0R, BKP1R, BKP2R, BKP3R, BKP4R,
+                           BKP5R, BKP6R, BKP7R, BKP8R, BKP9R, BKP10R, BKP11R, BKP12R, BKP13R, BKP14R, BKP15R;} RTC_TypeDef;
+typedef struct {volatile uint32_t DR, IDR, CR, RESERVED, INIT, POL;} CRC_TypeDef;
+typedef struct {volatile uint32_t CTRL, CYCCNT;} DWT_Type;
+typedef struct {volatile uint32_t DHCSR, DCRSR, DCRDR, DEMCR;} CoreDebug_Type;
+typedef struct {volatile uint32_t CCR, CNDTR, CPAR, CMAR;} DMA_Channel_TypeDef;
+typedef struct {volatile uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR, BDCR, CSR;} RCC_TypeDef;
+extern RCC_TypeDef host_rcc;
+extern GPIO_TypeDef host_gpio[4];
+extern TIM_TypeDef host_tim[4];
+extern RTC_TypeDef host_rtc;
+extern uint8_t host_crc_page[];
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+extern DMA_Channel_TypeDef host_dma[7];
+#define GPIOA          (&host_gpio[0])
+#define GPIOB          (&host_gpio[1])
+#define GPIOC          (&host_gpio[2])
+#define TIM2           (&host_tim[1])
+#define TIM3           (&host_tim[2])
+#define RCC            (&host_rcc)
+#define RTC            (&host_rtc)
+#define CRC            ((CRC_TypeDef *)host_crc_page)
+#define DWT            (&host_dwt)
+#define CoreDebug      (&host_core_debug)
+#define DMA1_Channel4  (&host_dma[3])
+#define RCC_AHBENR_CRCEN (1U << 6)
+#define CRC_CR_RESET     (1U << 0)
+#define CRC_CR_REV_IN_0  (1U << 5)
+#define CRC_CR_REV_IN_1  (1U << 6)
+#define CRC_CR_REV_IN    (3U << 5)
+#define CRC_CR_REV_OUT   (1U << 7)
+#define CoreDebug_DEMCR_TRCENA_Msk (1U << 24)
+#define DWT_CTRL_CYCCNTENA_Msk     (1U << 0)
+
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+typedef int32_t  msg_t;
+typedef uint32_t eventmask_t;
+typedef uint8_t  tprio_t;
+typedef struct {int dummy;} mutex_t;
+typedef struct {int dummy;} thread_t;
+typedef struct {int dummy;} threads_queue_t;
+typedef struct {int dummy;} virtual_timer_t;
+typedef struct {int dummy;} binary_semaphore_t;
+typedef void (*tfunc_t)(void *p);
+
+typedef struct BaseSequentialStream BaseSequentialStream;
+#define _base_sequential_stream_methods                    \
+  size_t (*write)(void *instance, const uint8_t *bp, size_t n); \
+  size_t (*read)(void *instance, uint8_t *bp, size_t n);        \
+  msg_t (*put)(void *instance, uint8_t b);                      \
+  msg_t (*get)(void *instance);
+struct BaseSequentialStreamVMT {
+  _base_sequential_stream_methods
+};
+struct BaseSequentialStream {
+  const struct BaseSequentialStreamVMT *vmt;
+};
+#define streamWrite(ip, bp, n)  ((ip)->vmt->write(ip, bp, n))
+#define streamRead(ip, bp, n)   ((ip)->vmt->read(ip, bp, n))
+#define streamPut(ip, b)        ((ip)->vmt->put(ip, b))
+#define streamGet(ip)           ((ip)->vmt->get(ip))
+
+void chSysInit(void);
+systime_t chVTGetSystemTimeX(void);
+systime_t chVTGetSystemTime(void);
+void chThdSleep(systime_t time);
+void chThdSleepMilliseconds(uint32_t ms);
+void chThdSleepMicroseconds(uint32_t us);
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+void chRegSetThreadName(const char *name);
+void chMtxObjectInit(mutex_t *mp);
+void chMtxLock(mutex_t *mp);
+void chMtxUnlock(mutex_t *mp);
+void osalThreadQueueObjectInit(threads_queue_t *tqp);
+msg_t osalThreadEnqueueTimeoutS(threads_queue_t *tqp, systime_t time);
+void osalThreadDequeueNextI(threads_queue_t *tqp, msg_t msg);
+
+#endif
@@ -0,0 +1,11 @@
+/*
+ * Host build stub of ChibiOS chprintf header (only used by test/ host builds)
+ */
+#ifndef _CHPRINTF_H_
+#define _CHPRINTF_H_
+#include "ch.h"
+int chvprintf(BaseSequentialStream *chp, const char *fmt, va_list ap);
+int chprintf(BaseSequentialStream *chp, const char *fmt, ...);
+int chsnprintf(char *str, size_t size, const char *fmt, ...);
+int chvsnprintf(char *str, size_t size, const char *fmt, va_list ap);
+#endif
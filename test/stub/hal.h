@@ -0,0 +1,67 @@
+/*
+ * Host build stub of ChibiOS HAL header (only used by test/ host builds)
+ * Peripherals are plain RAM structures, defined in test/host.c
+ */
+#ifndef _HAL_H_
+#define _HAL_H_
+#include "ch.h"
+#include "halconf.h"
+#include "board.h"
+
+#define STM32_SYSCLK            72000000
+#define STM32_RTCSEL_MASK       (3U << 8)
+#define STM32_RTCSEL_LSE        (1U << 8)
+#define ADC_CHSELR_CHSEL6       (1U << 6)
+#define ADC_CHSELR_CHSEL7       (1U << 7)
+#define STM32_DMA_ISR_TCIF      (1U << 1)
+#define STM32_DMA_ISR_HTIF      (1U << 2)
+#define STM32_DMA_CR_EN         (1U << 0)
+#define STM32_DMA_CR_PSIZE_BYTE   0
+#define STM32_DMA_CR_MSIZE_BYTE   0
+#define STM32_DMA_CR_PSIZE_HWORD  (1U << 8)
+#define STM32_DMA_CR_MSIZE_HWORD  (1U << 10)
+#define USART_CR2_STOP1_BITS    0
+#define I2C_TIMINGR_PRESC_Pos   28
+#define I2C_TIMINGR_SCLDEL_Pos  20
+#define I2C_TIMINGR_SDADEL_Pos  16
+#define I2C_TIMINGR_SCLH_Pos     8
+#define I2C_TIMINGR_SCLL_Pos     0
+#define PLATFORM_NAME            "host"
+
+// USB and serial drivers
+typedef enum {USB_UNINIT = 0, USB_STOP, USB_READY, USB_SELECTED, USB_ACTIVE, USB_SUSPENDED} usbstate_t;
+typedef struct {usbstate_t state;} USBDriver;
+typedef struct {int dummy;} USBConfig;
+typedef struct {int dummy;} USBDescriptor;
+typedef struct {USBDriver *usbp; uint32_t bulk_in, bulk_out, int_in;} SerialUSBConfig;
+typedef struct {int dummy;} io_queue_t;
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+  const SerialUSBConfig *config;
+  io_queue_t iqueue, oqueue;
+} SerialUSBDriver;
+typedef struct {uint32_t speed; uint16_t cr1, cr2, cr3;} SerialConfig;
+typedef struct {
+  const struct BaseSequentialStreamVMT *vmt;
+  io_queue_t iqueue, oqueue;
+} SerialDriver;
+extern USBDriver USBD1;
+extern SerialDriver SD1;
+#define usbGetDriverStateI(usbp) ((usbp)->state)
+void halInit(void);
+void usbStart(USBDriver *usbp, const USBConfig *config);
+void usbConnectBus(USBDriver *usbp);
+void usbDisconnectBus(USBDriver *usbp);
+void sduObjectInit(SerialUSBDriver *sdup);
+void sduStart(SerialUSBDriver *sdup, const SerialUSBConfig *config);
+void sduDisconnectI(SerialUSBDriver *sdup);
+void sduConfigureHookI(SerialUSBDriver *sdup);
+void sdStart(SerialDriver *sdp, const SerialConfig *config);
+void sdSetBaudrate(SerialDriver *sdp, uint32_t speed);
+size_t sdWriteTimeout(SerialDriver *sdp, const uint8_t *bp, size_t n, systime_t time);
+size_t sdReadTimeout(SerialDriver *sdp, uint8_t *bp, size_t n, systime_t time);
+void qResetI(io_queue_t *qp);
+void rccEnableDMA1(bool lp);
+void rccEnableAHB(uint32_t mask, bool lp);
+
+#endif
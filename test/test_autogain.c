@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Auto gain calibration (main.c auto_gain_calibrate) on simulated I2S rx buffers:
+ * sample channel = reference * fixed transmission * codec PGA gain (0.5 dB step, right channel)
+ *  band change - calibrate on low band (r_gain 0), high band (r_gain 60) and low band again:
+ *                steps count from calibration band gain (codec gain not over max), step gains = PGA gain steps
+ */
+#include "host.h"
+#define main vna_main
+#define div  vna_div     // not conflict with stdlib.h div()
+#include "main.c"
+#undef main
+#undef div
+
+#ifndef __USE_AUTO_GAIN__
+#error "Test require __USE_AUTO_GAIN__"
+#endif
+
+#define TEST_HIGH_BAND    100000000U   // r_gain 60 from this freq (0 below)
+#define TEST_HIGH_R_GAIN  60
+#define TEST_REF_LEVEL    10000.0      // reference sine amplitude
+#define TEST_TRANSMISSION 0.01         // sample channel level on PGA 0 dB (-40 dB to ref)
+#define GAIN_ERROR        5e-3f   // 0.04 dB, sample quantization on step 0 (amplitude 100)
+
+static uint16_t band_gain(uint32_t freq) {return freq < TEST_HIGH_BAND ? 0 : TEST_HIGH_R_GAIN << 8;}
+
+static uint32_t sample_n;
+static uint32_t half;
+static uint8_t  max_gain;    // max codec sample channel gain on measure
+
+// I2S DMA half/full transfer: fill next half of rx_buffer and call rx interrupt
+static void i2s_irq(void)
+{
+  double w = 2 * M_PI * IF_OFFSET / ADC_FREQ;
+  double g = TEST_TRANSMISSION * pow(10.0, host_codec_gain[1] * 0.5 / 20.0);
+  audio_sample_t *p = &rx_buffer[half ? AUDIO_BUFFER_LEN : 0];
+  if (host_codec_gain[1] > max_gain) max_gain = host_codec_gain[1];
+  for (uint32_t i = 0; i < ADC_BUFFER_LEN; i+= 2, sample_n++) {
+    double s = TEST_REF_LEVEL * g * cos(w * sample_n + 1.0);
+    p[i+0] = lrint(TEST_REF_LEVEL * cos(w * sample_n));
+    p[i+1] = s > 32767 ? 32767 : s < -32768 ? -32768 : lrint(s);
+  }
+  i2s_lld_serve_rx_interrupt(half ? STM32_DMA_ISR_TCIF : STM32_DMA_ISR_HTIF);
+  half^= 1;
+}
+
+// Steps count for band r_gain as auto_gain_max_step
+static uint8_t band_steps(uint32_t freq)
+{
+  uint8_t r_gain = band_gain(freq) >> 8;
+  return (AUTO_GAIN_REG_MAX - r_gain) / AUTO_GAIN_REG_STEP + 1;
+}
+
+static void test_band_change(void)
+{
+  static const freq_t freq[] = {10000000, 200000000, 10000000, 150000000};
+  for (uint32_t i = 0; i < ARRAY_COUNT(freq); i++) {
+    memset(config._gain_cal, 0, sizeof(config._gain_cal));
+    max_gain = 0;
+    auto_gain_calibrate(freq[i]);
+    uint8_t steps = band_steps(freq[i]);
+    CHECK(config._auto_gain == steps, "%u Hz: %d steps calibrated, need %d", (uint32_t)freq[i], config._auto_gain, steps);
+    CHECK(max_gain <= AUTO_GAIN_REG_MAX, "%u Hz: codec gain %d over max", (uint32_t)freq[i], max_gain);
+    CHECK(host_codec_gain[1] == (band_gain(freq[i]) >> 8), "%u Hz: codec gain %d not restored", (uint32_t)freq[i], host_codec_gain[1]);
+    float max_err = 0;
+    for (int k = 0; k < config._auto_gain; k++) {
+      float need = pow(10.0, k * AUTO_GAIN_REG_STEP * 0.5 / 20.0);
+      const float *g = config._gain_cal[k];
+      float err = hypotf(g[0] - need, g[1]) / need;
+      if (err > max_err) max_err = err;
+    }
+    CHECK(max_err < GAIN_ERROR, "%u Hz: step gain error %.3g", (uint32_t)freq[i], max_err);
+    printf("auto gain cal %u Hz: %d steps, max step gain error %.3g\n", (uint32_t)freq[i], config._auto_gain, max_err);
+  }
+}
+
+int main(void)
+{
+#ifdef USE_VARIABLE_OFFSET
+  generate_DSP_Table(IF_OFFSET);
+#endif
+  host_band_gain = band_gain;
+  host_irq = i2s_irq;
+  test_band_change();
+  host_irq = NULL;
+  return host_test_result("test_autogain");
+}
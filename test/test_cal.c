@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Calibration math tests (main.c):
+ *  calkit_gamma   - cal kit standard model vs double precision model
+ *  calkit_solve   - ideal kit result same as old eterm_calc_es/eterm_calc_er,
+ *                   non ideal kit: raw standards from error model, corrected DUT equal true
+ *  cal_interpolate - exact on cubic function
+ *  packed cal     - corrected S11/S21 error from float16 slot save within first order bound,
+ *                   float16 pack edge cases (NaN, Inf, overflow, subnormal)
+ */
+#include <complex.h>
+#include "host.h"
+#define main vna_main
+#define div  vna_div     // not conflict with stdlib.h div()
+#include "main.c"
+#undef main
+#undef div
+
+typedef double complex cplx;
+
+#define CAL_START      50000
+#define CAL_STOP   900000000
+#define CAL_POINTS       101
+
+static double rnd(void) {return (rand() / (double)RAND_MAX - 0.5) * 2.0;}
+
+static void set_sweep(freq_t start, freq_t stop, uint16_t points)
+{
+  load_default_properties();
+  current_props._frequency0 = start;
+  current_props._frequency1 = stop;
+  current_props._sweep_points = points;
+  update_frequencies();
+  cal_frequency0 = start;
+  cal_frequency1 = stop;
+  cal_sweep_points = points;
+}
+
+// Keysight cal kit standard definition in double precision
+static cplx ref_calkit_gamma(const calkit_t *k, int type, double f)
+{
+  double w = 2 * M_PI * f, sq = sqrt(f / 1e9);
+  double delay = k->delay[type] * 1e-12, loss = k->loss[type] * 1e9;
+  cplx zc = k->z0 + (w > 0 ? (1 - I) * loss / (2 * w) * sq : 0);
+  cplx gl;
+  if (type == CALKIT_OPEN) {
+    double c = (k->c[0] + k->c[1] * 1e-12 * f + k->c[2] * 1e-21 * f * f + k->c[3] * 1e-30 * f * f * f) * 1e-15;
+    cplx y = I * w * c;
+    gl = (1 - zc * y) / (1 + zc * y);
+  } else {
+    cplx z;
+    if (type == CALKIT_SHORT)
+      z = I * w * (k->l[0] + k->l[1] * 1e-12 * f + k->l[2] * 1e-21 * f * f + k->l[3] * 1e-30 * f * f * f) * 1e-12;
+    else
+      z = k->load_r + I * w * k->load_l * 1e-12;
+    gl = (z - zc) / (z + zc);
+  }
+  double al = loss * delay / (2 * k->z0) * sq;
+  cplx g = gl * cexp(-2 * (al + I * (w * delay + al)));
+  cplx g1 = (zc - CALKIT_Z_SYS) / (zc + CALKIT_Z_SYS);
+  return (g1 + g) / (1 + g1 * g);
+}
+
+// Non ideal kit (typical SMA kit values)
+static const calkit_t test_kit = {
+  .c = {49.43, -310.1, 23.17, -0.16},
+  .l = {2.077, -108.5, 2.171, -0.01},
+  .delay = {29.24, 31.79, 0},
+  .loss = {1.3, 1.4, 0},
+  .z0 = 50.0,
+  .load_r = 50.5,
+  .load_l = 5.0,
+};
+
+static void test_calkit_gamma(void)
+{
+  static const calkit_t ideal = CALKIT_DEFAULT;
+  static const float ideal_g[3][2] = {{1, 0}, {-1, 0}, {0, 0}};
+  float max_err = 0;
+  for (int i = 0; i < CAL_POINTS; i++) {
+    freq_t f = CAL_START + (uint64_t)(CAL_STOP - CAL_START) * i / (CAL_POINTS - 1);
+    for (int t = 0; t < 3; t++) {
+      float g[2];
+      config._calkit = ideal;
+      calkit_gamma(t, f, g);
+      CHECK(hypotf(g[0] - ideal_g[t][0], g[1] - ideal_g[t][1]) < 1e-6f, "ideal kit %d at %u: %f %f", t, f, g[0], g[1]);
+      config._calkit = test_kit;
+      calkit_gamma(t, f, g);
+      cplx r = ref_calkit_gamma(&test_kit, t, f);
+      float e = cabs(g[0] + I * g[1] - r);
+      if (e > max_err) max_err = e;
+      CHECK(e < 2e-5f, "kit %d at %u: %f %f, expect %f %f", t, f, g[0], g[1], creal(r), cimag(r));
+    }
+  }
+  printf("calkit_gamma: max error %.3g\n", max_err);
+}
+
+// Error terms model and raw standards measure for standards gamma
+static cplx ed[CAL_POINTS], es[CAL_POINTS], er[CAL_POINTS];
+static cplx raw(int i, cplx g) {return ed[i] + er[i] * g / (1 - es[i] * g);}
+
+static void gen_raw_standards(const calkit_t *k)
+{
+  for (int i = 0; i < CAL_POINTS; i++) {
+    double f = getFrequency(i);
+    ed[i] = 0.05 * cexp(I * M_PI * rnd());
+    es[i] = 0.1 * cexp(I * M_PI * rnd());
+    er[i] = (0.3 + 0.5 * fabs(rnd())) * cexp(-I * 2 * M_PI * f * 1e-9);
+    static const uint8_t std[3] = {CAL_OPEN, CAL_SHORT, CAL_LOAD};
+    for (int t = 0; t < 3; t++) {
+      cplx m = raw(i, ref_calkit_gamma(k, t, f));
+      cal_data[std[t]][i][0] = creal(m);
+      cal_data[std[t]][i][1] = cimag(m);
+    }
+  }
+}
+
+// All zero (ideal) kit: calkit_solve give same Ed, Es, Er as old eterm_calc_es + eterm_calc_er
+static void test_ideal_kit(void)
+{
+  static const calkit_t ideal = CALKIT_DEFAULT;
+  static float raw_data[3][POINTS_COUNT][2], old_e[3][POINTS_COUNT][2]; // first 3 cal_data slots
+  float max_err = 0;
+  set_sweep(CAL_START, CAL_STOP, CAL_POINTS);
+  config._calkit = ideal;
+  gen_raw_standards(&ideal);
+  memcpy(raw_data, cal_data, sizeof(raw_data));       // CAL_LOAD, CAL_OPEN, CAL_SHORT
+  // Old path (Ed = load, Es from open/short, Er from short)
+  cal_status = CALSTAT_LOAD|CALSTAT_OPEN|CALSTAT_SHORT;
+  eterm_calc_es();
+  eterm_calc_er(-1);
+  memcpy(old_e, cal_data, sizeof(old_e));             // ETERM_ED, ETERM_ES, ETERM_ER
+  // Cal kit path
+  memcpy(cal_data, raw_data, sizeof(raw_data));
+  cal_status = CALSTAT_LOAD|CALSTAT_OPEN|CALSTAT_SHORT;
+  eterm_calc_calkit();
+  CHECK(cal_status == (CALSTAT_LOAD|CALSTAT_ES|CALSTAT_ER), "cal_status %04x", cal_status);
+  static const uint8_t eterm[3] = {ETERM_ED, ETERM_ES, ETERM_ER};
+  for (int i = 0; i < CAL_POINTS; i++)
+    for (int t = 0; t < 3; t++) {
+      const float *n = cal_data[eterm[t]][i], *o = old_e[eterm[t]][i];
+      float e = hypotf(n[0] - o[0], n[1] - o[1]);
+      if (e > max_err) max_err = e;
+      CHECK(e < 1e-5f, "point %d eterm %d: %f %f, old %f %f", i, eterm[t], n[0], n[1], o[0], o[1]);
+    }
+  printf("ideal kit: max error to old eterm_calc %.3g\n", max_err);
+}
+
+// Non ideal kit: cal_done on raw standards, corrected DUT = true DUT gamma
+static void test_kit_solve(void)
+{
+  static const calkit_t ideal = CALKIT_DEFAULT;
+  static float raw_data[3][POINTS_COUNT][2];
+  float max_err = 0, max_ideal = 0;
+  set_sweep(CAL_START, CAL_STOP, CAL_POINTS);
+  gen_raw_standards(&test_kit);
+  memcpy(raw_data, cal_data, sizeof(raw_data));
+  for (int pass = 0; pass < 2; pass++) {
+    // pass 0 - use kit model, pass 1 - ideal kit (show model used)
+    config._calkit = pass ? ideal : test_kit;
+    memcpy(cal_data, raw_data, sizeof(raw_data));
+    cal_status = CALSTAT_LOAD|CALSTAT_OPEN|CALSTAT_SHORT;
+    cal_done();
+    for (int i = 0; i < CAL_POINTS; i++) {
+      for (int k = 0; k < 4; k++) {
+        cplx dut = (0.1 + 0.3 * k) * cexp(I * M_PI * rnd());
+        cplx m = raw(i, dut);
+        float data[4] = {creal(m), cimag(m), 0, 0};
+        float c_data[CAL_TYPE_COUNT][2];
+        cal_interpolate(i, getFrequency(i), c_data);
+        apply_CH0_error_term(data, c_data);
+        float e = cabs(data[0] + I * data[1] - dut);
+        if (pass == 0) {
+          if (e > max_err) max_err = e;
+          CHECK(e < 5e-5f, "point %d: S11 %f %f, true %f %f", i, data[0], data[1], creal(dut), cimag(dut));
+        }
+        else if (e > max_ideal) max_ideal = e;
+      }
+    }
+  }
+  // Ideal kit on high frequency give big error (check kit model really used)
+  CHECK(max_ideal > 0.1f, "ideal kit error %f too small", max_ideal);
+  printf("non ideal kit: max S11 error %.3g (ideal kit model %.3g)\n", max_err, max_ideal);
+}
+
+// Cubic Lagrange interpolation exact for cubic function on calibration points (quadratic on range ends)
+static void test_interpolate(void)
+{
+  double a[CAL_TYPE_COUNT][2][4];
+  float max_err = 0;
+  set_sweep(CAL_START, CAL_STOP, CAL_POINTS);
+  for (int t = 0; t < CAL_TYPE_COUNT; t++)
+    for (int j = 0; j < 2; j++)
+      for (int k = 0; k < 4; k++)
+        a[t][j][k] = rnd();
+#define CUBIC(t, j, x) (a[t][j][0] + (x) * (a[t][j][1] + (x) * (a[t][j][2] + (x) * a[t][j][3])))
+  for (int i = 0; i < CAL_POINTS; i++) {
+    double x = (getFrequency(i) - CAL_START) / (double)(CAL_STOP - CAL_START);
+    for (int t = 0; t < CAL_TYPE_COUNT; t++) {
+      cal_data[t][i][0] = CUBIC(t, 0, x);
+      cal_data[t][i][1] = CUBIC(t, 1, x);
+    }
+  }
+  cal_interpolate_prepare();
+  for (int k = 0; k < 10000; k++) {
+    // Inside range, skip first and last interval (extrapolate by quadratic)
+    double step = (CAL_STOP - CAL_START) / (double)(CAL_POINTS - 1);
+    freq_t f = CAL_START + step + (CAL_STOP - CAL_START - 2 * step) * (0.5 + 0.5 * rnd());
+    double x = (f - CAL_START) / (double)(CAL_STOP - CAL_START);
+    float c_data[CAL_TYPE_COUNT][2];
+    cal_interpolate(-1, f, c_data);
+    for (int t = 0; t < CAL_TYPE_COUNT; t++) {
+      float e = hypot(c_data[t][0] - CUBIC(t, 0, x), c_data[t][1] - CUBIC(t, 1, x));
+      if (e > max_err) max_err = e;
+      CHECK(e < 2e-5f, "%u Hz slot %d: %f %f, expect %f %f", f, t, c_data[t][0], c_data[t][1], CUBIC(t, 0, x), CUBIC(t, 1, x));
+    }
+  }
+#undef CUBIC
+  printf("cal_interpolate: max error on cubic %.3g\n", max_err);
+}
+
+/*
+ * Calibration slot save as float16 (__USE_PACKED_CAL__), recall use it in place
+ */
+#define HALF_EPS    (1.0 / 2048)        // float16 max relative error (round to nearest)
+#define HALF_MIN    (1.0 / 33554432)    // max absolute error on float16 subnormal (2^-25)
+static cplx cal_term(float c_data[CAL_TYPE_COUNT][2], int t) {return c_data[t][0] + I * c_data[t][1];}
+
+static void correct(int i, const float m[4], float data[4], float c_data[CAL_TYPE_COUNT][2])
+{
+  memcpy(data, m, 4 * sizeof(float));
+  cal_interpolate(i, getFrequency(i), c_data);
+  apply_CH0_error_term(data, c_data);
+  apply_CH1_error_term(data, c_data);
+}
+
+// Corrected S11 and S21 on representative calibration, RAM (float) vs saved slot (float16)
+static void test_packed_cal(void)
+{
+  static const calkit_t ideal = CALKIT_DEFAULT;
+  float max_s11 = 0, max_s21 = 0;
+  set_sweep(CAL_START, CAL_STOP, CAL_POINTS);
+  config._calkit = ideal;
+  gen_raw_standards(&ideal);
+  for (int i = 0; i < CAL_POINTS; i++) {
+    // thru: Et = S21mt - Ex, isolation Ex about -80dB
+    double f = getFrequency(i);
+    cplx et = (0.2 + 0.5 * fabs(rnd())) * cexp(-I * 2 * M_PI * f * 1.5e-9), ex = 1e-4 * cexp(I * M_PI * rnd());
+    cal_data[CAL_THRU][i][0] = creal(et + ex); cal_data[CAL_THRU][i][1] = cimag(et + ex);
+    cal_data[CAL_ISOLN][i][0] = creal(ex);     cal_data[CAL_ISOLN][i][1] = cimag(ex);
+  }
+  cal_status = CALSTAT_LOAD|CALSTAT_OPEN|CALSTAT_SHORT|CALSTAT_THRU|CALSTAT_ISOLN;
+  cal_done();
+  // DUT raw data
+  static float m[CAL_POINTS][4], ram[CAL_POINTS][4];
+  static float c_ram[CAL_POINTS][CAL_TYPE_COUNT][2];
+  for (int i = 0; i < CAL_POINTS; i++) {
+    cplx s11 = raw(i, (0.05 + 0.95 * fabs(rnd())) * cexp(I * M_PI * rnd()));
+    cplx s21 = (1e-3 + fabs(rnd())) * cexp(I * M_PI * rnd());
+    m[i][0] = creal(s11); m[i][1] = cimag(s11); m[i][2] = creal(s21); m[i][3] = cimag(s21);
+    correct(i, m[i], ram[i], c_ram[i]);
+  }
+  clear_all_config_prop_data();
+  CHECK(caldata_save(0) == 0, "caldata_save");
+  CHECK(caldata_recall(0) == 0, "caldata_recall");
+  for (int i = 0; i < CAL_POINTS; i++) {
+    float data[4], c_data[CAL_TYPE_COUNT][2];
+    correct(i, m[i], data, c_data);
+    // First order error from every term relative error HALF_EPS
+    // S11 = d / D, d = S11m - Ed, D = Er + Es * d: dS/dEd = -Er/D^2, dS/dEs = -S^2, dS/dEr = -S/D
+    float (*c)[2] = c_ram[i];
+    cplx ed = cal_term(c, ETERM_ED), es = cal_term(c, ETERM_ES), er = cal_term(c, ETERM_ER);
+    cplx d = m[i][0] + I * m[i][1] - ed, D = er + es * d, s = d / D;
+    double bound = (HALF_EPS * (cabs(ed * er / (D * D)) + cabs(es * s * s) + cabs(er * s / D)) + 3 * HALF_MIN) * 1.1 + 1e-6;
+    float e = hypotf(data[0] - ram[i][0], data[1] - ram[i][1]);
+    CHECK(e <= bound, "point %d: S11 error %g > %g", i, e, bound);
+    if (e > max_s11) max_s11 = e;
+    // S21 = (S21m - Ex) * Et
+    cplx ex = cal_term(c, ETERM_EX), et = cal_term(c, ETERM_ET);
+    bound = (HALF_EPS * (cabs(ex * et) + hypot(ram[i][2], ram[i][3])) + 2 * HALF_MIN) * 1.1 + 1e-7;
+    e = hypotf(data[2] - ram[i][2], data[3] - ram[i][3]);
+    CHECK(e <= bound, "point %d: S21 error %g > %g", i, e, bound);
+    if (e > max_s21) max_s21 = e;
+  }
+  // Direct write current_props after caldata_reset, slot data not used
+  caldata_reset();
+  float v[2];
+  cal_data[CAL_LOAD][0][0] = 1.5f; cal_data[CAL_LOAD][0][1] = -0.25f;
+  caldata_point(CAL_LOAD, 0, v);
+  CHECK(lastsaveid == NO_SAVE_SLOT && v[0] == 1.5f && v[1] == -0.25f, "caldata_reset: slot %d, data %g %g", lastsaveid, v[0], v[1]);
+  printf("packed cal: max S11 error %.3g, S21 error %.3g\n", max_s11, max_s21);
+}
+
+// float16 pack/unpack edge cases: NaN, Inf, overflow clamp to max (65504), subnormal, underflow to 0
+static float half_expect(float v)
+{
+  union {float f; uint32_t i;} u = {v};   // not use isnan(), -ffast-math fold it
+  if ((u.i & 0x7F800000) == 0x7F800000 || fabsf(v) >= 65520.0f) return copysignf(65504.0f, v);
+  return (float)(_Float16)v;  // round to nearest even
+}
+
+static void test_half(void)
+{
+  static const float edge[] = {NAN, -NAN, INFINITY, -INFINITY, 1e6f, -1e6f, 65504.0f, 65519.0f, 65520.0f, -65520.0f,
+    1.0f, -1.0f, 0.0f, -0.0f, 6.1035156e-5f, 6.09e-5f, 1e-6f, -1e-6f, 5.9604645e-8f, 3e-8f, 2.9802322e-8f, 2e-8f,
+    1e-40f, -1e-40f, 1e-45f, 0.33333334f, 1.00048828125f, 1.000732421875f};
+  int total = 0, fail = host_test_fail;
+  for (int pass = 0; pass < 20; pass++) {
+    // Edge values on first pass, random bit patterns on others
+    float *cal = &cal_data[0][0][0];
+    int count = CAL_TYPE_COUNT * POINTS_COUNT * 2;
+    caldata_recall(NO_SAVE_SLOT);
+    for (int i = 0; i < count; i++) {
+      union {uint32_t i; float f;} u;
+      u.i = ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ ((uint32_t)rand() << 31);
+      cal[i] = (pass == 0 && i < (int)ARRAY_COUNT(edge)) ? edge[i] : u.f;
+    }
+    static float src[CAL_TYPE_COUNT * POINTS_COUNT * 2];
+    memcpy(src, cal, sizeof(src));
+    CHECK(caldata_save(1) == 0, "caldata_save");
+    CHECK(caldata_recall(1) == 0, "caldata_recall");
+    for (int t = 0; t < CAL_TYPE_COUNT; t++)
+      for (int j = 0; j < POINTS_COUNT; j++) {
+        float v[2];
+        caldata_point(t, j, v);
+        for (int k = 0; k < 2; k++, total++) {
+          float x = src[(t * POINTS_COUNT + j) * 2 + k], r = half_expect(x);
+          CHECK(memcmp(&v[k], &r, sizeof(float)) == 0 || (v[k] == 0.0f && r == 0.0f && signbit(v[k]) == signbit(x)),
+                "half(%g) = %g, expect %g", x, v[k], r);
+          if (host_test_fail > fail + 10) return;
+        }
+      }
+  }
+  caldata_recall(NO_SAVE_SLOT);
+  printf("float16 pack: %d values checked\n", total);
+}
+
+int main(void)
+{
+  srand(1);
+  test_calkit_gamma();
+  test_ideal_kit();
+  test_kit_solve();
+  test_interpolate();
+  test_packed_cal();
+  test_half();
+  return host_test_result("test_cal");
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * CRC-32 tests: firmware CRC unit code (NANOVNA_STM32_F072/crc.c) run on register level
+ * unit model (host.c) against software table fallback from data_storage.c:
+ *  check value  - CRC-32 of "123456789" is 0xCBF43926 (both)
+ *  random       - random buffers all lengths 0..300 (odd tail bytes), unit == software
+ *  continue     - calculation split on aligned parts (continue from unit state), unit == software
+ *  journal      - record crc on unit == journal_record_crc (software)
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "host.h"
+// Host build use software table fallback (__USE_SW_CRC__), here as crc32_soft (crc32_calc is CRC unit code)
+#define crc32_calc crc32_soft
+#include "data_storage.c"
+#undef crc32_calc
+
+/*
+ * CRC unit, register level model: registers page protected, every access trapped
+ * (SIGSEGV on access, SIGTRAP after single step of access instruction),
+ * model: MSB first calculation, input reversal (by byte/half word/word), output reversal, INIT on RESET
+ * Firmware crc32_init/crc32_calc (NANOVNA_STM32_F072/crc.c) run on this model
+ * (x86-64 Linux: page fault error code and trap flag in ucontext)
+ */
+uint8_t  host_crc_page[4096] __attribute__((aligned(4096)));
+static volatile uint32_t host_crc_bytes;   // bytes processed by unit
+static volatile uint32_t host_crc_errors;  // access not supported by model (reversal wider as write, not 8/32 bit write)
+static uint32_t host_crc_state;
+static int32_t  host_crc_write = -1;  // trapped write register offset
+static uint32_t host_crc_size;        // trapped write size
+
+static uint32_t host_bit_rev(uint32_t v, uint32_t bits)
+{
+  uint32_t r = 0;
+  for (uint32_t i = 0; i < bits; i++, v>>= 1)
+    r = (r << 1) | (v & 1);
+  return r;
+}
+
+static void host_crc_data(uint32_t data, uint32_t size)
+{
+  uint32_t bits = size * 8, rev = 0;
+  switch (CRC->CR & CRC_CR_REV_IN) {
+    case CRC_CR_REV_IN_0: rev =  8; break;
+    case CRC_CR_REV_IN_1: rev = 16; break;
+    case CRC_CR_REV_IN:   rev = 32; break;
+  }
+  if (rev > bits) {host_crc_errors++; return;}  // reversal unit wider as write, not used
+  if (rev) {
+    uint32_t d = 0;
+    for (uint32_t i = 0; i < bits; i+= rev)
+      d|= host_bit_rev(data >> i, rev) << i;
+    data = d;
+  }
+  host_crc_state^= data << (32 - bits);
+  while (bits--)
+    host_crc_state = (host_crc_state << 1) ^ (CRC->POL & -(host_crc_state >> 31));
+  host_crc_bytes+= size;
+}
+
+// Size of store instruction (mov r/m8, mov r/m32, 0x66 prefix for 16 bit)
+static uint32_t host_store_size(const uint8_t *ip)
+{
+  uint32_t size = 4;
+  for (;; ip++) {
+    if (*ip == 0x66) size = 2;
+    else if ((*ip & 0xF0) != 0x40 || (*ip & 0x08)) break; // REX prefix (REX.W not allowed)
+  }
+  if (*ip == 0x88 || *ip == 0xC6) return 1;
+  if (*ip == 0x89 || *ip == 0xC7) return size;
+  return 0;
+}
+
+static void host_crc_fault(int sig, siginfo_t *si, void *context)
+{
+  ucontext_t *uc = context;
+  uint32_t offset = (uint8_t *)si->si_addr - host_crc_page;
+  if (offset >= sizeof(host_crc_page)) {signal(sig, SIG_DFL); return;} // not CRC access, fault again
+  mprotect(host_crc_page, sizeof(host_crc_page), PROT_READ | PROT_WRITE);
+  if (uc->uc_mcontext.gregs[REG_ERR] & 2) {                 // page fault on write
+    host_crc_write = offset;
+    host_crc_size = host_store_size((const uint8_t *)uc->uc_mcontext.gregs[REG_RIP]);
+  }
+  else if (offset == offsetof(CRC_TypeDef, DR))
+    CRC->DR = CRC->CR & CRC_CR_REV_OUT ? host_bit_rev(host_crc_state, 32) : host_crc_state;
+  uc->uc_mcontext.gregs[REG_EFL]|= 0x100;                   // single step access instruction
+}
+
+static void host_crc_step(int sig, siginfo_t *si, void *context)
+{
+  (void)sig; (void)si;
+  ucontext_t *uc = context;
+  uc->uc_mcontext.gregs[REG_EFL]&= ~0x100;
+  if (host_crc_write == offsetof(CRC_TypeDef, DR)) {
+    if (host_crc_size == 1 || host_crc_size == 4) host_crc_data(host_crc_size == 1 ? host_crc_page[0] : CRC->DR, host_crc_size);
+    else host_crc_errors++;
+  }
+  else if (host_crc_write == offsetof(CRC_TypeDef, CR) && (CRC->CR & CRC_CR_RESET)) {
+    host_crc_state = CRC->INIT;
+    CRC->CR&= ~CRC_CR_RESET;
+  }
+  else if (host_crc_write >= 0 && host_crc_size != 4)
+    host_crc_errors++;
+  host_crc_write = -1;
+  mprotect(host_crc_page, sizeof(host_crc_page), PROT_NONE);
+}
+
+// Reset values and trap install before main()
+__attribute__((constructor)) static void host_crc_map(void)
+{
+  struct sigaction sa = {0};
+  sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sa.sa_sigaction = host_crc_fault;
+  sigaction(SIGSEGV, &sa, NULL);
+  sa.sa_sigaction = host_crc_step;
+  sigaction(SIGTRAP, &sa, NULL);
+  CRC->DR = CRC->INIT = host_crc_state = 0xFFFFFFFF;
+  CRC->POL = 0x04C11DB7;
+  mprotect(host_crc_page, sizeof(host_crc_page), PROT_NONE);
+}
+
+#include "NANOVNA_STM32_F072/crc.c"
+
+#define TEST_MAX_LEN 300
+static uint32_t buf[TEST_MAX_LEN / sizeof(uint32_t) + 1];
+
+static void fill_random(void *p, uint32_t len)
+{
+  uint8_t *b = p;
+  while (len--) *b++ = rand();
+}
+
+static void test_check_value(void)
+{
+  memcpy(buf, "123456789", 9);
+  uint32_t unit = ~crc32_calc(0xFFFFFFFF, buf, 9);
+  uint32_t soft = ~crc32_soft(0xFFFFFFFF, buf, 9);
+  CHECK(unit == 0xCBF43926, "unit check value 0x%08X", unit);
+  CHECK(soft == 0xCBF43926, "software check value 0x%08X", soft);
+}
+
+static void test_random(void)
+{
+  uint32_t bytes = host_crc_bytes, total = 0, fail = 0;
+  srand(1);
+  for (uint32_t len = 0; len <= TEST_MAX_LEN; len++) {
+    for (int n = 0; n < 4; n++) {
+      fill_random(buf, len);
+      if (crc32_calc(0xFFFFFFFF, buf, len) != crc32_soft(0xFFFFFFFF, buf, len)) fail++;
+      total+= len;
+    }
+  }
+  CHECK(fail == 0, "random: %d buffers mismatch", fail);
+  CHECK(host_crc_bytes - bytes == total, "random: %d bytes processed by unit, need %d", host_crc_bytes - bytes, total);
+}
+
+static void test_continue(void)
+{
+  uint32_t fail = 0;
+  srand(2);
+  for (int n = 0; n < 1000; n++) {
+    uint32_t len = rand() % (TEST_MAX_LEN + 1);
+    uint32_t split = (rand() % (len + 1)) & ~3;  // continue data must be aligned
+    fill_random(buf, len);
+    uint32_t unit = crc32_calc(crc32_calc(0xFFFFFFFF, buf, split), (uint8_t *)buf + split, len - split);
+    uint32_t soft = crc32_soft(crc32_soft(0xFFFFFFFF, buf, split), (uint8_t *)buf + split, len - split);
+    if (unit != soft || unit != crc32_soft(0xFFFFFFFF, buf, len)) fail++;
+  }
+  CHECK(fail == 0, "continue: %d buffers mismatch", fail);
+}
+
+static void test_journal_crc(void)
+{
+  journal_record_t *r = (journal_record_t *)buf;
+  uint32_t fail = 0;
+  srand(3);
+  for (int n = 0; n < 100; n++) {
+    fill_random(buf, sizeof(buf));
+    r->size = (rand() % (TEST_MAX_LEN - sizeof(*r))) & ~3;
+    uint32_t unit = ~crc32_calc(crc32_calc(0xFFFFFFFF, r, offsetof(journal_record_t, crc)), r + 1, r->size);
+    if (journal_record_crc(r) != unit) fail++;
+  }
+  CHECK(fail == 0, "journal: %d records crc mismatch", fail);
+}
+
+int main(void)
+{
+  crc32_init();
+  test_check_value();
+  test_random();
+  test_continue();
+  test_journal_crc();
+  CHECK(host_crc_errors == 0, "%d CRC unit access not supported by model", host_crc_errors);
+  printf("crc: unit model %d bytes processed\n", host_crc_bytes);
+  return host_test_result("test_crc");
+}
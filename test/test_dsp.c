@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Replay recorded data through firmware dsp.c and calibration (main.c), compare with golden output
+ *  *.dump  - 'dump 2' command output (python/dsp_replay.py record), header lines:
+ *            kernel: m0 (F072) or m4 (F303), freq: Hz, if: IF Hz, expect: re im (optional, true gamma)
+ *            replay dsp_process/calculate_gamma on samples and compare with device gamma, ampl, ref
+ *  cal_*.txt - raw calibration standards and DUT data with golden corrected S11/S21
+ *            replay cal_done, cal_interpolate, apply_CH0/CH1_error_term
+ * Run in test/data folder
+ *   test_dsp      - replay all files
+ *   test_dsp -g   - generate synthetic *.dump (for current target kernel) and cal_*.txt files
+ */
+#include <glob.h>
+#include "host.h"
+#define main vna_main
+#define div  vna_div     // not conflict with stdlib.h div()
+#include "main.c"
+#undef main
+#undef div
+
+#ifdef __USE_DSP__
+#define DSP_KERNEL "m4"
+#else
+#define DSP_KERNEL "m0"
+#endif
+
+#define DUMP_LEN_MAX   (4 * AUDIO_BUFFER_LEN)
+typedef struct {
+  char kernel[8];
+  uint32_t freq;
+  int32_t  offset;
+  int      have_expect;
+  float    expect[2];
+  int      samples_count;
+  int      table_count;
+  int16_t  samples[DUMP_LEN_MAX] __attribute__((aligned(4)));
+  int16_t  table[DUMP_LEN_MAX];
+  float    golden[6];                 // gamma, ampl, ref
+} dump_t;
+
+static bool dump_load(const char *name, dump_t *d)
+{
+  FILE *f = fopen(name, "r");
+  if (f == NULL) return false;
+  char line[256];
+  int16_t *dst = d->samples;
+  int *count = &d->samples_count, golden = 0;
+  memset(d, 0, sizeof(*d));
+  while (fgets(line, sizeof(line), f)) {
+    char *p = line, *end;
+    if (sscanf(line, "kernel: %7s", d->kernel) == 1) continue;
+    if (sscanf(line, "freq: %u", &d->freq) == 1) continue;
+    if (sscanf(line, "if: %d", &d->offset) == 1) continue;
+    if (sscanf(line, "expect: %f %f", &d->expect[0], &d->expect[1]) == 2) {d->have_expect = 1; continue;}
+    if (strncmp(line, "table:", 6) == 0) {dst = d->table; count = &d->table_count; continue;}
+    if (sscanf(line, "gamma: %f %f", &d->golden[0], &d->golden[1]) == 2) {golden|= 1; continue;}
+    if (sscanf(line, "ampl: %f %f",  &d->golden[2], &d->golden[3]) == 2) {golden|= 2; continue;}
+    if (sscanf(line, "ref: %f %f",   &d->golden[4], &d->golden[5]) == 2) {golden|= 4; continue;}
+    for (long v = strtol(p, &end, 10); end != p && *count < DUMP_LEN_MAX; v = strtol(p, &end, 10)) {
+      dst[(*count)++] = v;
+      p = end;
+    }
+  }
+  fclose(f);
+  return golden == 7 && d->table_count > 0 && d->samples_count % d->table_count == 0;
+}
+
+// Same as cmd_dump golden calculation
+static void dump_process(int16_t *samples, int count, float result[6])
+{
+  uint8_t if_filter = config._if_filter;
+  config._if_filter = IF_FILTER_RECT;
+  reset_dsp_accumerator();
+  for (int i = 0; i < count; i+= ADC_BUFFER_LEN)
+    dsp_process(&samples[i], ADC_BUFFER_LEN);
+  calculate_gamma(&result[0]);
+  fetch_amplitude(&result[2]);
+  fetch_amplitude_ref(&result[4]);
+  config._if_filter = if_filter;
+  reset_dsp_accumerator();
+}
+
+static void dsp_set_offset(int32_t offset)
+{
+  if (offset == 0) offset = IF_OFFSET;
+#ifdef USE_VARIABLE_OFFSET
+  generate_DSP_Table(offset);
+#else
+  (void)offset;
+#endif
+}
+
+static void replay_dump(const char *name)
+{
+  static dump_t d;
+  if (!dump_load(name, &d)) {CHECK(0, "%s: bad dump file", name); return;}
+  if (strcmp(d.kernel, DSP_KERNEL) != 0) return;          // Other target kernel capture
+  dsp_set_offset(d.offset);
+  const int16_t *table = dsp_get_sincos_table();
+  CHECK(d.table_count == ADC_BUFFER_LEN && memcmp(table, d.table, d.table_count * sizeof(int16_t)) == 0,
+        "%s: sin/cos table not same as firmware (other IF or ADC profile)", name);
+  float r[6];
+  uint64_t t = host_cycles();
+  dump_process(d.samples, d.samples_count, r);
+  t = host_cycles() - t;
+  for (int i = 0; i < 6; i++) {
+    // device print values with 9 digits after point
+    float err = fabsf(r[i] - d.golden[i]);
+    CHECK(err <= 1e-5f * fabsf(d.golden[i]) + 2e-9f, "%s: value %d = %.9f, golden %.9f", name, i, r[i], d.golden[i]);
+  }
+  if (d.have_expect) {
+    float err = hypotf(r[0] - d.expect[0], r[1] - d.expect[1]);
+    CHECK(err < 1e-3f, "%s: gamma %f %f, expect %f %f", name, r[0], r[1], d.expect[0], d.expect[1]);
+  }
+  printf("%s: %u Hz gamma %.6f %.6f (%d buffers in %u host cycles)\n", name, d.freq, r[0], r[1],
+         d.samples_count / ADC_BUFFER_LEN, (uint32_t)t);
+}
+
+/*
+ * Calibration replay file
+ */
+enum {COL_OPEN = 0, COL_SHORT, COL_LOAD, COL_THRU_S11, COL_THRU, COL_ISOLN, COL_DUT_S11, COL_DUT_S21, COL_GOLD_S11, COL_GOLD_S21, COL_TRUE_S11, COL_TRUE_S21, COL_COUNT};
+typedef struct {
+  freq_t   start, stop;
+  uint16_t points;
+  uint16_t status;
+  uint16_t check;          // 1 - check S11 with true, 2 - check S21 with true
+  float    v[POINTS_COUNT][COL_COUNT][2];
+} cal_file_t;
+
+static const char *cal_std_name[] = {"load", "open", "short", "thru", "isoln", "enhanced", NULL};
+static const uint16_t cal_std_flag[] = {CALSTAT_LOAD, CALSTAT_OPEN, CALSTAT_SHORT, CALSTAT_THRU, CALSTAT_ISOLN, CALSTAT_ENHANCED_RESPONSE};
+
+// Parse standards (status) or check list
+static void cal_parse_list(char *list, cal_file_t *c)
+{
+  for (char *t = strtok(list, " \r\n"); t; t = strtok(NULL, " \r\n")) {
+    for (int i = 0; cal_std_name[i]; i++)
+      if (strcmp(t, cal_std_name[i]) == 0) c->status|= cal_std_flag[i];
+    if (strcmp(t, "s11") == 0) c->check|= 1;
+    if (strcmp(t, "s21") == 0) c->check|= 2;
+  }
+}
+
+static bool cal_file_load(const char *name, cal_file_t *c)
+{
+  FILE *f = fopen(name, "r");
+  if (f == NULL) return false;
+  char line[1024];
+  int n = 0;
+  memset(c, 0, sizeof(*c));
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') continue;
+    if (sscanf(line, "start: %u", &c->start) == 1) continue;
+    if (sscanf(line, "stop: %u", &c->stop) == 1) continue;
+    if (sscanf(line, "points: %hu", &c->points) == 1) continue;
+    if (strncmp(line, "status:", 7) == 0 || strncmp(line, "check:", 6) == 0) {
+      cal_parse_list(strchr(line, ':') + 1, c);
+      continue;
+    }
+    if (n >= c->points || n >= POINTS_COUNT) continue;
+    char *p = line, *end;
+    float *v = &c->v[n][0][0];
+    int i;
+    for (i = 0; i < COL_COUNT * 2; i++, p = end) {
+      v[i] = strtof(p, &end);
+      if (end == p) break;
+    }
+    if (i == COL_COUNT * 2) n++;
+  }
+  fclose(f);
+  return c->points > 1 && n == c->points;
+}
+
+// Made calibration as cal_collect + cal_done (raw standards from file)
+static void cal_file_calibrate(cal_file_t *c)
+{
+  load_default_properties();
+  current_props._frequency0 = c->start;
+  current_props._frequency1 = c->stop;
+  current_props._sweep_points = c->points;
+  update_frequencies();
+  cal_frequency0 = c->start;
+  cal_frequency1 = c->stop;
+  cal_sweep_points = c->points;
+  cal_status = c->status & (CALSTAT_LOAD|CALSTAT_OPEN|CALSTAT_SHORT|CALSTAT_THRU|CALSTAT_ISOLN|CALSTAT_ENHANCED_RESPONSE);
+  static const uint8_t col[CAL_TYPE_COUNT] = {[CAL_LOAD] = COL_LOAD, [CAL_OPEN] = COL_OPEN, [CAL_SHORT] = COL_SHORT, [CAL_THRU] = COL_THRU, [CAL_ISOLN] = COL_ISOLN};
+  for (int i = 0; i < c->points; i++) {
+    for (int t = 0; t < CAL_TYPE_COUNT; t++) {
+      cal_data[t][i][0] = c->v[i][col[t]][0];
+      cal_data[t][i][1] = c->v[i][col[t]][1];
+    }
+    measured[0][i][0] = c->v[i][COL_THRU_S11][0];
+    measured[0][i][1] = c->v[i][COL_THRU_S11][1];
+  }
+  if ((cal_status & (CALSTAT_THRU|CALSTAT_ENHANCED_RESPONSE)) == (CALSTAT_THRU|CALSTAT_ENHANCED_RESPONSE))
+    eterm_thru_load_match();
+  cal_done();
+}
+
+// Apply calibration as sweep on DUT data
+static void cal_file_apply(cal_file_t *c, int i, float data[4])
+{
+  float c_data[CAL_TYPE_COUNT][2];
+  data[0] = c->v[i][COL_DUT_S11][0]; data[1] = c->v[i][COL_DUT_S11][1];
+  data[2] = c->v[i][COL_DUT_S21][0]; data[3] = c->v[i][COL_DUT_S21][1];
+  cal_interpolate(i, getFrequency(i), c_data);
+  apply_CH0_error_term(data, c_data);
+  apply_CH1_error_term(data, c_data);
+  if (cal_status & CALSTAT_ENHANCED_RESPONSE)
+    apply_CH1_source_match(data, c_data);
+}
+
+static void replay_cal(const char *name)
+{
+  static cal_file_t c;
+  if (!cal_file_load(name, &c)) {CHECK(0, "%s: bad cal file", name); return;}
+  if (c.points > POINTS_COUNT) return;
+  cal_file_calibrate(&c);
+  float max_gold = 0.0f, max_true = 0.0f;
+  for (int i = 0; i < c.points; i++) {
+    float data[4];
+    cal_file_apply(&c, i, data);
+    for (int j = 0; j < 2; j++) {
+      float *g = c.v[i][COL_GOLD_S11 + j], *t = c.v[i][COL_TRUE_S11 + j];
+      float e = hypotf(data[2*j] - g[0], data[2*j+1] - g[1]);
+      if (e > max_gold) max_gold = e;
+      CHECK(e <= 1e-5f * hypotf(g[0], g[1]) + 1e-6f, "%s: point %d S%d1 %.7f %.7f, golden %.7f %.7f", name, i, j+1, data[2*j], data[2*j+1], g[0], g[1]);
+      if (!(c.check & (1<<j))) continue;
+      e = hypotf(data[2*j] - t[0], data[2*j+1] - t[1]);
+      if (e > max_true) max_true = e;
+      CHECK(e < 2e-3f, "%s: point %d S%d1 %.5f %.5f, true %.5f %.5f", name, i, j+1, data[2*j], data[2*j+1], t[0], t[1]);
+    }
+  }
+  printf("%s: %d points, max error to golden %.3g, to true %.3g\n", name, c.points, max_gold, max_true);
+}
+
+/*
+ * Synthetic data generator
+ */
+#include <complex.h>
+typedef double complex cplx;
+
+static double gen_noise(void) {return (rand() / (double)RAND_MAX - 0.5) * 2.0;}
+
+// Write synthetic 'dump 2' output: ref = A*cos(w*n + p), samp = gamma * ref, noise and quantization
+static void gen_dump(const char *name, uint32_t freq, double level, cplx gamma, double noise)
+{
+  static int16_t samples[2 * AUDIO_BUFFER_LEN] __attribute__((aligned(4)));
+  int count = 2 * ADC_BUFFER_LEN;
+  dsp_set_offset(0);
+  double w = 2 * M_PI * IF_OFFSET / ADC_FREQ, p = gen_noise() * M_PI;
+  for (int n = 0; n < count / 2; n++) {
+    cplx ref = level * cexp(I * (w * n + p));
+    cplx smp = gamma * ref;
+    samples[2*n+0] = lrint(creal(ref) + noise * gen_noise());
+    samples[2*n+1] = lrint(creal(smp) + noise * gen_noise());
+  }
+  float r[6];
+  dump_process(samples, count, r);
+  FILE *f = fopen(name, "w");
+  fprintf(f, "kernel: %s\nfreq: %u\nif: %d\n", DSP_KERNEL, freq, IF_OFFSET);
+  // DSP use sin/cos table (phase of sample * sin/cos), result gamma is conjugated to cexp phase
+  fprintf(f, "expect: %.9f %.9f\n", creal(gamma), -cimag(gamma));
+  for (int i = 0; i < count; i++)
+    fprintf(f, "%6d %s", samples[i], (i % 12) == 11 ? "\n" : "");
+  const int16_t *table = dsp_get_sincos_table();
+  fprintf(f, "table:\n");
+  for (int i = 0; i < ADC_BUFFER_LEN; i++)
+    fprintf(f, "%6d %s", table[i], (i % 12) == 11 ? "\n" : "");
+  fprintf(f, "gamma: %.9f %.9f\nampl: %.9f %.9f\nref: %.9f %.9f\n", r[0], r[1], r[2], r[3], r[4], r[5]);
+  fclose(f);
+}
+
+// Error model of 1 path 2 port VNA (forward only)
+static cplx gen_term(double a, double tau, double f) {return a * cexp(-I * 2 * M_PI * f * tau);}
+static void gen_cal(const char *name, const char *status, const char *check, bool one_port_ed, bool port2_match)
+{
+  freq_t start = 50000, stop = 900000000;
+  int points = POINTS_COUNT < 101 ? POINTS_COUNT : 101;
+  static cal_file_t c;
+  memset(&c, 0, sizeof(c));
+  c.start = start; c.stop = stop; c.points = points;
+  FILE *f = fopen(name, "w");
+  fprintf(f, "# Synthetic calibration replay (test_dsp -g), columns re im:\n");
+  fprintf(f, "# open short load thru_s11 thru isoln dut_s11 dut_s21 golden_s11 golden_s21 true_s11 true_s21\n");
+  fprintf(f, "start: %u\nstop: %u\npoints: %d\nstatus: %s\ncheck: %s\n", start, stop, points, status, check);
+  for (int i = 0; i < points; i++) {
+    double fr = start + (double)(stop - start) * i / (points - 1);
+    cplx ed = one_port_ed ? gen_term(0.03, 0.3e-9, fr) : 0;
+    cplx es = gen_term(0.08, 0.5e-9, fr), er = gen_term(0.85, 1.2e-9, fr);
+    cplx et = gen_term(0.80, 1.5e-9, fr), ex = one_port_ed ? 2e-5 : 0;
+    cplx el = port2_match ? gen_term(0.05, 0.7e-9, fr) : 0;
+    // DUT: S11 = 0.5 exp(-jw 1ns), S21 = S12 = 0.1 exp(-jw 2ns), S22 = 0
+    cplx s11 = gen_term(0.5, 1e-9, fr), s21 = gen_term(0.1, 2e-9, fr);
+#define M11(g) (ed + er * (g) / (1.0 - es * (g)))
+    cplx v[COL_COUNT];
+    v[COL_OPEN]  = M11(1.0);
+    v[COL_SHORT] = M11(-1.0);
+    v[COL_LOAD]  = M11(0.0);
+    v[COL_THRU_S11] = M11(el);
+    v[COL_THRU]  = ex + et / (1.0 - es * el);
+    v[COL_ISOLN] = ex;
+    v[COL_DUT_S11] = M11(s11 + s21 * s21 * el);
+    v[COL_DUT_S21] = ex + et * s21 / (1.0 - es * s11 - es * el * s21 * s21);
+    v[COL_TRUE_S11] = s11;
+    v[COL_TRUE_S21] = s21;
+#undef M11
+    for (int j = 0; j < COL_COUNT; j++) {
+      c.v[i][j][0] = creal(v[j]);
+      c.v[i][j][1] = cimag(v[j]);
+    }
+  }
+  fclose(f);
+  char list[64];
+  strcpy(list, status);
+  cal_parse_list(list, &c);
+  cal_file_calibrate(&c);
+  f = fopen(name, "a");
+  for (int i = 0; i < points; i++) {
+    float data[4];
+    cal_file_apply(&c, i, data);
+    c.v[i][COL_GOLD_S11][0] = data[0]; c.v[i][COL_GOLD_S11][1] = data[1];
+    c.v[i][COL_GOLD_S21][0] = data[2]; c.v[i][COL_GOLD_S21][1] = data[3];
+    for (int j = 0; j < COL_COUNT; j++)
+      fprintf(f, "% .9e % .9e ", c.v[i][j][0], c.v[i][j][1]);
+    fprintf(f, "\n");
+  }
+  fclose(f);
+}
+
+static void generate(void)
+{
+  srand(1);
+  gen_dump("dsp_" DSP_KERNEL "_open.dump",  10000000, 12000.0, 0.95 * cexp(-I * 0.3), 4.0);
+  gen_dump("dsp_" DSP_KERNEL "_load.dump", 100000000, 12000.0, 0.01 * cexp( I * 2.0), 4.0);
+  gen_dump("dsp_" DSP_KERNEL "_full.dump", 500000000, 30000.0, 0.70 * cexp( I * 1.0), 16.0);
+  gen_dump("dsp_" DSP_KERNEL "_weak.dump", 900000000,   800.0, 0.30 * cexp(-I * 2.5), 2.0);
+#ifndef __USE_DSP__
+  // Cal replay files same for all targets, generate once
+  gen_cal("cal_solt.txt",     "open short load thru isoln",          "s11",     true,  false);
+  gen_cal("cal_enhanced.txt", "open short load thru isoln enhanced", "s11 s21", true,  true);
+  gen_cal("cal_response.txt", "open short thru",                     "s11",     false, false);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1 && strcmp(argv[1], "-g") == 0) {
+    generate();
+    return 0;
+  }
+  glob_t g;
+  if (glob("*.dump", 0, NULL, &g) == 0) {
+    for (size_t i = 0; i < g.gl_pathc; i++) replay_dump(g.gl_pathv[i]);
+    globfree(&g);
+  }
+  if (glob("cal_*.txt", 0, NULL, &g) == 0) {
+    for (size_t i = 0; i < g.gl_pathc; i++) replay_cal(g.gl_pathv[i]);
+    globfree(&g);
+  }
+  CHECK(host_test_count > 0, "no replay data found");
+  return host_test_result("test_dsp");
+}
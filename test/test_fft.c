@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * FFT tests (vna_math.c), build for every FFT_SIZE (256 ... 2048, test_fftXXX):
+ *  twiddles         - sin table (256, 512) or vna_sincosf (1024, 2048) vs double sin/cos
+ *  fft              - forward/inverse vs double precision DFT, round trip
+ *  fft_real_inverse - real output inverse FFT vs complex fft_inverse on conjugate symmetric
+ *                     spectrum and vs double precision inverse DFT
+ *  host cycles      - radix-2^2 kernel vs previous radix-2 kernel (host only, not CPU timings)
+ * Error is relative RMS: |y - ref| / |ref|, bound from float rounding and twiddle error on every stage
+ */
+#include <float.h>
+#include "host.h"
+#include "vna_math.c"
+
+static double rnd(void) {return (rand() / (double)RAND_MAX - 0.5) * 2.0;}
+
+// Max twiddle error (sin table interpolation or vna_sincosf, both ~4e-7)
+#define TWIDDLE_ERROR   5e-7
+
+static float  data[FFT_SIZE][2];
+static float  full[FFT_SIZE][2];
+static double ref[FFT_SIZE][2];
+
+// Double precision DFT, dir = forward: 0, inverse: 1 (not scaled)
+static void dft(const float in[][2], double out[][2], int n, int dir)
+{
+  static double w[FFT_SIZE][2];
+  for (int k = 0; k < n; k++) {
+    w[k][0] = cos(2 * M_PI * k / n);
+    w[k][1] = sin(2 * M_PI * k / n) * (dir ? 1.0 : -1.0);
+  }
+  for (int k = 0; k < n; k++) {
+    double re = 0, im = 0;
+    for (int j = 0; j < n; j++) {
+      const double c = w[(j * k) % n][0], s = w[(j * k) % n][1];
+      re+= in[j][0] * c - in[j][1] * s;
+      im+= in[j][0] * s + in[j][1] * c;
+    }
+    out[k][0] = re;
+    out[k][1] = im;
+  }
+}
+
+// Max twiddle error vs double sin/cos
+static double twiddle_error(void)
+{
+  double max = 0;
+  for (int k = 0; k < FFT_SIZE; k++) {
+    float c, s;
+    fft_twiddle(k, &c, &s);
+    double e = hypot(c - cos(2 * M_PI * k / FFT_SIZE), s - sin(2 * M_PI * k / FFT_SIZE));
+    if (e > max) max = e;
+  }
+  return max;
+}
+
+// Relative RMS error of n values (step 1 - real part only, 2 - complex)
+static double rms_error(const float *v, const double *r, int n, int step)
+{
+  double e = 0, a = 0;
+  for (int i = 0; i < n * 2; i+= step) {
+    e+= (v[i] - r[i]) * (v[i] - r[i]);
+    a+= r[i] * r[i];
+  }
+  return sqrt(e / a);
+}
+
+// RMS error bound for 2^levels transform: every stage add float rounding (complex multiply and add)
+// and twiddle error, not correlated errors of stages sum as sqrt(stages)
+static double fft_bound(int levels, double twiddle)
+{
+  return sqrt(levels + 1) * (2 * FLT_EPSILON + twiddle);
+}
+
+/*
+ * Real output inverse FFT (lowpass time domain): spectrum FFT_SIZE/2 + 1 bins
+ */
+enum {SPECTRUM_RANDOM = 0, SPECTRUM_STEP, SPECTRUM_IMPULSE, SPECTRUM_COUNT};
+static const char *spectrum_name[] = {"random", "lowpass step", "impulse"};
+
+static void fill_spectrum(int type)
+{
+  const int n = FFT_SIZE / 2;
+  memset(data, 0, sizeof(data));
+  for (int k = 0; k <= n; k++) {
+    switch (type) {
+      case SPECTRUM_RANDOM:  data[k][0] = rnd(); data[k][1] = rnd(); break;
+      // Measured S11 as lowpass input: delay line with loss, window applied, zero after points count
+      case SPECTRUM_STEP:
+        if (k < 101) {
+          double w = 0.5 + 0.5 * cos(M_PI * k / 101), a = 2 * M_PI * k * 0.07;
+          data[k][0] = w * 0.8 * cos(a) * exp(-0.002 * k);
+          data[k][1] =-w * 0.8 * sin(a) * exp(-0.002 * k);
+        }
+        break;
+      case SPECTRUM_IMPULSE: data[k][0] = 1.0f; break;
+    }
+  }
+  // Imaginary part of bin 0 and FFT_SIZE/2 ignored (test it)
+  if (type == SPECTRUM_RANDOM) {data[0][1] = 5.0f; data[n][1] = -5.0f;}
+  // Full conjugate symmetric spectrum
+  memcpy(full, data, sizeof(data));
+  full[0][1] = full[n][1] = 0;
+  for (int k = 1; k < n; k++) {
+    full[FFT_SIZE - k][0] = full[k][0];
+    full[FFT_SIZE - k][1] =-full[k][1];
+  }
+}
+
+static void test_real_inverse(double twiddle)
+{
+  double bound = fft_bound(FFT_N, twiddle), max_c = 0, max_r = 0;
+  for (int type = 0; type < SPECTRUM_COUNT; type++) {
+    for (int pass = 0; pass < (type == SPECTRUM_RANDOM ? 10 : 1); pass++) {
+      fill_spectrum(type);
+      dft(full, ref, FFT_SIZE, 1);
+      fft_real_inverse(data);
+      fft_inverse(full);
+      // Real output in place
+      static float real[FFT_SIZE][2];
+      for (int i = 0; i < FFT_SIZE; i++) {
+        real[i][0] = ((float *)data)[i];
+        real[i][1] = 0;
+      }
+      double e = rms_error(&real[0][0], &ref[0][0], FFT_SIZE, 2);
+      CHECK(e < bound, "%s: real inverse error %g > %g", spectrum_name[type], e, bound);
+      if (e > max_r) max_r = e;
+      // Complex inverse: real part, imaginary part zero
+      e = rms_error(&full[0][0], &ref[0][0], FFT_SIZE, 1);
+      CHECK(e < bound, "%s: complex inverse error %g > %g", spectrum_name[type], e, bound);
+      if (e > max_c) max_c = e;
+      // Real and complex result near
+      double d = 0, a = 0;
+      for (int i = 0; i < FFT_SIZE; i++) {
+        d+= (real[i][0] - full[i][0]) * (real[i][0] - full[i][0]) + full[i][1] * full[i][1];
+        a+= ref[i][0] * ref[i][0];
+      }
+      CHECK(sqrt(d / a) < 2 * bound, "%s: real vs complex inverse difference %g", spectrum_name[type], sqrt(d / a));
+    }
+  }
+  printf("fft_real_inverse %d: max error %.3g (complex fft_inverse %.3g, bound %.3g, twiddle error %.3g)\n", FFT_SIZE, max_r, max_c, bound, twiddle);
+}
+
+/*
+ * Complex FFT vs double DFT
+ */
+static void test_fft(double twiddle)
+{
+  double bound = fft_bound(FFT_N, twiddle), max_f = 0, max_i = 0, max_r = 0;
+  static float src[FFT_SIZE][2];
+  for (int pass = 0; pass < 5; pass++) {
+    for (int i = 0; i < FFT_SIZE; i++) {
+      src[i][0] = rnd();
+      src[i][1] = rnd();
+    }
+    // Forward
+    memcpy(data, src, sizeof(data));
+    dft(data, ref, FFT_SIZE, 0);
+    fft_forward(data);
+    double e = rms_error(&data[0][0], &ref[0][0], FFT_SIZE, 1);
+    CHECK(e < bound, "fft_forward error %g > %g", e, bound);
+    if (e > max_f) max_f = e;
+    // Inverse of forward result (not scaled), round trip result N * src
+    memcpy(full, data, sizeof(data));
+    dft(full, ref, FFT_SIZE, 1);
+    fft_inverse(data);
+    e = rms_error(&data[0][0], &ref[0][0], FFT_SIZE, 1);
+    CHECK(e < bound, "fft_inverse error %g > %g", e, bound);
+    if (e > max_i) max_i = e;
+    for (int i = 0; i < FFT_SIZE; i++) {
+      ref[i][0] = src[i][0] * FFT_SIZE;
+      ref[i][1] = src[i][1] * FFT_SIZE;
+    }
+    e = rms_error(&data[0][0], &ref[0][0], FFT_SIZE, 1);
+    CHECK(e < 2 * bound, "round trip error %g > %g", e, 2 * bound);
+    if (e > max_r) max_r = e;
+  }
+  printf("fft %d: forward error %.3g, inverse %.3g, round trip %.3g (bound %.3g)\n", FFT_SIZE, max_f, max_i, max_r, bound);
+}
+
+/*
+ * Previous Cooley-Tukey radix-2 kernel (before radix-2^2), for compare speed on host
+ */
+static void old_fft(float array[][2], const uint8_t dir) {
+  const uint16_t n = FFT_SIZE;
+  uint16_t i, j;
+  for (i = 0; i < n; i++) {
+    uint16_t x = i, r = 0;
+    for (j = 0; j < FFT_N; j++, x >>= 1)
+      r = (r << 1) | (x & 1U);
+    if (r > i) {
+      SWAP(float, array[i][0], array[r][0]);
+      SWAP(float, array[i][1], array[r][1]);
+    }
+  }
+  uint16_t halfsize = 1;
+  uint16_t tablestep = FFT_SIZE / 2;
+  for (;halfsize < n; tablestep>>=1, halfsize<<=1) {
+    for (i = 0; i < n; i+= halfsize) {
+      for (j = 0; j < FFT_SIZE / 2; i++, j+= tablestep) {
+        const uint16_t l = i + halfsize;
+        float c, s;
+        fft_twiddle(j, &c, &s);
+        if (!dir) s = -s;
+        const float tpre = array[l][0] * c - array[l][1] * s;
+        const float tpim = array[l][0] * s + array[l][1] * c;
+        array[l][0] = array[i][0] - tpre; array[i][0]+= tpre;
+        array[l][1] = array[i][1] - tpim; array[i][1]+= tpim;
+      }
+    }
+  }
+}
+
+// Min of host cycles on runs (host timings only, not equal Cortex M0/M4 cycles)
+static uint32_t fft_cycles(void (*f)(float array[][2], const uint8_t dir), const float src[][2])
+{
+  uint64_t min = UINT64_MAX;
+  for (int run = 0; run < 50; run++) {
+    memcpy(data, src, sizeof(data));
+    uint64_t t = host_cycles();
+    f(data, 0);
+    t = host_cycles() - t;
+    if (t < min) min = t;
+  }
+  return min;
+}
+
+static void test_speed(void)
+{
+  static float src[FFT_SIZE][2];
+  for (int i = 0; i < FFT_SIZE; i++) {
+    src[i][0] = rnd();
+    src[i][1] = rnd();
+  }
+  // Old kernel give some result
+  memcpy(full, src, sizeof(full));
+  old_fft(full, 0);
+  dft(src, ref, FFT_SIZE, 0);
+  double e = rms_error(&full[0][0], &ref[0][0], FFT_SIZE, 1);
+  CHECK(e < fft_bound(FFT_N, TWIDDLE_ERROR), "old fft error %g", e);
+  uint32_t t_new = fft_cycles(fft, src), t_old = fft_cycles(old_fft, src);
+  printf("fft %d: host cycles %u, previous radix-2 %u (host timings)\n", FFT_SIZE, t_new, t_old);
+}
+
+int main(void)
+{
+  srand(1);
+  double twiddle = twiddle_error();
+  CHECK(twiddle < TWIDDLE_ERROR, "twiddle error %g", twiddle);
+  test_fft(twiddle);
+  test_real_inverse(twiddle);
+  test_speed();
+  return host_test_result("test_fft");
+}
@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Flash journal tests (data_storage.c) on RAM backed flash:
+ *  save/recall   - all cal slots and config after reboot (log replay)
+ *  torn record   - power loss on every stage of record write, previous record used
+ *  bad crc       - corrupted last record, previous record used
+ *  full area     - many saves one slot (blocks wrap) and random saves: page erases per save not more fixed slot
+ *                  layout, other records never relocated
+ *  reuse power loss - power loss on every stage of save to reused block and config save with page switch
+ *  boot crc      - crc checked data on boot load (config and one slot) with all slots saved
+ *  fast resume   - boot with journal state from backup registers, replay on bad state crc, newer records
+ *                  (backup not updated), power loss on commit and erased flash
+ * After every reboot all slots checked, not allowed program on not erased flash
+ */
+#include "host.h"
+#include "data_storage.c"
+
+#ifndef __USE_FLASH_JOURNAL__
+#error "Test require __USE_FLASH_JOURNAL__"
+#endif
+
+// Saved generation for every slot and config (0 - not saved)
+static uint32_t slot_gen[SAVEAREA_MAX];
+static uint32_t config_gen;
+// Slot data generation allowed after power loss while save it (old or new)
+static int      torn_id = -1;
+static uint32_t torn_gen;
+
+// Cal data values exactly represented in float16 (multiple of 1/8 below 256)
+static float pattern(uint32_t id, uint32_t gen, uint32_t i)
+{
+  return (float)((id * 7 + gen * 13 + i) % 2048) / 8.0f - 128.0f;
+}
+
+static void slot_fill(uint32_t id, uint32_t gen)
+{
+  float *cal = &cal_data[0][0][0];
+  caldata_reset();
+  current_props._frequency0 = id;
+  current_props._frequency1 = gen;
+  for (uint32_t i = 0; i < CAL_TYPE_COUNT * POINTS_COUNT * 2; i++)
+    cal[i] = pattern(id, gen, i);
+}
+
+static int slot_save(uint32_t id, uint32_t gen)
+{
+  slot_fill(id, gen);
+  int r = caldata_save(id);
+  if (r == 0) slot_gen[id] = gen;
+  return r;
+}
+
+static int save_config(uint32_t gen)
+{
+  config._serial_speed = gen;
+  int r = config_save();
+  if (r == 0) config_gen = gen;
+  return r;
+}
+
+// Simulate power on: RAM state lost, log replayed on first access
+static void reboot(void)
+{
+  journal_seq = 0;
+  cal_in_flash = NULL;
+  lastsaveid = NO_SAVE_SLOT;
+  memset(&config, 0, sizeof(config));
+}
+
+static bool slot_check(uint32_t id, uint32_t gen)
+{
+  if (caldata_recall(id) != 0) return gen == 0;
+  if (current_props._frequency0 != id || current_props._frequency1 != gen) return false;
+  for (int t = 0; t < CAL_TYPE_COUNT; t++)
+    for (int j = 0; j < POINTS_COUNT; j++) {
+      float v[2];
+      caldata_point(t, j, v);
+      uint32_t i = (t * POINTS_COUNT + j) * 2;
+      if (v[0] != pattern(id, gen, i) || v[1] != pattern(id, gen, i + 1)) return false;
+    }
+  return true;
+}
+
+// Check all slots and config as saved
+static void check_all(const char *name)
+{
+  for (uint32_t id = 0; id < SAVEAREA_MAX; id++) {
+    bool ok = slot_check(id, slot_gen[id]);
+    if (!ok && (int)id == torn_id && slot_check(id, torn_gen)) {slot_gen[id] = torn_gen; ok = true;}
+    CHECK(ok, "%s: slot %d gen %d lost (recall %d)", name, id, slot_gen[id], current_props._frequency1);
+  }
+  CHECK(config_recall() == 0 ? config._serial_speed == config_gen : config_gen == 0, "%s: config gen %d lost", name, config_gen);
+  CHECK(host_flash_errors == 0, "%s: %d program on not erased flash", name, host_flash_errors);
+  host_flash_errors = 0;
+  caldata_recall(NO_SAVE_SLOT);
+}
+
+static void format(void)
+{
+  host_flash_erase_all();
+  memset(slot_gen, 0, sizeof(slot_gen));
+  config_gen = 0;
+  torn_id = -1;
+  reboot();
+}
+
+static void test_save_recall(void)
+{
+  format();
+  check_all("empty");
+  for (uint32_t id = 0; id < SAVEAREA_MAX; id++)
+    CHECK(slot_save(id, 1) == 0, "slot %d save", id);
+  CHECK(save_config(1) == 0, "config save");
+  check_all("saved");
+  reboot();
+  check_all("reboot");
+  // In place used slot stay valid after save other
+  CHECK(caldata_recall(1) == 0, "recall");
+  slot_save(2, 2);
+  reboot();
+  check_all("resave");
+}
+
+// Flash operations (program + erase) on save
+static uint32_t flash_ops(void) {return host_flash_writes + host_flash_erases;}
+
+// Power loss on k flash operation while save slot id, return true if power lost
+static bool save_power_loss(uint32_t id, uint32_t gen, int32_t k)
+{
+  torn_id = id;
+  torn_gen = gen;
+  host_flash_countdown = k;
+  if (setjmp(host_power_loss) == 0) {
+    slot_save(id, gen);
+    host_flash_countdown = -1;
+    return false;
+  }
+  host_flash_countdown = -1;
+  return true;
+}
+
+// Snapshot flash state before save, restore it for every power loss point
+static uint8_t  flash_copy[SAVE_FULL_AREA_SIZE];
+static uint32_t gen_copy[SAVEAREA_MAX];
+static void snapshot(void) {memcpy(flash_copy, (void *)SAVE_CONFIG_ADDR, SAVE_FULL_AREA_SIZE); memcpy(gen_copy, slot_gen, sizeof(slot_gen));}
+static void restore(void)  {memcpy((void *)SAVE_CONFIG_ADDR, flash_copy, SAVE_FULL_AREA_SIZE); memcpy(slot_gen, gen_copy, sizeof(slot_gen)); reboot();}
+
+// Power loss on every stage of save (all header, crc and nearest to it operations, every 61 data operation)
+static int power_loss_scan(uint32_t id, uint32_t gen, const char *name)
+{
+  snapshot();
+  uint32_t ops = flash_ops();
+  slot_save(id, gen);
+  ops = flash_ops() - ops;
+  int count = 0;
+  for (uint32_t k = 0; k < ops; k++) {
+    if (k > 16 && k + 16 < ops && k % 61) continue;
+    restore();
+    CHECK(save_power_loss(id, gen, k), "%s: save end before power loss %d", name, k);
+    reboot();
+    check_all(name);
+    // Next saves after power loss
+    torn_id = -1;
+    CHECK(slot_save(id, gen + 1) == 0, "%s: save after power loss %d", name, k);
+    CHECK(slot_save((id + 1) % SAVEAREA_MAX, gen + 1) == 0, "%s: save after power loss %d", name, k);
+    reboot();
+    check_all(name);
+    count++;
+  }
+  return count;
+}
+
+static void test_torn_record(void)
+{
+  // First record of slot, and slot with previous record
+  format();
+  for (uint32_t id = 1; id < SAVEAREA_MAX; id++)
+    slot_save(id, 1);
+  save_config(1);
+  int count = power_loss_scan(0, 1, "torn first record");
+  format();
+  for (uint32_t id = 0; id < SAVEAREA_MAX; id++)
+    slot_save(id, 1);
+  save_config(1);
+  count+= power_loss_scan(3, 2, "torn record");
+  printf("torn record: %d power loss points\n", count);
+}
+
+static void test_bad_crc(void)
+{
+  format();
+  for (uint32_t id = 0; id < SAVEAREA_MAX; id++)
+    slot_save(id, 1);
+  save_config(1);
+  slot_save(2, 2);
+  save_config(2);
+  // Corrupt data (clear bits as flash program) in last slot 2 record and config
+  const journal_record_t *r = JOURNAL_RECORD(journal_index[2]);
+  uint16_t *p = (uint16_t *)(r + 1) + 100;
+  *p&= 0x00FF;
+  r = JOURNAL_RECORD(journal_index[JOURNAL_ID_CONFIG]);
+  p = (uint16_t *)((uint8_t *)(r + 1) + offsetof(config_t, _serial_speed));
+  *p = 0;
+  reboot();
+  slot_gen[2] = 1;
+  config_gen = 1;
+  check_all("bad crc");
+  // Corrupt header only record
+  slot_save(4, 2);
+  r = JOURNAL_RECORD(journal_index[4]);
+  ((journal_record_t *)r)->seq&= 0xFFFF0000;
+  reboot();
+  slot_gen[4] = 1;
+  check_all("bad crc header");
+  // Continue save after bad records
+  for (uint32_t i = 0; i < 50; i++)
+    slot_save(i % SAVEAREA_MAX, 3 + i);
+  reboot();
+  check_all("bad crc resave");
+}
+
+// Page erases per save of fixed slot layout (erase all slot pages on every save)
+#define BASELINE_SLOT_ERASES    ((uint32_t)(JOURNAL_PAGE_CEIL(PROPS_PACKED_SIZE) / FLASH_PAGESIZE))
+#define BASELINE_CONFIG_ERASES  ((uint32_t)(JOURNAL_PAGE_CEIL(sizeof(config_t)) / FLASH_PAGESIZE))
+
+// Save slot (or config if id == SAVEAREA_MAX), return true if other records relocated
+static bool save_moved(uint32_t id, uint32_t gen)
+{
+  uint32_t index[JOURNAL_ID_COUNT];
+  memcpy(index, journal_index, sizeof(index));
+  int r = id < SAVEAREA_MAX ? slot_save(id, gen) : save_config(gen);
+  CHECK(r == 0, "save id %d gen %d fail", id, gen);
+  for (uint32_t i = 0; i < JOURNAL_ID_COUNT; i++)
+    if (i != id && index[i] != journal_index[i]) return true;
+  return false;
+}
+
+static void fill_all(void)
+{
+  format();
+  for (uint32_t id = 0; id < SAVEAREA_MAX; id++)
+    slot_save(id, 1);
+  save_config(1);
+}
+
+// Many saves one slot (blocks wrap) and random slot and config saves: erases per save not more fixed slot layout,
+// saves only append (other records not relocated)
+static void test_full_area(void)
+{
+  fill_all();
+  uint32_t moves = 0, erases = host_flash_erases;
+  for (uint32_t i = 0; i < 200; i++)
+    moves+= save_moved(0, 2 + i);
+  reboot();
+  check_all("full area");
+  erases = host_flash_erases - erases;
+  CHECK(erases <= 200 * BASELINE_SLOT_ERASES, "one slot: %d page erases per 200 saves, baseline %d", erases, 200 * BASELINE_SLOT_ERASES);
+  CHECK(moves == 0, "one slot: %d saves relocate", moves);
+  printf("full area: %d pages, one slot 200 saves: %d page erases (baseline %d), %d saves relocate\n",
+         SAVE_FULL_AREA_SIZE / FLASH_PAGESIZE, erases, 200 * BASELINE_SLOT_ERASES, moves);
+  // Random slots and config
+  uint32_t baseline = 0;
+  moves = 0;
+  erases = host_flash_erases;
+  srand(1);
+  for (uint32_t i = 0; i < 1000; i++) {
+    uint32_t id = rand() % JOURNAL_ID_COUNT;
+    baseline+= id < SAVEAREA_MAX ? BASELINE_SLOT_ERASES : BASELINE_CONFIG_ERASES;
+    moves+= save_moved(id, 300 + i);
+  }
+  reboot();
+  check_all("full area random");
+  erases = host_flash_erases - erases;
+  CHECK(erases <= baseline, "random: %d page erases per 1000 saves, baseline %d", erases, baseline);
+  CHECK(moves == 0, "random: %d saves relocate", moves);
+  printf("full area: random 1000 saves: %d page erases (baseline %d), %d saves relocate\n", erases, baseline, moves);
+}
+
+// Power loss while save slot to reused block (erase old record of other slot) and while config save switch page
+static void test_reuse_power_loss(void)
+{
+  fill_all();
+  // All blocks used once, next saves erase blocks with old records
+  for (uint32_t i = 0; i < JOURNAL_BLOCK_COUNT; i++)
+    slot_save(i % SAVEAREA_MAX, 2 + i);
+  int count = power_loss_scan(1, 100, "reuse power loss");
+  // Config saves until next save switch page
+  torn_id = -1;
+  uint32_t gen = 2, scans = 0;
+  for (; journal_head + JOURNAL_LEN(sizeof(config_t)) <= JOURNAL_PAGE_CEIL(journal_head); gen++)
+    save_config(gen);
+  snapshot();
+  uint32_t ops = flash_ops(), old = config_gen;
+  save_config(gen);
+  ops = flash_ops() - ops;
+  for (uint32_t k = 0; k < ops; k++) {
+    restore();
+    config_gen = old;
+    host_flash_countdown = k;
+    if (setjmp(host_power_loss) == 0) {
+      save_config(gen);
+      CHECK(false, "config save end before power loss %d", k);
+    }
+    host_flash_countdown = -1;
+    reboot();
+    // Old or new config
+    if (config_recall() == 0 && config._serial_speed == gen) config_gen = gen;
+    check_all("config power loss");
+    CHECK(save_config(gen + 1) == 0, "config save after power loss %d", k);
+    reboot();
+    check_all("config power loss");
+    scans++;
+  }
+  printf("reuse power loss: %d slot, %d config page switch power loss points\n", count, scans);
+}
+
+// Bytes crc checked for last records of ids in mask (header before crc and data)
+static uint32_t crc_bytes(uint32_t mask)
+{
+  uint32_t bytes = 0;
+  for (uint32_t id = 0; id < JOURNAL_ID_COUNT; id++)
+    if ((mask & (1 << id)) && journal_index[id] != JOURNAL_NONE)
+      bytes+= offsetof(journal_record_t, crc) + JOURNAL_RECORD(journal_index[id])->size;
+  return bytes;
+}
+
+// Boot load as load_settings: config and slot from backup, only this records crc checked
+static void test_boot_crc(void)
+{
+  format();
+  for (uint32_t id = 0; id < SAVEAREA_MAX; id++)
+    slot_save(id, 1);
+  save_config(1);
+  reboot();
+  uint64_t t = host_cycles();
+  CHECK(config_recall() == 0 && caldata_recall(SAVEAREA_MAX - 1) == 0, "boot load");
+  t = host_cycles() - t;
+  // Only config and loaded slot records crc checked
+  uint32_t mask = (1 << JOURNAL_ID_CONFIG) | (1 << (SAVEAREA_MAX - 1));
+  CHECK(journal_checked == mask, "boot crc checked mask 0x%X", journal_checked);
+  uint32_t bytes = crc_bytes(journal_checked);
+  CHECK(bytes == sizeof(config_t) + JOURNAL_PROPS_SIZE + 2 * offsetof(journal_record_t, crc), "boot crc %d bytes", bytes);
+  // All records check (as replay after not complete record)
+  uint64_t t_all = host_cycles();
+  journal_init(true);
+  t_all = host_cycles() - t_all;
+  check_all("boot crc");
+  printf("boot crc: %d slots saved, boot check %d bytes (%u host cycles), all records replay %u host cycles\n",
+         SAVEAREA_MAX, bytes, (uint32_t)t, (uint32_t)t_all);
+}
+
+#ifdef __USE_FAST_RESUME__
+// Backup registers copy: restore old state after write simulate flash written by other firmware
+static uint32_t backup_copy[BACKUP_COUNT];
+static void backup_get(void) {for (int i = 0; i < BACKUP_COUNT; i++) backup_copy[i] = get_backup_data32(i);}
+static void backup_set(void) {for (int i = 0; i < BACKUP_COUNT; i++) set_backup_data32(i, backup_copy[i]);}
+
+static void resume_check(const char *name, bool resume)
+{
+  reboot();
+  CHECK(journal_resume() == resume, "%s: resume %s", name, resume ? "not used" : "used");
+  check_all(name);
+}
+
+// Boot with journal state from backup registers, replay on not valid or not actual state
+static void test_fast_resume(void)
+{
+  format();
+  for (uint32_t id = 0; id < SAVEAREA_MAX; id++)
+    slot_save(id, 1);
+  save_config(1);
+  reboot();
+  uint64_t t_replay = host_cycles();
+  journal_init(false);
+  t_replay = host_cycles() - t_replay;
+  reboot();
+  uint64_t t_resume = host_cycles();
+  CHECK(journal_resume(), "resume not used");
+  t_resume = host_cycles() - t_resume;
+  check_all("resume");
+  set_backup_data32(RESUME_BACKUP_START + 2, get_backup_data32(RESUME_BACKUP_START + 2) ^ 1);
+  resume_check("bad backup crc", false);
+  resume_check("after replay", true);
+  // Newer records on next write positions
+  backup_get(); slot_save(2, 2); backup_set();
+  resume_check("newer slot", false);
+  backup_get(); save_config(2); backup_set();
+  resume_check("newer config", false);
+  uint32_t gen = 3, len = JOURNAL_LEN(sizeof(config_t));
+  while ((journal_head & (FLASH_PAGESIZE - 1)) && journal_head + len <= JOURNAL_PAGE_CEIL(journal_head))
+    save_config(gen++);
+  backup_get(); save_config(gen); backup_set();
+  resume_check("newer config on next page", false);
+  // Power loss on record write: before commit (record not used), on commit (crc half written)
+  uint32_t ops = host_flash_writes + host_flash_erases;
+  slot_save(4, 4);
+  ops = host_flash_writes + host_flash_erases - ops;
+  torn_id = 4; torn_gen = 5;
+  host_flash_countdown = ops / 2;
+  if (setjmp(host_power_loss) == 0) slot_save(4, 5);
+  host_flash_countdown = -1;
+  resume_check("power loss before commit", true);
+  host_flash_countdown = ops - 1;
+  if (setjmp(host_power_loss) == 0) slot_save(4, 5);
+  host_flash_countdown = -1;
+  resume_check("power loss on commit", false);
+  torn_id = -1;
+  resume_check("after power loss", true);
+  // Flash erased not by firmware (DFU), and clear by firmware
+  format();
+  resume_check("erased flash", false);
+  clear_all_config_prop_data();
+  CHECK(get_backup_data32(RESUME_BACKUP_START) != RESUME_MAGIC, "clear: backup state valid");
+  printf("fast resume: %d slots saved, log replay %u host cycles, resume %u host cycles\n",
+         SAVEAREA_MAX, (uint32_t)t_replay, (uint32_t)t_resume);
+}
+#endif
+
+int main(void)
+{
+  test_save_recall();
+  test_torn_record();
+  test_bad_crc();
+  test_full_area();
+  test_reuse_power_loss();
+  test_boot_crc();
+#ifdef __USE_FAST_RESUME__
+  test_fast_resume();
+#endif
+  return host_test_result("test_journal");
+}
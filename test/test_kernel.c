@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Compare firmware DSP kernels with previous versions on same buffers:
+ *  dsp_process   - Cortex M0 SWAR kernel (int32 buffer sum, >>4) vs old loop (/16, float accumulators)
+ *                  Cortex M4 DSP kernel vs plain C loop
+ *  calculate_gamma - one reciprocal vs old 5 divisions
+ *  apply_CH0_error_term - one reciprocal vs old 2 divisions
+ *  dsp_settle_check - integer compare vs double precision on reference sums (up to full scale phase flip)
+ * All compared with double precision result from exact int64 accumulators
+ */
+#include <float.h>
+#include "host.h"
+#define main vna_main
+#define div  vna_div     // not conflict with stdlib.h div()
+#include "main.c"
+#undef main
+#undef div
+
+// Max relative error bounds
+#define GAMMA_ERROR      2e-6f   // calculate_gamma vs double
+#define KERNEL_ERROR     2e-6f   // new vs old kernel, float accumulate (plus floor vs truncate rounding of >>4)
+#define CORRECT_ERROR    1e-5f   // apply_CH0_error_term vs double
+
+static double rnd(void) {return (rand() / (double)RAND_MAX - 0.5) * 2.0;}
+
+static int16_t buffer[AUDIO_BUFFER_LEN * 256] __attribute__((aligned(4)));
+
+// Fill count buffers: ref = A*cos(w*n + p), samp = |g| * A*cos(w*n + p + arg(g)) + noise
+static void gen_buffers(int count, double level, double g_mag, double g_arg, double noise)
+{
+  double w = 2 * M_PI * IF_OFFSET / ADC_FREQ, p = rnd() * M_PI;
+  for (int n = 0; n < count * ADC_BUFFER_LEN / 2; n++) {
+    buffer[2*n+0] = lrint(level * cos(w * n + p) + noise * rnd());
+    buffer[2*n+1] = lrint(level * g_mag * cos(w * n + p + g_arg) + noise * rnd());
+  }
+}
+
+// Exact accumulators (int64) as firmware kernel
+static void ref_process(int count, int64_t acc[4])
+{
+  const int16_t *tbl = dsp_get_sincos_table();
+  acc[0] = acc[1] = acc[2] = acc[3] = 0;
+  for (int b = 0; b < count; b++) {
+    const int16_t *p = &buffer[b * ADC_BUFFER_LEN];
+    for (int i = 0; i < ADC_BUFFER_LEN; i+= 2) {
+      int32_t ref = p[i], smp = p[i+1], sin = tbl[i], cos = tbl[i+1];
+#ifdef __USE_DSP__
+      acc[0]+= smp * sin; acc[1]+= smp * cos; acc[2]+= ref * sin; acc[3]+= ref * cos;
+#else
+      acc[0]+= (smp * sin)>>4; acc[1]+= (smp * cos)>>4; acc[2]+= (ref * sin)>>4; acc[3]+= (ref * cos)>>4;
+#endif
+    }
+  }
+}
+
+static void ref_gamma(const int64_t acc[4], double g[2])
+{
+  double ss = acc[0], sc = acc[1], rs = acc[2], rc = acc[3];
+  double rr = rs * rs + rc * rc;
+  g[0] = (sc * rc + ss * rs) / rr;
+  g[1] = (ss * rc - sc * rs) / rr;
+}
+
+// Old calculate_gamma (before reciprocal)
+static void old_gamma(float acc_samp_s, float acc_samp_c, float acc_ref_s, float acc_ref_c, float gamma[2])
+{
+  float rs_rc = acc_ref_s / acc_ref_c;
+  float sc_rc = acc_samp_c / acc_ref_c;
+  float ss_rc = acc_samp_s / acc_ref_c;
+  float rr = rs_rc * rs_rc + 1.0;
+  gamma[0] = (sc_rc + ss_rc*rs_rc) / rr;
+  gamma[1] = (ss_rc - sc_rc*rs_rc) / rr;
+}
+
+#ifndef __USE_DSP__
+// Old Cortex M0 dsp_process: signed divide by 16, float accumulators
+static void old_process(int count, float acc[4])
+{
+  const int16_t *tbl = dsp_get_sincos_table();
+  acc[0] = acc[1] = acc[2] = acc[3] = 0;
+  for (int b = 0; b < count; b++) {
+    const int16_t *capture = &buffer[b * ADC_BUFFER_LEN];
+    int32_t samp_s = 0, samp_c = 0, ref_s = 0, ref_c = 0;
+    uint32_t i = 0;
+    do {
+      int16_t ref = capture[i+0];
+      int16_t smp = capture[i+1];
+      int32_t sin = tbl[i+0];
+      int32_t cos = tbl[i+1];
+      samp_s+= (smp * sin)/16;
+      samp_c+= (smp * cos)/16;
+      ref_s += (ref * sin)/16;
+      ref_c += (ref * cos)/16;
+      i+=2;
+    } while (i < ADC_BUFFER_LEN);
+    acc[0]+= samp_s; acc[1]+= samp_c; acc[2]+= ref_s; acc[3]+= ref_c;
+  }
+}
+#endif
+
+static float rel_error(const float v[2], const double r[2])
+{
+  return hypot(v[0] - r[0], v[1] - r[1]) / hypot(r[0], r[1]);
+}
+
+static void test_dsp_kernel(void)
+{
+  static const double level[] = {30000, 3000, 300, 30};
+  static const int    count[] = {1, 2, 8, 80, 256};
+  float max_new = 0, max_old = 0;
+#ifndef __USE_DSP__
+  float max_kernel = 0;
+#endif
+  int tests = 0;
+#ifdef USE_VARIABLE_OFFSET
+  generate_DSP_Table(IF_OFFSET);
+#endif
+  config._if_filter = IF_FILTER_RECT;
+  for (uint32_t l = 0; l < ARRAY_COUNT(level); l++)
+  for (uint32_t c = 0; c < ARRAY_COUNT(count); c++)
+  for (int k = 0; k < 20; k++, tests++) {
+    int n = count[c];
+    gen_buffers(n, level[l], 0.05 + 0.95 * fabs(rnd()), rnd() * M_PI, 2.0);
+    // Firmware kernel
+    float g_new[2], ampl[2], ref[2];
+    reset_dsp_accumerator();
+    for (int b = 0; b < n; b++)
+      dsp_process(&buffer[b * ADC_BUFFER_LEN], ADC_BUFFER_LEN);
+    calculate_gamma(g_new);
+    fetch_amplitude(ampl);
+    fetch_amplitude_ref(ref);
+    // Exact reference
+    int64_t acc[4];
+    double g_ref[2];
+    ref_process(n, acc);
+    ref_gamma(acc, g_ref);
+    // Kernel accumulators bit exact (fetch give acc * 1e-9 in float)
+    double a_ref[4] = {acc[0] * 1e-9, acc[1] * 1e-9, acc[2] * 1e-9, acc[3] * 1e-9};
+    float a_new[4] = {ampl[0], ampl[1], ref[0], ref[1]};
+    for (int i = 0; i < 4; i++)
+      CHECK(fabs(a_new[i] - a_ref[i]) <= 1e-6 * fabs(a_ref[i]) + 1e-15, "level %.0f count %d: acc %d = %g, expect %g",
+            level[l], n, i, a_new[i], a_ref[i]);
+    float e = rel_error(g_new, g_ref);
+    CHECK(e < GAMMA_ERROR, "level %.0f count %d: gamma error %g", level[l], n, e);
+    if (e > max_new) max_new = e;
+    // Old calculate_gamma on same accumulators
+    float g_old[2];
+    old_gamma(acc[0], acc[1], acc[2], acc[3], g_old);
+    e = rel_error(g_old, g_ref);
+    if (e > max_old) max_old = e;
+#ifndef __USE_DSP__
+    // Old kernel + old calculate_gamma
+    float old_acc[4];
+    old_process(n, old_acc);
+    old_gamma(old_acc[0], old_acc[1], old_acc[2], old_acc[3], g_old);
+    double g_old_d[2] = {g_old[0], g_old[1]};
+    // Floor vs truncate >>4 differ max by 1 on every product, old float accumulators add
+    // rounding error (FLT_EPSILON) on every buffer sum, new int64 accumulators exact
+    int products = n * ADC_BUFFER_LEN / 2;
+    for (int i = 0; i < 4; i++)
+      CHECK(fabs(old_acc[i] - acc[i]) <= products + n * FLT_EPSILON * fabs(acc[i]), "level %.0f count %d: old acc %d = %.0f, new %lld",
+            level[l], n, i, old_acc[i], (long long)acc[i]);
+    double bound = M_SQRT2 * products * (1.0 / hypot(acc[0], acc[1]) + 1.0 / hypot(acc[2], acc[3])) + 2 * n * FLT_EPSILON + KERNEL_ERROR;
+    e = rel_error(g_new, g_old_d);
+    CHECK(e < bound, "level %.0f count %d: new vs old kernel error %g > %g", level[l], n, e, bound);
+    if (e > max_kernel) max_kernel = e;
+#endif
+  }
+  printf("dsp_process + calculate_gamma: %d tests, max gamma error %.3g (old gamma %.3g)", tests, max_new, max_old);
+#ifndef __USE_DSP__
+  printf(", new vs old kernel %.3g", max_kernel);
+#endif
+  printf("\n");
+}
+
+// Old apply_CH0_error_term (before reciprocal)
+static void old_CH0_error_term(float data[4], float c_data[CAL_TYPE_COUNT][2])
+{
+  float s11mr = data[0] - c_data[ETERM_ED][0];
+  float s11mi = data[1] - c_data[ETERM_ED][1];
+  float err = c_data[ETERM_ER][0] + s11mr * c_data[ETERM_ES][0] - s11mi * c_data[ETERM_ES][1];
+  float eri = c_data[ETERM_ER][1] + s11mr * c_data[ETERM_ES][1] + s11mi * c_data[ETERM_ES][0];
+  float sq = err*err + eri*eri;
+  data[0] = (s11mr * err + s11mi * eri) / sq;
+  data[1] = (s11mi * err - s11mr * eri) / sq;
+}
+
+static void test_error_term(void)
+{
+  float max_new = 0, max_old = 0;
+  int tests = 10000;
+  for (int k = 0; k < tests; k++) {
+    float c[CAL_TYPE_COUNT][2] = {0};
+    c[ETERM_ED][0] = 0.1 * rnd(); c[ETERM_ED][1] = 0.1 * rnd();
+    c[ETERM_ES][0] = 0.2 * rnd(); c[ETERM_ES][1] = 0.2 * rnd();
+    double er_mag = 0.1 + 0.9 * fabs(rnd()), er_arg = M_PI * rnd();
+    c[ETERM_ER][0] = er_mag * cos(er_arg); c[ETERM_ER][1] = er_mag * sin(er_arg);
+    float d_new[4] = {rnd(), rnd(), 0, 0}, d_old[4] = {d_new[0], d_new[1], 0, 0};
+    // Double reference
+    double mr = (double)d_new[0] - c[ETERM_ED][0], mi = (double)d_new[1] - c[ETERM_ED][1];
+    double er = c[ETERM_ER][0] + mr * c[ETERM_ES][0] - mi * c[ETERM_ES][1];
+    double ei = c[ETERM_ER][1] + mr * c[ETERM_ES][1] + mi * c[ETERM_ES][0];
+    double sq = er * er + ei * ei;
+    double r[2] = {(mr * er + mi * ei) / sq, (mi * er - mr * ei) / sq};
+    apply_CH0_error_term(d_new, c);
+    old_CH0_error_term(d_old, c);
+    float e = rel_error(d_new, r);
+    CHECK(e < CORRECT_ERROR, "apply_CH0_error_term error %g", e);
+    if (e > max_new) max_new = e;
+    e = rel_error(d_old, r);
+    if (e > max_old) max_old = e;
+  }
+  printf("apply_CH0_error_term: %d tests, max error %.3g (old %.3g)\n", tests, max_new, max_old);
+}
+
+#ifdef __USE_SETTLE_DETECT__
+// Reference channel only buffer: ref = A*cos(w*n + p)
+static void gen_ref_buffer(int16_t *p, double level, double phase)
+{
+  double w = 2 * M_PI * IF_OFFSET / ADC_FREQ;
+  for (int n = 0; n < ADC_BUFFER_LEN / 2; n++) {
+    p[2*n+0] = lrint(level * cos(w * n + phase));
+    p[2*n+1] = 0;
+  }
+}
+
+// Exact reference channel sums as firmware (products >> 4)
+static void ref_settle_sum(const int16_t *p, double r[2])
+{
+  const int16_t *tbl = dsp_get_sincos_table();
+  int64_t s = 0, c = 0;
+  for (int i = 0; i < ADC_BUFFER_LEN; i+= 2) {
+    s+= (p[i] * tbl[i])>>4;
+    c+= (p[i] * tbl[i+1])>>4;
+  }
+  r[0] = s; r[1] = c;
+}
+
+static void test_settle_check(void)
+{
+  static const double level[] = {32767, 3000, 30};
+  int16_t *a = &buffer[0], *b = &buffer[ADC_BUFFER_LEN];
+  int tests = 0, pass = 0;
+  for (uint32_t l = 0; l < ARRAY_COUNT(level); l++)
+  for (int k = 0; k < 2000; k++) {
+    // Relative change 1e-5 .. 2 (phase flip), random amplitude step
+    double ratio = 2.0 * pow(10.0, -5.0 * fabs(rnd())), p = rnd() * M_PI;
+    double phase = 2 * asin(ratio / 2) * (rnd() < 0 ? -1 : 1);
+    double scale = k & 1 ? 1.0 : 1.0 - 0.01 * fabs(rnd());
+    gen_ref_buffer(a, level[l], p);
+    gen_ref_buffer(b, level[l] * scale, p + phase);
+    double ra[2], rb[2];
+    ref_settle_sum(a, ra);
+    ref_settle_sum(b, rb);
+    double d = hypot(rb[0] - ra[0], rb[1] - ra[1]), r = hypot(rb[0], rb[1]);
+    // Skip near threshold (halved sums rounding)
+    if (fabs(d * SETTLE_THRESHOLD / r - 1.0) < 0.01) continue;
+    bool expect = d * SETTLE_THRESHOLD < r;
+    // a, a settle (count 1), then b decide
+    dsp_settle_reset();
+    dsp_settle_check(a, ADC_BUFFER_LEN);
+    bool first = dsp_settle_check(a, ADC_BUFFER_LEN);
+    bool result = dsp_settle_check(b, ADC_BUFFER_LEN);
+    CHECK(!first, "level %.0f: settled after one compare", level[l]);
+    CHECK(result == expect, "level %.0f ratio %g: settle %d, expect %d", level[l], d / r, result, expect);
+    tests++;
+    pass+= expect;
+  }
+  printf("dsp_settle_check: %d tests (%d settled)\n", tests, pass);
+}
+#endif
+
+int main(void)
+{
+  srand(1);
+  test_dsp_kernel();
+  test_error_term();
+#ifdef __USE_SETTLE_DETECT__
+  test_settle_check();
+#endif
+  return host_test_result("test_kernel");
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2019-2020, Dmitry (DiSlord) dislordlive@gmail.com
+ * All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * The software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Radio; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Time domain tests (main.c):
+ *  zoom accuracy    - chirp-Z zoom (transform_zoom_lowpass) impulse and step on random [t0, t1] ranges vs
+ *                     double precision direct DFT at zoom times, step on integer times vs sum of impulse
+ *  zoom host cycles - chirp-Z zoom vs zero-padding real iFFT with same time resolution, host timings only
+ *                     (not Cortex M0/M4 cycles)
+ *  gate             - two reflections, inside gate kept, outside removed for all windows and gate shapes
+ *  tdr              - TDR Z trace on lowpass step of short, open, matched and resistive loads for all windows,
+ *                     TDR Z allowed only on S11 in lowpass step mode (channel and transform mode change)
+ */
+#include <complex.h>
+#include "host.h"
+#define main vna_main
+#define div  vna_div     // not conflict with stdlib.h div()
+#include "main.c"
+#undef main
+#undef div
+
+#ifdef __USE_TD_ZOOM__
+#define TEST_POINTS   POINTS_COUNT
+// Lowpass spectrum bins used by transform_domain
+#define TEST_BINS     (TEST_POINTS < FFT_SIZE / 2 + 1 ? TEST_POINTS : FFT_SIZE / 2 + 1)
+// RMS error bounds (relative to impulse peak or step max): float fft and chirp error
+#define ZOOM_ERROR    1e-5
+#define STEP_ERROR    1e-5
+
+static double rnd(void) {return (rand() / (double)RAND_MAX - 0.5) * 2.0;}
+
+static float  spectrum[POINTS_COUNT][2];
+static float  zoom[POINTS_COUNT][2];
+static double ref[POINTS_COUNT];
+
+// Lowpass input: delay line with loss and reflection, window applied
+static void fill_spectrum(void)
+{
+  const double d0 = 7.3 + 20 * fabs(rnd()), d1 = d0 + 1.6 + 10 * fabs(rnd());
+  for (int k = 0; k < TEST_BINS; k++) {
+    double w = 0.5 + 0.5 * cos(M_PI * k / TEST_BINS), a0 = 2 * M_PI * k * d0 / FFT_SIZE, a1 = 2 * M_PI * k * d1 / FFT_SIZE;
+    spectrum[k][0] = w * (0.8 * cos(a0) - 0.3 * cos(a1)) / FFT_SIZE;
+    spectrum[k][1] =-w * (0.8 * sin(a0) - 0.3 * sin(a1)) / FFT_SIZE;
+  }
+}
+
+// Real iFFT multiplier: X[0] and X[N/2] once, other twice (upper half is conjugate)
+static double bin_mul(int k) {return (k == 0 || k == FFT_SIZE / 2) ? 1.0 : 2.0;}
+
+// Direct DFT impulse response at time t (FFT time step units)
+static double time_response(double t)
+{
+  double v = 0;
+  for (int k = 0; k < TEST_BINS; k++) {
+    double a = 2 * M_PI * k * t / FFT_SIZE;
+    v+= bin_mul(k) * (spectrum[k][0] * cos(a) - spectrum[k][1] * sin(a));
+  }
+  return v;
+}
+
+// Step start: impulse part before 0 (periodic response times sweep_points ... FFT_SIZE - 1)
+static double step_start(void)
+{
+  double v = 0;
+  for (int j = sweep_points; j < FFT_SIZE; j++) v+= time_response(j);
+  return v;
+}
+
+// Direct DFT step response (step start + sum of impulse 0 ... t, geometric sum for every bin) at time t
+static double step_response(double t)
+{
+  double complex v = (t + 1) * spectrum[0][0] + step_start();
+  for (int k = 1; k < TEST_BINS; k++) {
+    double complex x = spectrum[k][0] + I * spectrum[k][1];
+    double complex z = cexp(2 * M_PI * I * k / FFT_SIZE);
+    v+= bin_mul(k) * x * (cexp(2 * M_PI * I * k * (t + 1) / FFT_SIZE) - 1) / (z - 1);
+  }
+  return creal(v);
+}
+
+// RMS error relative to peak of impulse or max of step on full time response
+static double zoom_error(int n, bool step)
+{
+  double e = 0, peak = 0, sum = step ? step_start() : 0;
+  for (int i = 0; i < n; i++)
+    e+= (zoom[i][0] - ref[i]) * (zoom[i][0] - ref[i]);
+  for (int j = 0; j < FFT_SIZE; j++) {
+    double x = time_response(j);
+    sum+= x;
+    x = step ? sum : x;
+    if (fabs(x) > peak) peak = fabs(x);
+  }
+  return sqrt(e / n) / peak;
+}
+
+static void run_zoom(float t0, float dt)
+{
+  memcpy(zoom, spectrum, sizeof(zoom));
+  transform_zoom_lowpass(&zoom[0][0], TEST_BINS, t0, dt);
+}
+
+static void test_zoom(void)
+{
+  double max_i = 0, max_s = 0, max_n = 0;
+  props_mode|= DOMAIN_TIME;
+  for (int pass = 0; pass < 20; pass++) {
+    fill_spectrum();
+    // Arbitrary range: start in [0, 2 * FFT_SIZE) (periodic), span from 1/64 to one FFT_SIZE period
+    const float t0 = pass == 0 ? 0.0f : fabs(rnd()) * 2 * FFT_SIZE;
+    const float t1 = t0 + (pass == 0 ? FFT_SIZE : FFT_SIZE * pow(64.0, -fabs(rnd())));
+    const float dt = (t1 - t0) / (TEST_POINTS - 1);
+    props_mode = (props_mode & ~TD_FUNC) | TD_FUNC_LOWPASS_IMPULSE;
+    run_zoom(t0, dt);
+    for (int i = 0; i < TEST_POINTS; i++) ref[i] = time_response(t0 + i * (double)dt);
+    double e = zoom_error(TEST_POINTS, false);
+    CHECK(e < ZOOM_ERROR, "impulse [%.3f, %.3f]: error %g", t0, t1, e);
+    if (e > max_i) max_i = e;
+    props_mode = (props_mode & ~TD_FUNC) | TD_FUNC_LOWPASS_STEP;
+    run_zoom(t0, dt);
+    for (int i = 0; i < TEST_POINTS; i++) ref[i] = step_response(t0 + i * (double)dt);
+    e = zoom_error(TEST_POINTS, true);
+    CHECK(e < STEP_ERROR, "step [%.3f, %.3f]: error %g", t0, t1, e);
+    if (e > max_s) max_s = e;
+  }
+  // Step on integer times equal sum of impulse (as not zoomed transform)
+  fill_spectrum();
+  props_mode = (props_mode & ~TD_FUNC) | TD_FUNC_LOWPASS_STEP;
+  for (int t0 = 0; t0 < FFT_SIZE; t0+= FFT_SIZE / 4) {
+    double sum = step_start();
+    for (int j = 0; j < t0; j++) sum+= time_response(j);
+    for (int i = 0; i < TEST_POINTS; i++) ref[i] = (sum+= time_response(t0 + i));
+    run_zoom(t0, 1.0f);
+    double e = zoom_error(TEST_POINTS, true);
+    CHECK(e < STEP_ERROR, "step sum start %d: error %g", t0, e);
+    if (e > max_n) max_n = e;
+  }
+  printf("td zoom %d points: max impulse error %.3g, step %.3g, step vs impulse sum %.3g\n", TEST_POINTS, max_i, max_s, max_n);
+}
+
+// Zero-padding reference: complex radix-2 FFT size n (real iFFT size 2 * n), twiddles prepared before timing
+static float pad_data[1<<15][2];
+static float pad_twiddle[1<<14][2];
+static void pad_prepare(int n)
+{
+  for (int i = 0; i < n / 2; i++) {
+    pad_twiddle[i][0] = cos(2 * M_PI * i / n);
+    pad_twiddle[i][1] = sin(2 * M_PI * i / n);
+  }
+}
+
+static void pad_fft(int n)
+{
+  float (*x)[2] = pad_data;
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit>>= 1) j^= bit;
+    j^= bit;
+    if (i < j) {float t0 = x[i][0], t1 = x[i][1]; x[i][0] = x[j][0]; x[i][1] = x[j][1]; x[j][0] = t0; x[j][1] = t1;}
+  }
+  for (int len = 2; len <= n; len<<= 1) {
+    int step = n / len;
+    for (int i = 0; i < n; i+= len)
+      for (int j = 0; j < len / 2; j++) {
+        const float *w = pad_twiddle[j * step];
+        float *a = x[i + j], *b = x[i + j + len / 2];
+        float re = b[0] * w[0] - b[1] * w[1], im = b[0] * w[1] + b[1] * w[0];
+        b[0] = a[0] - re; b[1] = a[1] - im;
+        a[0]+= re;        a[1]+= im;
+      }
+  }
+}
+
+// Min of host cycles on runs
+#define MIN_CYCLES(min, code) do { \
+  min = UINT64_MAX; \
+  for (int run = 0; run < 20; run++) { \
+    uint64_t t = host_cycles(); code; t = host_cycles() - t; \
+    if (t < min) min = t; \
+  } \
+} while(0)
+
+static void test_speed(void)
+{
+  static const float span[] = {FFT_SIZE, FFT_SIZE / 2, FFT_SIZE / 4, FFT_SIZE / 8, FFT_SIZE / 16, FFT_SIZE / 64};
+  props_mode = (props_mode & ~TD_FUNC) | TD_FUNC_LOWPASS_IMPULSE;
+  fill_spectrum();
+  printf("td zoom %d points host cycles (host timings, not Cortex M0/M4): resolution, chirp-Z, zero-padding real iFFT size (bytes)\n", TEST_POINTS);
+  for (uint32_t s = 0; s < ARRAY_COUNT(span); s++) {
+    const float dt = span[s] / (TEST_POINTS - 1);
+    // Zero-padding: real iFFT size >= FFT_SIZE / dt (power of 2), same resolution on all time range, need size / 2 complex FFT
+    int n = 1;
+    while (n * dt < FFT_SIZE) n<<= 1;
+    pad_prepare(n / 2);
+    uint64_t t_czt, t_pad;
+    MIN_CYCLES(t_czt, run_zoom(12.25f, dt));
+    MIN_CYCLES(t_pad, memset(pad_data, 0, n / 2 * sizeof(pad_data[0])); memcpy(pad_data, spectrum, sizeof(spectrum)); pad_fft(n / 2));
+    printf("  %8.4f: %8u %8u %6d (%u)\n", dt, (uint32_t)t_czt, (uint32_t)t_pad, n, (uint32_t)(n * sizeof(float)));
+  }
+  // Work memory for chirp-Z: complex FFT_SIZE buffer and filter (F303 filter and output in CCM)
+  printf("td zoom %d points chirp-Z work memory: %u bytes (spi_buffer %u bytes)\n", TEST_POINTS,
+         (uint32_t)(2 * 8 * FFT_SIZE), (uint32_t)sizeof(spi_buffer));
+}
+#endif
+
+static const uint16_t td_window[] = {TD_WINDOW_MINIMUM, TD_WINDOW_NORMAL, TD_WINDOW_MAXIMUM, TD_WINDOW_HANN, TD_WINDOW_BLACKMAN};
+static const char *td_window_name[] = {"minimum", "normal", "maximum", "hann", "blackman"};
+
+#ifdef __USE_TD_GATE__
+// Gate two reflections (one inside, one outside gate): inside amplitude error and outside leakage bounds
+#define GATE_KEEP     0.01
+#define GATE_LEAK     0.01
+
+static const uint16_t gate_shape[] = {TD_GATE_MINIMUM, TD_GATE_NORMAL, TD_GATE_MAXIMUM};
+static const char *gate_shape_name[] = {"minimum", "normal", "maximum"};
+
+// Reflection with delay d (FFT time step units): exp(-2*pi*i*k*d/FFT_SIZE)
+static double complex reflection(int k, double d)
+{
+  return cexp(-2 * M_PI * I * k * d / FFT_SIZE);
+}
+
+// Least squares fit of gate result: measured = a_in * reflection(d_in) + a_out * reflection(d_out)
+static void gate_fit(double d_in, double d_out, double complex *a_in, double complex *a_out)
+{
+  double complex g11 = 0, g12 = 0, g22 = 0, b1 = 0, b2 = 0;
+  for (int k = 0; k < sweep_points; k++) {
+    double complex r1 = reflection(k, d_in), r2 = reflection(k, d_out);
+    double complex y = measured[0][k][0] + I * measured[0][k][1];
+    g11+= conj(r1) * r1; g12+= conj(r1) * r2; g22+= conj(r2) * r2;
+    b1 += conj(r1) * y;  b2 += conj(r2) * y;
+  }
+  double complex det = g11 * g22 - g12 * conj(g12);
+  *a_in  = (g22 * b1 - g12 * b2) / det;
+  *a_out = (g11 * b2 - conj(g12) * b1) / det;
+}
+
+static void test_gate(void)
+{
+  const double a_in = 0.5, a_out = 0.4;
+  double max_keep = 0, max_leak = 0;
+  sweep_points = POINTS_COUNT;
+  frequency0 = 50000000;
+  frequency1 = 900000000;
+  // Time of FFT time step
+  const double step = (sweep_points - 1) / ((double)FFT_SIZE * (frequency1 - frequency0));
+  // Inside reflection not on gate center
+  const double d_in = FFT_SIZE * 0.12 + 0.3, d_out = FFT_SIZE * 0.35 + 0.7;
+  for (uint32_t w = 0; w < ARRAY_COUNT(td_window); w++)
+  for (uint32_t g = 0; g < ARRAY_COUNT(gate_shape); g++) {
+    props_mode = (props_mode & ~(TD_WINDOW|TD_GATE_SHAPE)) | td_window[w] | gate_shape[g];
+    gate_start = (d_in - FFT_SIZE * 0.08) * step;
+    gate_stop  = (d_in + FFT_SIZE * 0.07) * step;
+    for (int k = 0; k < sweep_points; k++) {
+      double complex v = a_in * reflection(k, d_in) + a_out * reflection(k, d_out);
+      measured[0][k][0] = creal(v);
+      measured[0][k][1] = cimag(v);
+    }
+    transform_gate(1);
+    double complex f_in, f_out;
+    gate_fit(d_in, d_out, &f_in, &f_out);
+    double keep = cabs(f_in / a_in - 1), leak = cabs(f_out / a_out);
+    CHECK(keep < GATE_KEEP, "%s window, %s gate: inside reflection error %g", td_window_name[w], gate_shape_name[g], keep);
+    CHECK(leak < GATE_LEAK, "%s window, %s gate: outside reflection leak %g", td_window_name[w], gate_shape_name[g], leak);
+    if (keep > max_keep) max_keep = keep;
+    if (leak > max_leak) max_leak = leak;
+  }
+  printf("td gate %d points: max inside reflection error %.3g, outside leak %.3g\n", sweep_points, max_keep, max_leak);
+}
+#endif
+
+// TDR Z: step response settle after window impulse width (start skipped), bin 0 window value < 1 give
+// small reflection error, minimum (rectangular) window not tested (Gibbs ringing on all step)
+#define TDR_SKIP      10
+#define TDR_ERROR     1e-3    // relative Z error for resistive loads
+#define TDR_SHORT     0.05    // short Z maximum (ohm)
+#define TDR_OPEN      1e4     // open Z minimum
+#define TDR_Z0        50.0    // PORT_Z in plot.c
+#define LOAD_OPEN     -1      // not use INFINITY (-ffast-math)
+
+static void test_tdr(void)
+{
+  static const double load[] = {0, 25, 50, 100, LOAD_OPEN};
+  get_value_cb_t tdr = trace_info_list[TRC_TDR].get_value_cb;
+  double max_err = 0, max_short = 0, min_open = 1e30;
+  sweep_points = POINTS_COUNT;
+  for (uint32_t w = 1; w < ARRAY_COUNT(td_window); w++)
+  for (uint32_t l = 0; l < ARRAY_COUNT(load); l++) {
+    props_mode = DOMAIN_TIME | TD_FUNC_LOWPASS_STEP | td_window[w];
+    double g = load[l] == LOAD_OPEN ? 1.0 : (load[l] - TDR_Z0) / (load[l] + TDR_Z0);
+    for (int k = 0; k < sweep_points; k++) {
+      measured[0][k][0] = g;
+      measured[0][k][1] = 0.0f;
+    }
+    transform_domain(1);
+    for (int i = TDR_SKIP; i < sweep_points; i++) {
+      double z = tdr(i, measured[0][i]);
+      if (load[l] == LOAD_OPEN) {
+        CHECK(z > TDR_OPEN, "%s window: open Z %g at %d", td_window_name[w], z, i);
+        if (z < min_open) min_open = z;
+        continue;
+      }
+      if (load[l] == 0) {
+        CHECK(fabs(z) < TDR_SHORT, "%s window: short Z %g at %d", td_window_name[w], z, i);
+        if (fabs(z) > max_short) max_short = fabs(z);
+        continue;
+      }
+      double e = fabs(z / load[l] - 1);
+      CHECK(e < TDR_ERROR, "%s window: load %g Z %g at %d", td_window_name[w], load[l], z, i);
+      if (e > max_err) max_err = e;
+    }
+  }
+  printf("tdr %d points: max Z error %.3g, short Z %.3g, open Z %.3g\n", sweep_points, max_err, max_short, min_open);
+  // Availability: S11 and lowpass step only
+  props_mode = DOMAIN_TIME | TD_FUNC_LOWPASS_STEP;
+  set_trace_type(0, TRC_TDR, 0);
+  CHECK(trace[0].type == TRC_TDR, "tdr on S11 step not set");
+  set_trace_channel(0, 1);
+  CHECK(trace[0].type == TRC_REAL && trace[0].channel == 1, "tdr not switched on S21 (type %d)", trace[0].type);
+  set_trace_type(0, TRC_TDR, 1);
+  CHECK(trace[0].type == TRC_REAL, "tdr set on S21");
+  set_trace_type(0, TRC_TDR, 0);
+  props_mode = DOMAIN_TIME | TD_FUNC_LOWPASS_IMPULSE;
+  tdr_check_traces();
+  CHECK(trace[0].type == TRC_REAL, "tdr not switched on impulse");
+  set_trace_type(0, TRC_TDR, 0);
+  CHECK(trace[0].type == TRC_REAL, "tdr set on impulse");
+  props_mode = DOMAIN_TIME | TD_FUNC_LOWPASS_STEP;
+  set_trace_type(0, TRC_TDR, 0);
+  props_mode&= ~DOMAIN_TIME;
+  tdr_check_traces();
+  CHECK(trace[0].type == TRC_REAL, "tdr not switched on frequency domain");
+}
+
+int main(void)
+{
+  srand(1);
+#ifdef __USE_TD_ZOOM__
+  sweep_points = TEST_POINTS;
+  test_zoom();
+  test_speed();
+#endif
+#ifdef __USE_TD_GATE__
+  test_gate();
+#endif
+  test_tdr();
+  return host_test_result("test_td");
+}
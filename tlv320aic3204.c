@@ -371,6 +371,50 @@ tlv320aic3204_write_reg(uint8_t page, uint8_t reg, uint8_t data)
   tlv320aic3204_config(buf, sizeof(buf)/2);
 }
 
+#ifdef USE_ADC_PROFILE
+// ADC clock settings for runtime change sample rate (from PLL 98.304MHz, see conf_data)
+typedef struct {
+  uint32_t freq;
+  uint8_t ndac, mdac, dosr, prb_p;
+  uint8_t nadc, madc, aosr, prb_r;
+  uint8_t bclk;
+} adc_clock_t;
+
+static const adc_clock_t adc_clock[] = {
+//    freq, NDAC, MDAC, DOSR, PRB_P, NADC, MADC, AOSR, PRB_R, BCLK
+  {  48000, 0x82, 0x88, 0x80,     1, 0x81, 0x88, 0x80,     1,   32},
+  {  96000, 0x82, 0x88, 0x40,     1, 0x82, 0x88, 0x80,     1,   16},
+  { 192000, 0x82, 0x84, 0x40,    17, 0x82, 0x84, 0x40,     7,    8},
+  { 384000, 0x82, 0x84, 0x20,    17, 0x82, 0x82, 0x40,     7,    4},
+};
+
+void tlv320aic3204_set_adc_freq(uint32_t freq)
+{
+  const adc_clock_t *c = adc_clock;
+  while (c->freq != freq)
+    if (++c == &adc_clock[ARRAY_COUNT(adc_clock)]) return;
+  const uint8_t data[] = {
+  // reg, data,
+    0x00, 0x00,         // Select Page 0
+    0x51, 0x00,         // Power down ADC (processing block can be changed only if ADC powered down)
+    0x0b, c->ndac,      // NDAC divider
+    0x0c, c->mdac,      // MDAC divider
+    0x0d, 0x00,         // DAC OSR (MSB)
+    0x0e, c->dosr,      // DAC OSR (LSB)
+    0x3c, c->prb_p,     // DAC processing block
+    0x12, c->nadc,      // NADC divider
+    0x13, c->madc,      // MADC divider
+    0x14, c->aosr,      // ADC OSR
+    0x3d, c->prb_r,     // ADC processing block
+    0x1e, REG_30(c->bclk), // BCLKN divider
+    0x51, 0xc2,         // Power up Left and Right ADC Channels
+    0x52, 0x00,         // Unmute Left and Right ADC Digital Volume Control
+    0x00, 0x01,         // Select Page 1 (should be set as default)
+  };
+  tlv320aic3204_config(data, sizeof(data)/2);
+}
+#endif
+
 void tlv320aic3204_select(uint8_t channel)
 {
 #if 0
@@ -84,6 +84,12 @@ enum {
   KM_SCALE, KM_nSCALE, KM_SCALEDELAY,
   KM_REFPOS, KM_EDELAY, KM_VAR_DELAY, KM_S21OFFSET, KM_VELOCITY_FACTOR,
   KM_XTAL, KM_THRESHOLD, KM_VBAT,
+#ifdef __USE_TD_ZOOM__
+  KM_TD_START, KM_TD_STOP,
+#endif
+#ifdef __USE_TD_GATE__
+  KM_GATE_START, KM_GATE_STOP,
+#endif
 #ifdef __S21_MEASURE__
   KM_MEASURE_R,
 #endif
@@ -168,6 +174,8 @@ static int8_t  selection = -1;
 #define BUTTON_ICON_GROUP_CHECKED    3
 #define BUTTON_ICON_CHECK_AUTO       4
 #define BUTTON_ICON_CHECK_MANUAL     5
+// Button text color if action not allowed now
+#define BUTTON_DISABLED_COLOR        LCD_GRID_COLOR
 
 #define BUTTON_BORDER_NONE           0x00
 #define BUTTON_BORDER_WIDTH_MASK     0x07
@@ -669,8 +677,8 @@ static UI_FUNCTION_CALLBACK(menu_cal_reset_cb)
 {
   (void)data;
   // RESET
+  caldata_reset();
   cal_status = 0;
-  lastsaveid = NO_SAVE_SLOT;
   set_power(SI5351_CLK_DRIVE_STRENGTH_AUTO);
 }
 
@@ -705,6 +713,34 @@ static UI_FUNCTION_ADV_CALLBACK(menu_cal_apply_acb)
   request_to_redraw(REDRAW_CAL_STATUS);
 }
 
+static UI_FUNCTION_ADV_CALLBACK(menu_cal_enh_acb)
+{
+  (void)data;
+  if (b){
+    b->icon = (cal_status&CALSTAT_ENHANCED_RESPONSE) ? BUTTON_ICON_CHECK : BUTTON_ICON_NOCHECK;
+    if (cal_status & CALSTAT_ENHANCED_LOCK) b->fg = BUTTON_DISABLED_COLOR;
+    return;
+  }
+  // Thru already measured in current mode, need reset calibration
+  if (cal_status & CALSTAT_ENHANCED_LOCK) return;
+  // toggle enhanced response (source match correction, thru load match if collect thru after)
+  cal_status ^= CALSTAT_ENHANCED_RESPONSE;
+  request_to_redraw(REDRAW_CAL_STATUS);
+}
+
+#ifdef __USE_CAL_AVERAGE__
+static UI_FUNCTION_ADV_CALLBACK(menu_cal_avg_acb)
+{
+  (void)data;
+  if (b){
+    plot_printf(b->label, sizeof(b->label), "CAL AVERAGE\n " R_LINK_COLOR "%d", config._cal_average);
+    return;
+  }
+  // cycle 1, 4, 16, 64 sweeps on calibration standard
+  config._cal_average = config._cal_average >= 64 ? 1 : ((config._cal_average < 4 ? 1 : config._cal_average) * 4);
+}
+#endif
+
 static UI_FUNCTION_ADV_CALLBACK(menu_recall_acb)
 {
   if (b){
@@ -837,9 +873,11 @@ static UI_FUNCTION_ADV_CALLBACK(menu_format_acb)
 
     if (current_trace != TRACE_INVALID && trace[current_trace].type == format && trace[current_trace].channel == channel)
       b->icon = BUTTON_ICON_CHECK;
+    if (format == TRC_TDR && !TDR_AVAILABLE(channel)) b->fg = BUTTON_DISABLED_COLOR;
     return;
   }
   if (current_trace == TRACE_INVALID) return;
+  if (format == TRC_TDR && !TDR_AVAILABLE(channel)) return;
 
   if (format == TRC_SMITH && trace[current_trace].type == TRC_SMITH && trace[current_trace].channel == channel)
     menu_push_submenu(channel == 0 ? menu_marker_s11smith : menu_marker_s21smith);
@@ -863,9 +901,11 @@ static UI_FUNCTION_ADV_CALLBACK(menu_transform_window_acb)
 {
   char *text = "";
   switch(props_mode & TD_WINDOW){
-    case TD_WINDOW_MINIMUM: text = "MINIMUM"; data = TD_WINDOW_NORMAL;  break;
-    case TD_WINDOW_NORMAL:  text = "NORMAL";  data = TD_WINDOW_MAXIMUM; break;
-    case TD_WINDOW_MAXIMUM: text = "MAXIMUM"; data = TD_WINDOW_MINIMUM; break;
+    case TD_WINDOW_MINIMUM:  text = "MINIMUM";  data = TD_WINDOW_NORMAL;   break;
+    case TD_WINDOW_NORMAL:   text = "NORMAL";   data = TD_WINDOW_MAXIMUM;  break;
+    case TD_WINDOW_MAXIMUM:  text = "MAXIMUM";  data = TD_WINDOW_HANN;     break;
+    case TD_WINDOW_HANN:     text = "HANN";     data = TD_WINDOW_BLACKMAN; break;
+    case TD_WINDOW_BLACKMAN: text = "BLACKMAN"; data = TD_WINDOW_MINIMUM;  break;
   }
   if(b){
     b->p1.text = text;
@@ -883,10 +923,63 @@ static UI_FUNCTION_ADV_CALLBACK(menu_transform_acb)
     return;
   }
   props_mode ^= DOMAIN_TIME;
+  tdr_check_traces();
   select_lever_mode(LM_MARKER);
   request_to_redraw(REDRAW_FREQUENCY | REDRAW_AREA);
 }
 
+#ifdef __USE_TD_ZOOM__
+static UI_FUNCTION_ADV_CALLBACK(menu_transform_zoom_acb)
+{
+  (void)data;
+  if(b){
+    if (props_mode & TD_ZOOM) b->icon = BUTTON_ICON_CHECK;
+    b->p1.text = (props_mode & TD_ZOOM) ? "ON" : "OFF";
+    if (domain_func == TD_FUNC_BANDPASS) b->fg = BUTTON_DISABLED_COLOR;
+    return;
+  }
+  // Zoom only for lowpass
+  if (domain_func == TD_FUNC_BANDPASS) return;
+  props_mode ^= TD_ZOOM;
+  request_to_redraw(REDRAW_FREQUENCY | REDRAW_MARKER);
+}
+#endif
+
+#ifdef __USE_TD_GATE__
+static UI_FUNCTION_ADV_CALLBACK(menu_transform_gate_acb)
+{
+  (void)data;
+  if(b){
+    if (props_mode & TD_GATE) b->icon = BUTTON_ICON_CHECK;
+    b->p1.text = (props_mode & TD_GATE) ? "ON" : "OFF";
+    return;
+  }
+  props_mode ^= TD_GATE;
+}
+
+static UI_FUNCTION_ADV_CALLBACK(menu_transform_gate_shape_acb)
+{
+  char *text = "";
+  switch(props_mode & TD_GATE_SHAPE){
+    case TD_GATE_MINIMUM: text = "MINIMUM"; data = TD_GATE_NORMAL;  break;
+    case TD_GATE_NORMAL:  text = "NORMAL";  data = TD_GATE_MAXIMUM; break;
+    case TD_GATE_MAXIMUM: text = "MAXIMUM"; data = TD_GATE_MINIMUM; break;
+  }
+  if(b){
+    b->p1.text = text;
+    return;
+  }
+  props_mode = (props_mode & ~TD_GATE_SHAPE) | data;
+}
+
+static UI_FUNCTION_CALLBACK(menu_transform_gate_markers_cb)
+{
+  (void)data;
+  if (set_gate_from_markers())
+    props_mode|= TD_GATE;
+}
+#endif
+
 static UI_FUNCTION_ADV_CALLBACK(menu_transform_filter_acb)
 {
   if(b){
@@ -894,6 +987,7 @@ static UI_FUNCTION_ADV_CALLBACK(menu_transform_filter_acb)
     return;
   }
   props_mode = (props_mode & ~TD_FUNC) | data;
+  tdr_check_traces();
 //  ui_mode_normal();
 }
 
@@ -918,6 +1012,18 @@ static UI_FUNCTION_ADV_CALLBACK(menu_bandwidth_acb)
   set_bandwidth(data);
 }
 
+#ifdef __USE_IF_FILTER__
+static UI_FUNCTION_ADV_CALLBACK(menu_if_filter_acb)
+{
+  (void)data;
+  if (b){
+    b->p1.text = config._if_filter == IF_FILTER_CIC3 ? "CIC3" : "RECT";
+    return;
+  }
+  config._if_filter = config._if_filter == IF_FILTER_CIC3 ? IF_FILTER_RECT : IF_FILTER_CIC3;
+}
+#endif
+
 void apply_VNA_mode(uint16_t idx, uint16_t value) {
   uint16_t m = 1<<idx;
   uint16_t old = config._vna_mode;
@@ -1051,6 +1157,13 @@ static UI_FUNCTION_ADV_CALLBACK(menu_keyboard_acb)
   } else if (data == KM_VAR) {
     if (lever_mode == LM_EDELAY) data = KM_VAR_DELAY;
   }
+#ifdef __USE_TD_ZOOM__
+  // Zoom start/stop only for lowpass
+  if ((data == KM_TD_START || data == KM_TD_STOP) && domain_func == TD_FUNC_BANDPASS) {
+    if (b == NULL) return;
+    b->fg = BUTTON_DISABLED_COLOR;
+  }
+#endif
   if (b){
     const keyboard_cb_t cb = keypads_mode_tbl[data].cb;
     if (cb) cb(keypads_mode_tbl[data].data, b);
@@ -1491,6 +1604,7 @@ static void vna_save_file(char *name, uint8_t format)
        */
       case FMT_CAL_FILE:
       {
+        caldata_unref();
         const char *src = (char*)&current_props;
         const uint32_t total = sizeof(current_props);
         res = f_write(fs_file, src, total, &size);
@@ -1634,6 +1748,18 @@ const menuitem_t menu_save[] = {
 #endif
 #if SAVEAREA_MAX > 6
   { MT_ADV_CALLBACK, 6, MT_CUSTOM_LABEL, menu_save_acb },
+#endif
+#if SAVEAREA_MAX > 7
+  { MT_ADV_CALLBACK, 7, MT_CUSTOM_LABEL, menu_save_acb },
+#endif
+#if SAVEAREA_MAX > 8
+  { MT_ADV_CALLBACK, 8, MT_CUSTOM_LABEL, menu_save_acb },
+#endif
+#if SAVEAREA_MAX > 9
+  { MT_ADV_CALLBACK, 9, MT_CUSTOM_LABEL, menu_save_acb },
+#endif
+#if SAVEAREA_MAX > 10
+  { MT_ADV_CALLBACK, 10, MT_CUSTOM_LABEL, menu_save_acb },
 #endif
   { MT_NONE, 0, NULL, menu_back } // next-> menu_back
 };
@@ -1656,6 +1782,18 @@ const menuitem_t menu_recall[] = {
 #endif
 #if SAVEAREA_MAX > 6
   { MT_ADV_CALLBACK, 6, MT_CUSTOM_LABEL, menu_recall_acb },
+#endif
+#if SAVEAREA_MAX > 7
+  { MT_ADV_CALLBACK, 7, MT_CUSTOM_LABEL, menu_recall_acb },
+#endif
+#if SAVEAREA_MAX > 8
+  { MT_ADV_CALLBACK, 8, MT_CUSTOM_LABEL, menu_recall_acb },
+#endif
+#if SAVEAREA_MAX > 9
+  { MT_ADV_CALLBACK, 9, MT_CUSTOM_LABEL, menu_recall_acb },
+#endif
+#if SAVEAREA_MAX > 10
+  { MT_ADV_CALLBACK, 10, MT_CUSTOM_LABEL, menu_recall_acb },
 #endif
   { MT_NONE, 0, NULL, menu_back } // next-> menu_back
 };
@@ -1676,6 +1814,10 @@ const menuitem_t menu_cal[] = {
   { MT_ADV_CALLBACK, 0, MT_CUSTOM_LABEL, menu_cal_range_acb },
   { MT_CALLBACK,     0, "RESET",         menu_cal_reset_cb },
   { MT_ADV_CALLBACK, 0, "APPLY",         menu_cal_apply_acb },
+  { MT_ADV_CALLBACK, 0, "ENHANCED\nRESPONSE", menu_cal_enh_acb },
+#ifdef __USE_CAL_AVERAGE__
+  { MT_ADV_CALLBACK, 0, MT_CUSTOM_LABEL, menu_cal_avg_acb },
+#endif
   { MT_NONE, 0, NULL, menu_back } // next-> menu_back
 };
 
@@ -1728,6 +1870,7 @@ const menuitem_t menu_format3[] = {
   { MT_ADV_CALLBACK, F_S11|TRC_Xp,     "PARALLEL X", menu_format_acb },
   { MT_ADV_CALLBACK, F_S11|TRC_pC,     "PARALLEL C", menu_format_acb },
   { MT_ADV_CALLBACK, F_S11|TRC_pL,     "PARALLEL L", menu_format_acb },
+  { MT_ADV_CALLBACK, F_S11|TRC_TDR,    "TDR Z",      menu_format_acb },
   { MT_NONE, 0, NULL, menu_back } // next-> menu_back
 };
 
@@ -1769,6 +1912,17 @@ const menuitem_t menu_scale[] = {
   { MT_NONE, 0, NULL, menu_back } // next-> menu_back
 };
 
+#ifdef __USE_TD_GATE__
+const menuitem_t menu_transform_gate[] = {
+  { MT_ADV_CALLBACK, 0,             "GATE\n%s",                                     menu_transform_gate_acb },
+  { MT_ADV_CALLBACK, KM_GATE_START, "GATE START\n" R_LINK_COLOR " %b.4F" S_SECOND, menu_keyboard_acb },
+  { MT_ADV_CALLBACK, KM_GATE_STOP,  "GATE STOP\n"  R_LINK_COLOR " %b.4F" S_SECOND, menu_keyboard_acb },
+  { MT_ADV_CALLBACK, 0,             "SHAPE\n" R_LINK_COLOR " %s",                  menu_transform_gate_shape_acb },
+  { MT_CALLBACK,     0,             "GATE ON\nMARKERS",                            menu_transform_gate_markers_cb },
+  { MT_NONE, 0, NULL, menu_back } // next-> menu_back
+};
+#endif
+
 const menuitem_t menu_transform[] = {
   { MT_ADV_CALLBACK, 0,                       "TRANSFORM\n%s",      menu_transform_acb },
   { MT_ADV_CALLBACK, TD_FUNC_LOWPASS_IMPULSE, "LOW PASS\nIMPULSE",  menu_transform_filter_acb },
@@ -1776,6 +1930,14 @@ const menuitem_t menu_transform[] = {
   { MT_ADV_CALLBACK, TD_FUNC_BANDPASS,        "BANDPASS",           menu_transform_filter_acb },
   { MT_ADV_CALLBACK, 0,                       "WINDOW\n" R_LINK_COLOR " %s", menu_transform_window_acb },
   { MT_ADV_CALLBACK, KM_VELOCITY_FACTOR, "VELOCITY\nFACTOR" R_LINK_COLOR " %d%%%%", menu_keyboard_acb },
+#ifdef __USE_TD_ZOOM__
+  { MT_ADV_CALLBACK, 0,           "ZOOM\n%s",                                     menu_transform_zoom_acb },
+  { MT_ADV_CALLBACK, KM_TD_START, "ZOOM START\n" R_LINK_COLOR " %b.4F" S_SECOND, menu_keyboard_acb },
+  { MT_ADV_CALLBACK, KM_TD_STOP,  "ZOOM STOP\n"  R_LINK_COLOR " %b.4F" S_SECOND, menu_keyboard_acb },
+#endif
+#ifdef __USE_TD_GATE__
+  { MT_SUBMENU,      0,           "GATE",                                          menu_transform_gate },
+#endif
   { MT_NONE, 0, NULL, menu_back } // next-> menu_back
 };
 
@@ -1803,6 +1965,9 @@ const menuitem_t menu_bandwidth[] = {
 #endif
 #ifdef BANDWIDTH_10
   { MT_ADV_CALLBACK, BANDWIDTH_10,   "%u " S_Hz, menu_bandwidth_acb },
+#endif
+#ifdef __USE_IF_FILTER__
+  { MT_ADV_CALLBACK, 0, "FILTER\n" R_LINK_COLOR " %s", menu_if_filter_acb },
 #endif
   { MT_NONE, 0, NULL, menu_back } // next-> menu_back
 };
@@ -1936,6 +2101,9 @@ const menuitem_t menu_marker_measure[] = {
 #ifdef __S11_RESONANCE_MEASURE__
   { MT_ADV_CALLBACK, MEASURE_S11_RESONANCE,"RESONANCE\n (S11)", menu_measure_acb },
 #endif
+#ifdef __S11_DTF_MEASURE__
+  { MT_ADV_CALLBACK, MEASURE_S11_DTF,     "DTF\n (S11)",        menu_measure_acb },
+#endif
 #ifdef __S21_MEASURE__
   { MT_ADV_CALLBACK, MEASURE_SHUNT_LC,    "SHUNT LC\n (S21)",   menu_measure_acb },
   { MT_ADV_CALLBACK, MEASURE_SERIES_LC,   "SERIES LC\n (S21)",  menu_measure_acb },
@@ -2360,6 +2528,24 @@ UI_KEYBOARD_CALLBACK(input_velocity) {
   velocity_factor = keyboard_get_uint();
 }
 
+#ifdef __USE_TD_ZOOM__
+UI_KEYBOARD_CALLBACK(input_td_zoom) {
+  if (b) {b->p1.f = data == KM_TD_START ? td_start : td_stop; return;}
+  if (data == KM_TD_START) td_start = keyboard_get_nfloat();
+  else                     td_stop  = keyboard_get_nfloat();
+  if (domain_func != TD_FUNC_BANDPASS) props_mode|= TD_ZOOM;
+  request_to_redraw(REDRAW_FREQUENCY | REDRAW_MARKER);
+}
+#endif
+
+#ifdef __USE_TD_GATE__
+UI_KEYBOARD_CALLBACK(input_gate) {
+  if (b) {b->p1.f = data == KM_GATE_START ? gate_start : gate_stop; return;}
+  if (data == KM_GATE_START) gate_start = keyboard_get_nfloat();
+  else                       gate_stop  = keyboard_get_nfloat();
+}
+#endif
+
 UI_KEYBOARD_CALLBACK(input_xtal) {
   (void)data;
   if (b) {b->p1.u = config._xtal_freq; return;}
@@ -2458,6 +2644,14 @@ const keypads_list keypads_mode_tbl[KM_NONE] = {
 [KM_XTAL]            = {KEYPAD_FREQ,   0,             "TCXO 26M" S_Hz,      input_xtal     }, // XTAL frequency
 [KM_THRESHOLD]       = {KEYPAD_FREQ,   0,             "THRESHOLD",          input_harmonic }, // Harmonic threshold frequency
 [KM_VBAT]            = {KEYPAD_UFLOAT, 0,             "BAT OFFSET",         input_vbat     }, // Vbat offset input in mV
+#ifdef __USE_TD_ZOOM__
+[KM_TD_START]        = {KEYPAD_NFLOAT, KM_TD_START,   "ZOOM START",         input_td_zoom  }, // time domain zoom start
+[KM_TD_STOP]         = {KEYPAD_NFLOAT, KM_TD_STOP,    "ZOOM STOP",          input_td_zoom  }, // time domain zoom stop
+#endif
+#ifdef __USE_TD_GATE__
+[KM_GATE_START]      = {KEYPAD_NFLOAT, KM_GATE_START, "GATE START",         input_gate     }, // time domain gate start
+[KM_GATE_STOP]       = {KEYPAD_NFLOAT, KM_GATE_STOP,  "GATE STOP",          input_gate     }, // time domain gate stop
+#endif
 #ifdef __S21_MEASURE__
 [KM_MEASURE_R]       = {KEYPAD_UFLOAT, 0,             "MEASURE Rl",         input_measure_r}, // CH0 port impedance in Om
 #endif
@@ -116,7 +116,8 @@ static const float sin_table_512[FAST_MATH_TABLE_SIZE/2 + 1] = {
 #define FFT_SIN(i) sin_table_512[      (i)]
 #define FFT_COS(i) ((i) > 128 ?-sin_table_512[  (i)-128] : sin_table_512[128-  (i)])
 #else
-#error "Need use bigger sin/cos table for new FFT size"
+// Not have table for this FFT size, calculate twiddles by vna_sincosf
+#define FFT_USE_SINCOSF
 #endif
 
 #else
@@ -238,76 +239,155 @@ static const float sin_table_512[] = {
 #define FFT_COS(i) ((i) > 128 ?-sin_table_512[(i)-128] : sin_table_512[128-(i)])
 
 #else
-#error "Need build table for new FFT size"
+// Not have table for this FFT size, calculate twiddles by vna_sincosf
+#define FFT_USE_SINCOSF
 #endif
 
 #else
 // Not use FFT_USE_SIN_COS_TABLE, use direct sin/cos calculations
 #define FFT_SIN(k) sinf((2 * VNA_PI / FFT_SIZE) * (k))
-#define FFT_COS(k) cosf((2 * VNA_PI / FFT_SIZE) * (k));
+#define FFT_COS(k) cosf((2 * VNA_PI / FFT_SIZE) * (k))
 
 #endif // FFT_USE_SIN_COS_TABLE
 
 #endif // __VNA_USE_MATH_TABLES__
 
-#ifdef ARM_MATH_CM4
-// Use CORTEX M4 rbit instruction (reverse bit order in 32bit value)
+#if defined(ARM_MATH_CM4) && defined(__arm__)
+// Use CORTEX M4 rbit instruction (reverse bit order in 32bit value), one cycle, faster then table
 static uint32_t reverse_bits(uint32_t x, int n) {
 	uint32_t result;
 	 __asm volatile ("rbit %0, %1" : "=r" (result) : "r" (x) );
 	return result>>(32-n); // made shift for correct result
 }
 #else
+// Byte bit reverse table, build on compile time
+#define R2(n) (n), (n) + 2*64, (n) + 1*64, (n) + 3*64
+#define R4(n) R2(n), R2((n) + 2*16), R2((n) + 1*16), R2((n) + 3*16)
+#define R6(n) R4(n), R4((n) + 2*4 ), R4((n) + 1*4 ), R4((n) + 3*4 )
+static const uint8_t reverse_byte[256] = {R6(0), R6(2), R6(1), R6(3)};
+#undef R2
+#undef R4
+#undef R6
 static uint16_t reverse_bits(uint16_t x, int n) {
-  uint16_t result = 0;
-  int i;
-  for (i = 0; i < n; i++, x >>= 1)
-    result = (result << 1) | (x & 1U);
-  return result;
+  return ((reverse_byte[x & 0xFF] << 8) | reverse_byte[x >> 8]) >> (16 - n);
 }
 #endif
 
-/***
- * dir = forward: 0, inverse: 1
- * https://www.nayuki.io/res/free-small-fft-in-multiple-languages/fft.c
- */
-void fft(float array[][2], const uint8_t dir) {
 // FFT_SIZE = 2^FFT_N
 #if   FFT_SIZE == 256
  #define FFT_N     8
 #elif FFT_SIZE == 512
  #define FFT_N     9
+#elif FFT_SIZE == 1024
+ #define FFT_N    10
+#elif FFT_SIZE == 2048
+ #define FFT_N    11
 #else
  #error "Need define FFT_N for this FFT size"
 #endif
-  const uint16_t n = FFT_SIZE;
-  const uint8_t levels = FFT_N; // log2(n)
-  uint16_t i, j;
+
+// Return twiddle cos/sin for angle 2*pi*k/FFT_SIZE, k in range 0 .. FFT_SIZE-1
+static void fft_twiddle(uint16_t k, float *c, float *s) {
+#ifdef FFT_USE_SINCOSF
+  vna_sincosf((float)k / FFT_SIZE, s, c);
+#else
+  float sign = 1.0f;
+  if (k > FFT_SIZE / 2) {k-= FFT_SIZE / 2; sign = -1.0f;}
+  *s = sign * FFT_SIN(k);
+  *c = sign * FFT_COS(k);
+#endif
+}
+
+/***
+ * Complex FFT for 2^levels points (levels <= FFT_N), use FFT_SIZE twiddles with step
+ * dir = forward: 0, inverse: 1
+ * Decimation-in-time radix-2^2: two radix-2 stages merged in one pass over data,
+ * need 3 complex multiply on 4 points (radix-2 need 4), for odd levels first stage is radix-2
+ */
+static void fft_n(float array[][2], const uint8_t levels, const uint8_t dir) {
+  const uint16_t n = 1 << levels;
+  uint16_t i, j, k;
   for (i = 0; i < n; i++) {
     if ((j = reverse_bits(i, levels)) > i) {
       SWAP(float, array[i][0], array[j][0]);
       SWAP(float, array[i][1], array[j][1]);
     }
   }
-  const uint16_t size = 2;
-  uint16_t halfsize = size / 2;
-  uint16_t tablestep = n / size;
-  // Cooley-Tukey decimation-in-time radix-2 FFT
-  for (;tablestep; tablestep>>=1, halfsize<<=1) {
-    for (i = 0; i < n; i+= halfsize) {
-      for (j = 0; j < n / size; i++, j+= tablestep) {
-        const uint16_t l = i + halfsize;
-        const float s = dir ? FFT_SIN(j) : -FFT_SIN(j);
-        const float c = FFT_COS(j);
-        const float tpre = array[l][0] * c - array[l][1] * s;
-        const float tpim = array[l][0] * s + array[l][1] * c;
-        array[l][0] = array[i][0] - tpre; array[i][0]+= tpre;
-        array[l][1] = array[i][1] - tpim; array[i][1]+= tpim;
+  uint16_t halfsize = 1;
+  // First radix-2 stage, twiddle = 1
+  if (levels & 1) {
+    for (i = 0; i < n; i+= 2) {
+      const float tpre = array[i+1][0];
+      const float tpim = array[i+1][1];
+      array[i+1][0] = array[i][0] - tpre; array[i][0]+= tpre;
+      array[i+1][1] = array[i][1] - tpim; array[i][1]+= tpim;
+    }
+    halfsize = 2;
+  }
+  const float sign = dir ? 1.0f : -1.0f;
+  for (; halfsize < n; halfsize<<= 2) {
+    const uint16_t tablestep = FFT_SIZE / (4 * halfsize);
+    for (k = 0, j = 0; k < halfsize; k++, j+= tablestep) {
+      // Twiddles w^k, w^2k, w^3k (w = exp(-+2*pi*i/(4*halfsize)))
+      float c1, s1, c2, s2, c3, s3;
+      fft_twiddle(  j, &c1, &s1); s1*= sign;
+      fft_twiddle(2*j, &c2, &s2); s2*= sign;
+      fft_twiddle(3*j, &c3, &s3); s3*= sign;
+      for (i = k; i < n; i+= 4 * halfsize) {
+        float *a0 = array[i], *a1 = array[i + halfsize], *a2 = array[i + 2 * halfsize], *a3 = array[i + 3 * halfsize];
+        // t1 = a1 * w^2k, t2 = a2 * w^k, t3 = a3 * w^3k
+        const float t1re = vna_fmaf(a1[0], c2, -a1[1] * s2), t1im = vna_fmaf(a1[0], s2, a1[1] * c2);
+        const float t2re = vna_fmaf(a2[0], c1, -a2[1] * s1), t2im = vna_fmaf(a2[0], s1, a2[1] * c1);
+        const float t3re = vna_fmaf(a3[0], c3, -a3[1] * s3), t3im = vna_fmaf(a3[0], s3, a3[1] * c3);
+        // first stage
+        const float b0re = a0[0] + t1re, b0im = a0[1] + t1im;
+        const float b1re = a0[0] - t1re, b1im = a0[1] - t1im;
+        const float b2re = t2re  + t3re, b2im = t2im  + t3im;
+        // second stage, b3 = (t2 - t3) * w^halfsize = (t2 - t3) * (-+i)
+        const float b3re = sign * (t3im - t2im), b3im = sign * (t2re - t3re);
+        a0[0] = b0re + b2re; a0[1] = b0im + b2im;
+        a2[0] = b0re - b2re; a2[1] = b0im - b2im;
+        a1[0] = b1re + b3re; a1[1] = b1im + b3im;
+        a3[0] = b1re - b3re; a3[1] = b1im - b3im;
       }
     }
   }
 }
 
+void fft(float array[][2], const uint8_t dir) {
+  fft_n(array, FFT_N, dir);
+}
+
+/***
+ * Inverse FFT with real output, use FFT_SIZE/2 complex FFT
+ * Input:  FFT_SIZE/2 + 1 bins of Hermitian spectrum (bins FFT_SIZE/2+1 .. FFT_SIZE-1 is conjugate),
+ *         imaginary part of bin 0 and FFT_SIZE/2 ignored
+ * Output: FFT_SIZE real values in place, ((float *)array)[i]
+ * Result equal real part of fft_inverse on full size conjugate symmetric array
+ */
+void fft_real_inverse(float array[][2]) {
+  const uint16_t n = FFT_SIZE / 2;
+  uint16_t k;
+  // Split spectrum to even (e) and odd (d) output samples parts, pack as z = e + i * d * exp(2*pi*i*k/FFT_SIZE)
+  const float h0 = array[0][0], hn = array[n][0];
+  array[0][0] = h0 + hn;
+  array[0][1] = h0 - hn;
+  for (k = 1; k <= n / 2; k++) {
+    const uint16_t m = n - k;
+    const float er = array[k][0] + array[m][0], ei = array[k][1] - array[m][1];
+    const float dr = array[k][0] - array[m][0], di = array[k][1] + array[m][1];
+    float c, s;
+    fft_twiddle(k, &c, &s);
+    const float tr = dr * c - di * s;
+    const float ti = dr * s + di * c;
+    // bin m: e = conj(e), d * exp() = conj(d * exp())
+    array[k][0] = er - ti; array[k][1] = ei + tr;
+    array[m][0] = er + ti; array[m][1] = tr - ei;
+  }
+  // Half size inverse FFT, result even samples in real, odd in imaginary part
+  fft_n(array, FFT_N - 1, 1);
+}
+
 // Return sin/cos value angle in range 0.0 to 1.0 (0 is 0 degree, 1 is 360 degree)
 void vna_sincosf(float angle, float * pSinVal, float * pCosVal)
 {
@@ -828,3 +908,43 @@ float vna_expf(float x)
 #endif
   return v.f;
 }
+
+//**********************************************************************************
+// Half precision float (packed calibration, F072 gate normalization cache)
+//**********************************************************************************
+// IEEE 754 half precision pack (round to nearest even, clamp to max value), max relative error 2^-11
+uint16_t
+float_to_half(float v)
+{
+  union {float f; uint32_t i;} u = {v};
+  uint32_t sign = (u.i >> 16) & 0x8000;
+  int32_t  exp  = (int32_t)((u.i >> 23) & 0xFF) - 127 + 15;
+  uint32_t mant = u.i & 0x007FFFFF, h, rem, half;
+  if (exp >= 31) return sign | 0x7BFF;
+  if (exp <= 0) {   // subnormal, step 2^-24
+    if (exp < -10) return sign;
+    mant|= 0x00800000;
+    uint32_t shift = 14 - exp;
+    h = mant >> shift;
+    rem = mant & ((1U << shift) - 1); half = 1U << (shift - 1);
+  } else {
+    h = (exp << 10) | (mant >> 13);
+    rem = mant & 0x1FFF; half = 0x1000;
+  }
+  if (rem > half || (rem == half && (h & 1))) h++; // carry to exponent is correct rounding
+  if (h > 0x7BFF) h = 0x7BFF;
+  return sign | h;
+}
+
+float
+half_to_float(uint16_t h)
+{
+  union {uint32_t i; float f;} u;
+  uint32_t exp = (h >> 10) & 0x1F;
+  if (exp == 0)
+    u.f = (h & 0x3FF) * (1.0f / 16777216.0f);
+  else
+    u.i = ((exp + 127 - 15) << 23) | ((h & 0x3FF) << 13);
+  u.i|= (uint32_t)(h & 0x8000) << 16;
+  return u.f;
+}
@@ -70,6 +70,7 @@ float vna_modff(float x, float *iptr);
 void fft(float array[][2], const uint8_t dir);
 #define fft_forward(array) fft(array, 0)
 #define fft_inverse(array) fft(array, 1)
+void fft_real_inverse(float array[][2]);
 
 // cube root
 float vna_cbrtf(float x);
@@ -77,4 +78,8 @@ float vna_cbrtf(float x);
 // Return sin/cos value, angle have range 0.0 to 1.0 (0 is 0 degree, 1 is 360 degree)
 void vna_sincosf(float angle, float * pSinVal, float * pCosVal);
 
+// IEEE 754 half precision pack/unpack
+uint16_t float_to_half(float v);
+float half_to_float(uint16_t h);
+
 #endif